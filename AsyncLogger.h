@@ -0,0 +1,267 @@
+// Logger writing through per-thread rings drained on a thread.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _ASYNC_LOGGER_H_
+#define _ASYNC_LOGGER_H_
+
+#include "Atomic.h"
+#include "Signal.h"
+
+#include <Core/Thread.h>
+#include <Core/Mutex.h>
+#include <Logging/ILogger.h>
+#include <Utils/Timer.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#define ASYNC_LOGGER_THREAD_LOCAL __declspec(thread)
+#else
+#define ASYNC_LOGGER_THREAD_LOCAL __thread
+#endif
+
+using namespace OpenEngine;
+using namespace OpenEngine::Core;
+using namespace OpenEngine::Logging;
+using std::string;
+
+/**
+ * Takes writing log messages off the threads that log.
+ *
+ * Every thread that logs gets a ring of fixed size records of its own
+ * on its first message; afterwards Write() copies the message and a
+ * time stamp into its ring and publishes it with one atomic store, no
+ * stdio. Long messages take several consecutive records. A drain
+ * thread empties all rings into the file (or stdout), formats the
+ * type and time stamp there and flushes once per pass. It sleeps on a
+ * signal while the rings are empty; Write() only sets the signal when
+ * its ring was empty, which is the only time it takes a lock.
+ *
+ * Memory is bounded by RECORDS records per thread. A message that
+ * does not fit in its ring is dropped and counted; the drain thread
+ * writes the count into the log where the gap is, and GetDropped()
+ * has the total. After Stop() messages are written on the calling
+ * thread; Stop() drains once more when the drain thread has ended, and
+ * a thread that pushed while Stop() ran drains its own ring, so no
+ * message is lost at shutdown.
+ */
+class AsyncLogger : public ILogger {
+public:
+    // Empty path for stdout.
+    AsyncLogger(const string& path = "")
+        : out(stdout), opened(true), stopping(0), running(1), dropped(0) {
+        start = Utils::Timer::GetTime().AsInt();
+        if (!path.empty()) {
+            out = fopen(path.c_str(), "w");
+            opened = out != NULL;
+            if (!opened) out = stdout;
+        }
+        drainer = new Drainer(*this);
+        drainer->Start();
+    }
+
+    ~AsyncLogger() {
+        Stop();
+        for (unsigned int i = 0; i < rings.size(); i++)
+            delete rings[i];
+        if (out != stdout) fclose(out);
+    }
+
+    // False if the file could not be created and stdout is used.
+    bool IsOpen() const { return opened; }
+
+    void Write(LoggerType type, string msg) {
+        if (!Atomic::Load(&running)) {
+            lock.Lock();
+            Format(type, Utils::Timer::GetTime().AsInt(), msg.data(), msg.size());
+            fflush(out);
+            lock.Unlock();
+            return;
+        }
+        Ring* ring = current;
+        if (ring == NULL || ring->owner != this) ring = current = Register();
+        if (ring->Push(type, Utils::Timer::GetTime().AsInt(), msg.data(), msg.size()))
+            wake.Set();
+        // Stop() began meanwhile and may have drained already
+        if (!Atomic::Load(&running)) {
+            lock.Lock();
+            if (DrainRing(*ring)) fflush(out);
+            lock.Unlock();
+        }
+    }
+
+    // Writes out what is queued and stops the drain thread.
+    void Stop() {
+        if (!Atomic::Load(&running)) return;
+        Atomic::Store(&running, 0);
+        Atomic::Store(&stopping, 1);
+        wake.Set();
+        drainer->Wait();
+        delete drainer;
+        drainer = NULL;
+        // what was pushed after the drain thread's last pass
+        lock.Lock();
+        if (DrainRings()) fflush(out);
+        lock.Unlock();
+    }
+
+    unsigned long long GetDropped() const { return dropped; }
+
+private:
+    static const unsigned int RECORDS = 1024;
+    static const unsigned int TEXT = 240;
+
+    struct Record {
+        unsigned long long time;
+        int type;
+        unsigned short length;
+        unsigned char more;     // the message goes on in the next record
+        char text[TEXT];
+    };
+
+    // Single producer, single consumer.
+    class Ring {
+    public:
+        Ring(AsyncLogger* owner)
+            : owner(owner), head(0), tail(0), dropped(0)
+            , pushed(0), popped(0), seen(0) {}
+
+        // True if the ring was empty, so the drain thread may sleep.
+        bool Push(int type, unsigned long long time, const char* text, size_t size) {
+            const unsigned int needed = std::max<size_t>(1, (size + TEXT - 1) / TEXT);
+            const unsigned int h = pushed;
+            // the tail is only read again when the ring looks full
+            if (needed > RECORDS - (h - seen)) {
+                seen = Atomic::Load(&tail);
+                if (needed > RECORDS - (h - seen)) {
+                    Atomic::Add(&dropped, 1);
+                    return false;
+                }
+            }
+            for (unsigned int i = 0; i < needed; i++) {
+                Record& r = records[(h + i) % RECORDS];
+                r.time = time;
+                r.type = type;
+                r.length = std::min<size_t>(TEXT, size - i * TEXT);
+                r.more = i + 1 < needed;
+                std::memcpy(r.text, text + i * TEXT, r.length);
+            }
+            pushed = h + needed;
+            Atomic::Store(&head, (int)pushed);
+            // read after the store: a drain pass that had not seen
+            // this message yet has not caught up either
+            return (unsigned int)Atomic::Load(&tail) == h;
+        }
+
+        AsyncLogger* owner;
+        volatile int head, tail;    // records pushed and popped, wrapping
+        volatile int dropped;       // since the drain thread last looked
+        unsigned int pushed, popped;    // own copies of head and tail
+        unsigned int seen;              // tail as last read by the producer
+        Record records[RECORDS];
+    };
+
+    class Drainer : public Thread {
+    public:
+        Drainer(AsyncLogger& log) : log(log) {}
+        void Run() { log.Drain(); }
+    private:
+        AsyncLogger& log;
+    };
+
+    static ASYNC_LOGGER_THREAD_LOCAL Ring* current;
+
+    FILE* out;
+    bool opened;
+    volatile int stopping;
+    volatile int running;   // 0 once Stop() began
+    unsigned long long start, dropped;
+    Drainer* drainer;
+    Signal wake;
+    std::vector<Ring*> rings;
+    Mutex lock;
+
+    Ring* Register() {
+        Ring* ring = new Ring(this);
+        lock.Lock();
+        rings.push_back(ring);
+        lock.Unlock();
+        return ring;
+    }
+
+    void Drain() {
+        for (;;) {
+            // read the flag first, so nothing pushed before Stop() is missed
+            bool last = Atomic::Load(&stopping) != 0;
+            lock.Lock();
+            bool written = DrainRings();
+            lock.Unlock();
+            if (written) fflush(out);
+            if (last) break;
+            if (!written) wake.Wait();
+        }
+    }
+
+    // Call with the lock held.
+    bool DrainRings() {
+        bool written = false;
+        for (unsigned int i = 0; i < rings.size(); i++)
+            written = DrainRing(*rings[i]) || written;
+        return written;
+    }
+
+    bool DrainRing(Ring& ring) {
+        bool written = false;
+        int lost = Atomic::Exchange(&ring.dropped, 0);
+        if (lost) {
+            dropped += lost;
+            fprintf(out, "[WARNING] %d log messages dropped\n", lost);
+            written = true;
+        }
+        const unsigned int h = Atomic::Load(&ring.head);
+        unsigned int t = ring.popped;
+        bool first = true;
+        for (; t != h; t++) {
+            const Record& r = ring.records[t % RECORDS];
+            if (first) Prefix(r.type, r.time);
+            fwrite(r.text, 1, r.length, out);
+            first = !r.more;
+            if (first) fputc('\n', out);
+            written = true;
+        }
+        ring.popped = t;
+        Atomic::Store(&ring.tail, (int)t);
+        return written;
+    }
+
+    void Format(int type, unsigned long long time, const char* text, size_t size) {
+        Prefix(type, time);
+        fwrite(text, 1, size, out);
+        fputc('\n', out);
+    }
+
+    void Prefix(int type, unsigned long long time) {
+        const char* name;
+        switch (type) {
+        case Error:   name = "ERROR";   break;
+        case Warning: name = "WARNING"; break;
+        case Info:    name = "INFO";    break;
+        default:      name = "DEBUG";   break;
+        }
+        unsigned long long t = time - start;
+        fprintf(out, "[%s] %llu.%06llu: ", name, t / 1000000, t % 1000000);
+    }
+};
+
+ASYNC_LOGGER_THREAD_LOCAL AsyncLogger::Ring* AsyncLogger::current = NULL;
+
+#endif // _ASYNC_LOGGER_H_
@@ -0,0 +1,102 @@
+// Atomic integer operations and a lock-free triple buffer.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _ATOMIC_H_
+#define _ATOMIC_H_
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/**
+ * Atomic operations on an int shared between threads. All of them
+ * are full memory barriers (GCC __sync builtins, Win32 Interlocked
+ * functions), so plain data written before a Store() or Exchange() is
+ * visible to the thread that reads the new value.
+ */
+class Atomic {
+public:
+    static int Load(volatile int* target) {
+        return Add(target, 0);
+    }
+
+    static void Store(volatile int* target, int value) {
+        Exchange(target, value);
+    }
+
+    // Adds delta and returns the new value.
+    static int Add(volatile int* target, int delta) {
+#ifdef _WIN32
+        return InterlockedExchangeAdd((volatile LONG*)target, delta) + delta;
+#else
+        return __sync_add_and_fetch(target, delta);
+#endif
+    }
+
+    // Sets value and returns the old one.
+    static int Exchange(volatile int* target, int value) {
+#ifdef _WIN32
+        return InterlockedExchange((volatile LONG*)target, value);
+#else
+        // __sync_lock_test_and_set is only an acquire barrier
+        __sync_synchronize();
+        return __sync_lock_test_and_set(target, value);
+#endif
+    }
+
+    // Sets desired if the value is expected, returns the old value.
+    static int CompareAndSwap(volatile int* target, int expected, int desired) {
+#ifdef _WIN32
+        return InterlockedCompareExchange((volatile LONG*)target,
+                                          desired, expected);
+#else
+        return __sync_val_compare_and_swap(target, expected, desired);
+#endif
+    }
+};
+
+/**
+ * Hands the latest value of T from one writer thread to one reader
+ * thread without locks or waiting.
+ *
+ * Each side owns one of three slots and the third sits in the middle.
+ * Publish() swaps the writer's slot with the middle one and marks it
+ * fresh; Update() swaps the reader's slot with the middle one if it is
+ * fresh. Neither side ever touches the other's slot, and a value the
+ * reader did not get to before the next Publish() is simply replaced.
+ * Slots are reused, so a T holding vectors stops allocating once they
+ * have grown to size.
+ */
+template <class T> class TripleBuffer {
+public:
+    TripleBuffer() : state(1), back(2), front(0) {}
+
+    // Writer side: fill Back(), then Publish() it.
+    T& Back() { return slots[back]; }
+    void Publish() {
+        back = Atomic::Exchange(&state, back | FRESH) & INDEX;
+    }
+
+    // Reader side: true if Front() changed since the last call.
+    bool Update() {
+        if (!(Atomic::Load(&state) & FRESH)) return false;
+        front = Atomic::Exchange(&state, front) & INDEX;
+        return true;
+    }
+    const T& Front() const { return slots[front]; }
+
+private:
+    static const int INDEX = 3, FRESH = 4;
+
+    T slots[3];
+    volatile int state;     // middle slot and fresh flag
+    int back, front;
+};
+
+#endif // _ATOMIC_H_
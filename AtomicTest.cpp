@@ -0,0 +1,104 @@
+// Checks of the lock free triple buffer handoff.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "Atomic.h"
+#include "TestCheck.h"
+
+#include <Core/Thread.h>
+
+#include <vector>
+
+using namespace OpenEngine::Core;
+
+static void TestSingleThread() {
+    TripleBuffer<int> buffer;
+    CHECK(!buffer.Update());
+
+    buffer.Back() = 1;
+    buffer.Publish();
+    CHECK(buffer.Update());
+    CHECK(buffer.Front() == 1);
+    // nothing new, the front stays
+    CHECK(!buffer.Update());
+    CHECK(buffer.Front() == 1);
+
+    // the reader only sees the latest of several publishes
+    buffer.Back() = 2;
+    buffer.Publish();
+    buffer.Back() = 3;
+    buffer.Publish();
+    CHECK(buffer.Update());
+    CHECK(buffer.Front() == 3);
+    CHECK(!buffer.Update());
+
+    // the writer never gets the slot the reader holds
+    for (int i = 4; i < 20; i++) {
+        buffer.Back() = i;
+        CHECK(&buffer.Back() != &buffer.Front());
+        buffer.Publish();
+        CHECK(&buffer.Back() != &buffer.Front());
+        if (i % 3 == 0) {
+            CHECK(buffer.Update());
+            CHECK(buffer.Front() == i);
+        }
+    }
+}
+
+// Publishes snapshots holding SIZE copies of a rising number.
+class Writer : public Thread {
+public:
+    static const int SNAPSHOTS = 200000;
+    static const unsigned int SIZE = 64;
+
+    Writer(TripleBuffer<std::vector<int> >& buffer) : buffer(buffer) {}
+
+    void Run() {
+        for (int n = 1; n <= SNAPSHOTS; n++) {
+            std::vector<int>& back = buffer.Back();
+            back.assign(SIZE, n);
+            buffer.Publish();
+        }
+    }
+
+private:
+    TripleBuffer<std::vector<int> >& buffer;
+};
+
+// The reader must never see a snapshot being written, nor an older
+// one after a newer.
+static void TestThreads() {
+    TripleBuffer<std::vector<int> > buffer;
+    Writer writer(buffer);
+    writer.Start();
+    int last = 0;
+    bool whole = true, ordered = true;
+    while (last < Writer::SNAPSHOTS) {
+        if (!buffer.Update()) continue;
+        const std::vector<int>& front = buffer.Front();
+        if (front.size() != Writer::SIZE) {
+            whole = false;
+            break;
+        }
+        for (unsigned int i = 1; i < front.size(); i++)
+            if (front[i] != front[0]) whole = false;
+        if (front[0] <= last) ordered = false;
+        last = front[0];
+        if (!whole || !ordered) break;
+    }
+    writer.Wait();
+    CHECK(whole);
+    CHECK(ordered);
+    CHECK(last == Writer::SNAPSHOTS);
+}
+
+int main(int argc, char** argv) {
+    TestSingleThread();
+    TestThreads();
+    return TestFailures();
+}
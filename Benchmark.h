@@ -0,0 +1,272 @@
+// Scripted effect benchmark with golden image comparison.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _BENCHMARK_H_
+#define _BENCHMARK_H_
+
+#include "EffectProfiler.h"
+#include "CPUImage.h"
+
+#include <Core/IEngine.h>
+#include <Core/IListener.h>
+#include <Logging/Logger.h>
+#include <Renderers/IRenderer.h>
+#include <Renderers/OpenGL/IPostProcessingEffect.h>
+#include <Utils/Timer.h>
+#include <Meta/OpenGL.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace OpenEngine;
+using namespace OpenEngine::Core;
+using namespace OpenEngine::Renderers;
+using namespace OpenEngine::Renderers::OpenGL;
+using std::string;
+
+/**
+ * Steps through a script of effect combinations, one after the other.
+ *
+ * Each combination is enabled, rendered for a number of warm-up
+ * frames (lazy construction, program builds, pool allocations) and
+ * then measured for a number of frames. The wall clock frame time is
+ * taken here; the pass timings come from the profiler zones of the
+ * combination. The last measured frame is read back and compared with
+ * the golden image of the combination. It passes when both the mean
+ * difference and the difference that 99% of the pixels stay within
+ * are inside their tolerances. A missing golden fails, unless the
+ * goldens are being updated, which writes them all. When the script
+ * is done the report is written and the engine is stopped.
+ *
+ * Run it with a FixedStepEngine so the frames are the same in every
+ * run. Attach it to the renderer's post process event after the post
+ * processing view.
+ */
+class Benchmark : public IListener<RenderingEventArg> {
+public:
+    Benchmark(IEngine& engine, EffectProfiler& profiler,
+              const std::vector<IPostProcessingEffect*>& effects,
+              const std::vector<string>& names,
+              unsigned int warmup = 30, unsigned int measure = 120)
+        : engine(engine), profiler(profiler), effects(effects), names(names)
+        , warmup(warmup), measure(measure), current(0), frame(0), last(0)
+        , update(false), tolerance(2.0 / 255.0), p99Tolerance(16.0 / 255.0)
+        , failed(0), report("benchmark") {
+        profiler.SetHistory(true);
+    }
+
+    // Effects enabled together, as names separated by '+'.
+    void Add(const string& combination) {
+        script.push_back(combination);
+    }
+
+    // No effects, every effect alone, then some common stacks.
+    void AddDefaultScript() {
+        Add("none");
+        for (unsigned int i = 0; i < names.size(); i++)
+            Add(names[i]);
+        Add("gaussianBlur+glow");
+        Add("simpleDoF+glow+saturate");
+        Add("edgeDetection+toon");
+        Add("toon+grayscale+saturate+pixelate");
+        Add("glow+volumetricLightScattering+dof");
+    }
+
+    // Mean absolute channel difference allowed, and the difference
+    // 99% of the pixels must stay within, in [0,1].
+    void SetGolden(const string& dir, bool updateAll, double meanTolerance,
+                   double p99Tolerance) {
+        golden = dir;
+        update = updateAll;
+        tolerance = meanTolerance;
+        this->p99Tolerance = p99Tolerance;
+    }
+
+    // Base name of the CSV report.
+    void SetReportName(const string& name) { report = name; }
+
+    bool Passed() const { return failed == 0; }
+
+    void Handle(RenderingEventArg arg) {
+        if (current >= script.size()) return;
+        unsigned long long now = Utils::Timer::GetTime().AsInt();
+
+        if (frame == 0) {
+            // this frame was rendered with the previous combination
+            if (!Apply(script[current])) {
+                Next();
+                return;
+            }
+            label = ActiveEffects(effects, names);
+        }
+        else if (frame == warmup) {
+            frameTimes.clear();
+            offsets.clear();
+            for (unsigned int z = 0; z < ZONES; z++) {
+                std::vector<double> gpu, cpu;
+                profiler.GetSamples(Zone(z), gpu, cpu);
+                offsets.push_back(std::make_pair(gpu.size(), cpu.size()));
+            }
+        }
+        else if (frame > warmup) {
+            frameTimes.push_back((now - last) / 1000.0);
+            if (frame == warmup + measure) {
+                Finish();
+                Next();
+                last = Utils::Timer::GetTime().AsInt();
+                return;
+            }
+        }
+        frame++;
+        last = now;
+    }
+
+private:
+    static const unsigned int ZONES = 4;
+
+    IEngine& engine;
+    EffectProfiler& profiler;
+    const std::vector<IPostProcessingEffect*>& effects;
+    const std::vector<string>& names;
+    unsigned int warmup, measure, current, frame;
+    unsigned long long last;
+    std::vector<string> script;
+    string label, golden;
+    bool update;
+    double tolerance, p99Tolerance;
+    unsigned int failed;
+    string report;
+    std::vector<double> frameTimes;
+    std::vector<std::pair<unsigned int, unsigned int> > offsets;
+    std::ostringstream csv;
+
+    string Zone(unsigned int z) const {
+        static const char* kinds[ZONES] = { "pre/", "scene/", "post/", "screen/" };
+        return kinds[z] + label;
+    }
+
+    bool Apply(const string& combination) {
+        std::vector<bool> enable(effects.size(), false);
+        std::istringstream parts(combination);
+        for (string name; std::getline(parts, name, '+'); ) {
+            if (name == "none") continue;
+            unsigned int i = 0;
+            while (i < names.size() && names[i] != name) i++;
+            if (i == names.size()) {
+                logger.warning << "Benchmark skips '" << combination
+                               << "', unknown effect " << name << logger.end;
+                return false;
+            }
+            enable[i] = true;
+        }
+        for (unsigned int i = 0; i < effects.size(); i++)
+            effects[i]->Enable(enable[i]);
+        return true;
+    }
+
+    void Next() {
+        current++;
+        frame = 0;
+        if (current < script.size()) return;
+        WriteReport();
+        engine.Stop();
+    }
+
+    void Finish() {
+        double p50 = EffectProfiler::Percentile(frameTimes, 50);
+        double p95 = EffectProfiler::Percentile(frameTimes, 95);
+        double p99 = EffectProfiler::Percentile(frameTimes, 99);
+        csv << label << ",frame,,,,,,," << p50 << "," << p95 << "," << p99
+            << std::endl;
+
+        double gpuTotal = 0.0;
+        for (unsigned int z = 0; z < ZONES; z++) {
+            std::vector<double> gpu, cpu;
+            profiler.GetSamples(Zone(z), gpu, cpu);
+            gpu.erase(gpu.begin(), gpu.begin() + std::min<size_t>(offsets[z].first, gpu.size()));
+            cpu.erase(cpu.begin(), cpu.begin() + std::min<size_t>(offsets[z].second, cpu.size()));
+            double g50 = EffectProfiler::Percentile(gpu, 50);
+            gpuTotal += g50;
+            csv << label << "," << Zone(z).substr(0, Zone(z).find('/'))
+                << "," << g50
+                << "," << EffectProfiler::Percentile(gpu, 95)
+                << "," << EffectProfiler::Percentile(gpu, 99)
+                << "," << EffectProfiler::Percentile(cpu, 50)
+                << "," << EffectProfiler::Percentile(cpu, 95)
+                << "," << EffectProfiler::Percentile(cpu, 99) << ",,,"
+                << std::endl;
+        }
+
+        logger.info << "Benchmark " << label << ": frame p50 " << p50
+                    << " p95 " << p95 << " p99 " << p99 << " ms, gpu p50 "
+                    << gpuTotal << " ms, " << CompareGolden() << logger.end;
+    }
+
+    string CompareGolden() {
+        if (golden.empty()) return "no golden";
+        GLint vp[4];
+        glGetIntegerv(GL_VIEWPORT, vp);
+        std::vector<unsigned char> pixels(4 * vp[2] * vp[3]);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(vp[0], vp[1], vp[2], vp[3], GL_RGBA, GL_UNSIGNED_BYTE,
+                     &pixels[0]);
+        CPUImage image;
+        image.FromRGBA8(&pixels[0], vp[2], vp[3]);
+
+        std::ostringstream path;
+        path << golden << "/" << label << "_" << vp[2] << "x" << vp[3];
+        CPUImage reference;
+        if (update) {
+            image.SavePPM(path.str() + ".ppm");
+            return "golden written";
+        }
+        std::ifstream exists((path.str() + ".ppm").c_str());
+        if (!exists.good()) {
+            failed++;
+            image.SavePPM(path.str() + ".actual.ppm");
+            return "golden MISSING, run with --update-golden to create it";
+        }
+        exists.close();
+        if (!reference.LoadPPM(path.str() + ".ppm")) {
+            failed++;
+            return "golden unreadable";
+        }
+        double mean = 0.0, p99 = 0.0;
+        double worst = image.Compare(reference, &mean, &p99);
+        std::ostringstream result;
+        if (worst < 0.0 || mean > tolerance || p99 > p99Tolerance) {
+            failed++;
+            image.SavePPM(path.str() + ".actual.ppm");
+            result << "golden FAILED";
+        }
+        else result << "golden ok";
+        result << " (mean " << mean * 255.0 << ", p99 " << p99 * 255.0
+               << ", max " << worst * 255.0 << " of 255)";
+        return result.str();
+    }
+
+    void WriteReport() {
+        std::ofstream out((report + ".csv").c_str());
+        if (!out.good()) {
+            logger.error << "Can not write benchmark report to '"
+                         << report << ".csv'" << logger.end;
+            return;
+        }
+        out << "effects,pass,gpu_p50_ms,gpu_p95_ms,gpu_p99_ms,"
+            << "cpu_p50_ms,cpu_p95_ms,cpu_p99_ms,"
+            << "wall_p50_ms,wall_p95_ms,wall_p99_ms" << std::endl
+            << csv.str();
+        logger.info << "Saved benchmark report to '" << report << ".csv', "
+                    << failed << " golden image mismatches" << logger.end;
+    }
+};
+
+#endif // _BENCHMARK_H_
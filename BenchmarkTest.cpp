@@ -0,0 +1,84 @@
+// Checks of the statistics behind the benchmark report and goldens.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "CPUImage.h"
+#include "EffectProfiler.h"
+#include "TestCheck.h"
+
+static bool Near(double a, double b) {
+    return std::fabs(a - b) < 1e-6;
+}
+
+static void TestPercentile() {
+    std::vector<double> samples;
+    CHECK(EffectProfiler::Percentile(samples, 50) == 0.0);
+    for (int i = 100; i >= 1; i--) samples.push_back(i);
+    // nearest rank on the sorted samples, whatever their order
+    CHECK(EffectProfiler::Percentile(samples, 0) == 1.0);
+    CHECK(EffectProfiler::Percentile(samples, 50) == 50.0);
+    CHECK(EffectProfiler::Percentile(samples, 50.5) == 51.0);
+    CHECK(EffectProfiler::Percentile(samples, 95) == 95.0);
+    CHECK(EffectProfiler::Percentile(samples, 99) == 99.0);
+    CHECK(EffectProfiler::Percentile(samples, 100) == 100.0);
+    std::vector<double> one(1, 7.0);
+    CHECK(EffectProfiler::Percentile(one, 99) == 7.0);
+    // of four samples the 50th percentile is the second, the 51st the
+    // third
+    std::vector<double> four;
+    for (int i = 1; i <= 4; i++) four.push_back(i);
+    CHECK(EffectProfiler::Percentile(four, 50) == 2.0);
+    CHECK(EffectProfiler::Percentile(four, 51) == 3.0);
+}
+
+static void Fill(CPUImage& image, float value) {
+    for (int y = 0; y < image.GetHeight(); y++)
+        for (int x = 0; x < image.GetWidth(); x++) {
+            float* p = image.Pixel(x, y);
+            p[0] = p[1] = p[2] = value;
+            p[3] = 1.0f;
+        }
+}
+
+static void TestCompare() {
+    CPUImage a(10, 10), b(10, 10);
+    Fill(a, 0.5f);
+    Fill(b, 0.5f);
+    double mean = -1.0, p99 = -1.0;
+    CHECK(a.Compare(b, &mean, &p99) == 0.0);
+    CHECK(mean == 0.0 && p99 == 0.0);
+
+    // one pixel of a hundred off: the maximum sees it, the 99th
+    // percentile does not
+    b.Pixel(3, 4)[1] = 1.0f;
+    double worst = a.Compare(b, &mean, &p99);
+    CHECK(Near(worst, 0.5));
+    CHECK(Near(mean, 0.5 / 300.0));
+    CHECK(p99 == 0.0);
+
+    // two pixels off are more than 1%
+    b.Pixel(5, 5)[0] = 0.25f;
+    worst = a.Compare(b, &mean, &p99);
+    CHECK(Near(worst, 0.5));
+    CHECK(p99 >= 0.25 && p99 <= 0.25 + 1.0 / 1024.0);
+
+    // alpha is not compared
+    CPUImage c(10, 10);
+    Fill(c, 0.5f);
+    c.Pixel(0, 0)[3] = 0.0f;
+    CHECK(a.Compare(c, &mean, &p99) == 0.0);
+
+    CPUImage d(10, 11);
+    CHECK(a.Compare(d) < 0.0);
+}
+
+int main(int argc, char** argv) {
+    TestPercentile();
+    TestCompare();
+    return TestFailures();
+}
@@ -0,0 +1,255 @@
+// Bicubic Bezier patch evaluation, scalar reference and SIMD batch.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _BEZIER_PATCH_H_
+#define _BEZIER_PATCH_H_
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define BEZIER_LANES 8
+typedef __m256 bz_float;
+inline bz_float bz_set1(float a)            { return _mm256_set1_ps(a); }
+inline bz_float bz_load(const float* p)     { return _mm256_load_ps(p); }
+inline void     bz_store(float* p, bz_float a) { _mm256_store_ps(p, a); }
+inline bz_float bz_add(bz_float a, bz_float b) { return _mm256_add_ps(a, b); }
+inline bz_float bz_sub(bz_float a, bz_float b) { return _mm256_sub_ps(a, b); }
+inline bz_float bz_mul(bz_float a, bz_float b) { return _mm256_mul_ps(a, b); }
+inline bz_float bz_sqrt(bz_float a)         { return _mm256_sqrt_ps(a); }
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define BEZIER_LANES 4
+typedef __m128 bz_float;
+inline bz_float bz_set1(float a)            { return _mm_set1_ps(a); }
+inline bz_float bz_load(const float* p)     { return _mm_load_ps(p); }
+inline void     bz_store(float* p, bz_float a) { _mm_store_ps(p, a); }
+inline bz_float bz_add(bz_float a, bz_float b) { return _mm_add_ps(a, b); }
+inline bz_float bz_sub(bz_float a, bz_float b) { return _mm_sub_ps(a, b); }
+inline bz_float bz_mul(bz_float a, bz_float b) { return _mm_mul_ps(a, b); }
+inline bz_float bz_sqrt(bz_float a)         { return _mm_sqrt_ps(a); }
+#else
+#define BEZIER_LANES 1
+typedef float bz_float;
+inline bz_float bz_set1(float a)            { return a; }
+inline bz_float bz_load(const float* p)     { return *p; }
+inline void     bz_store(float* p, bz_float a) { *p = a; }
+inline bz_float bz_add(bz_float a, bz_float b) { return a + b; }
+inline bz_float bz_sub(bz_float a, bz_float b) { return a - b; }
+inline bz_float bz_mul(bz_float a, bz_float b) { return a * b; }
+inline bz_float bz_sqrt(bz_float a)         { return std::sqrt(a); }
+#endif
+
+// Evaluated surface point with unit normal.
+struct BezierSample {
+    float position[3];
+    float normal[3];
+};
+
+/**
+ * Scalar reference evaluator for a single bicubic patch.
+ *
+ * The control net is indexed [v][u][xyz] like a GL_MAP2_VERTEX_3
+ * map with u-stride 3 and v-stride 12. The normal is
+ * dP/du x dP/dv, which is what GL_AUTO_NORMAL produces.
+ */
+class BezierPatch {
+public:
+    static void Basis(float t, float b[4], float d[4]) {
+        float s = 1.0f - t;
+        b[0] = s * s * s;
+        b[1] = 3.0f * t * s * s;
+        b[2] = 3.0f * t * t * s;
+        b[3] = t * t * t;
+        d[0] = -3.0f * s * s;
+        d[1] = 3.0f * s * s - 6.0f * t * s;
+        d[2] = 6.0f * t * s - 3.0f * t * t;
+        d[3] = 3.0f * t * t;
+    }
+
+    // Position and unnormalized normal at (u,v).
+    static void Evaluate(const float net[4][4][3], float u, float v,
+                         float pos[3], float nrm[3]) {
+        float bu[4], du[4], bv[4], dv[4];
+        Basis(u, bu, du);
+        Basis(v, bv, dv);
+        float pu[3] = {0, 0, 0}, pv[3] = {0, 0, 0};
+        pos[0] = pos[1] = pos[2] = 0;
+        for (int j = 0; j < 4; j++)
+            for (int k = 0; k < 4; k++)
+                for (int l = 0; l < 3; l++) {
+                    pos[l] += bu[k] * bv[j] * net[j][k][l];
+                    pu[l]  += du[k] * bv[j] * net[j][k][l];
+                    pv[l]  += bu[k] * dv[j] * net[j][k][l];
+                }
+        Cross(pu, pv, nrm);
+    }
+
+    // Evaluate with a unit normal. Collapsed edges (zero derivative,
+    // e.g. the tip of the lid) take the normal from just inside.
+    static void Evaluate(const float net[4][4][3], float u, float v,
+                         BezierSample& out) {
+        float nrm[3];
+        Evaluate(net, u, v, out.position, nrm);
+        float len = Length(nrm);
+        if (len < 1e-6f) {
+            float q[3];
+            Evaluate(net, u + (0.5f - u) * 1e-3f,
+                     v + (0.5f - v) * 1e-3f, q, nrm);
+            len = Length(nrm);
+        }
+        if (len > 0.0f) len = 1.0f / len;
+        for (int l = 0; l < 3; l++) out.normal[l] = nrm[l] * len;
+    }
+
+    // Reference grid evaluation, out is [patch][i][j] with
+    // (grid+1)^2 samples per patch, i along u and j along v.
+    static void EvaluateGrid(const float (*nets)[4][4][3], int count,
+                             int grid, BezierSample* out) {
+        const float step = 1.0f / grid;
+        for (int n = 0; n < count; n++)
+            for (int i = 0; i <= grid; i++)
+                for (int j = 0; j <= grid; j++)
+                    Evaluate(nets[n], i * step, j * step, *out++);
+    }
+
+    static void Cross(const float a[3], const float b[3], float c[3]) {
+        c[0] = a[1] * b[2] - a[2] * b[1];
+        c[1] = a[2] * b[0] - a[0] * b[2];
+        c[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    static float Length(const float a[3]) {
+        return std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+    }
+};
+
+/**
+ * SIMD evaluator for many patches at once.
+ *
+ * Control nets are packed structure-of-arrays so that each SIMD lane
+ * holds one patch; every (u,v) sample of the grid is then evaluated
+ * for BEZIER_LANES patches with the same scalar basis weights.
+ * Output layout and results match BezierPatch::EvaluateGrid (up to
+ * float rounding), which BezierPatchTest checks.
+ */
+class BezierPatchBatch {
+public:
+    BezierPatchBatch(const float (*nets)[4][4][3], int count)
+        : count(std::max(count, 0)),
+          blocks((this->count + BEZIER_LANES - 1) / BEZIER_LANES),
+          data(blocks * BLOCK + BEZIER_LANES), nets(nets) {
+        // keep every block aligned for the vector loads
+        offset = 0;
+        while (((size_t)&data[offset]) % (BEZIER_LANES * sizeof(float)))
+            offset++;
+        // without patches there is no final patch to pad with
+        if (this->count == 0) return;
+        for (int n = 0; n < blocks * BEZIER_LANES; n++) {
+            // pad the last block by repeating the final patch
+            const float (*net)[4][3] = nets[std::min(n, this->count - 1)];
+            float* block = Block(n / BEZIER_LANES);
+            for (int c = 0; c < 16; c++)
+                for (int l = 0; l < 3; l++)
+                    block[(c * 3 + l) * BEZIER_LANES + n % BEZIER_LANES] =
+                        net[c / 4][c % 4][l];
+        }
+    }
+
+    int GetCount() const { return count; }
+
+    void EvaluateGrid(int grid, BezierSample* out) const {
+        const int side = grid + 1;
+        const float step = 1.0f / grid;
+        // weights and derivative weights, shared by u and v
+        std::vector<float> basis(side * 8);
+        for (int i = 0; i <= grid; i++)
+            BezierPatch::Basis(i * step, &basis[i * 8], &basis[i * 8 + 4]);
+
+        bz_float lanes[7];
+        float* res = (float*)lanes;
+        for (int b = 0; b < blocks; b++) {
+            const float* block = Block(b);
+            for (int i = 0; i <= grid; i++) {
+                for (int j = 0; j <= grid; j++) {
+                    EvaluateBlock(block, &basis[i * 8], &basis[j * 8], res);
+                    for (int l = 0; l < BEZIER_LANES; l++) {
+                        int n = b * BEZIER_LANES + l;
+                        if (n >= count) break;
+                        BezierSample& s = out[(n * side + i) * side + j];
+                        Resolve(res, l, n, i * step, j * step, s);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    static const int BLOCK = 16 * 3 * BEZIER_LANES;
+    int count, blocks;
+    std::vector<float> data;
+    size_t offset;
+    const float (*nets)[4][4][3];
+
+    const float* Block(int b) const { return &data[offset + b * BLOCK]; }
+    float* Block(int b) { return &data[offset + b * BLOCK]; }
+
+    // res holds position, dP/du x dP/dv and its length per lane.
+    static void EvaluateBlock(const float* block, const float* bu,
+                              const float* bv, float* res) {
+        bz_float pos[3], pu[3], pv[3];
+        for (int l = 0; l < 3; l++)
+            pos[l] = pu[l] = pv[l] = bz_set1(0.0f);
+        for (int j = 0; j < 4; j++) {
+            for (int k = 0; k < 4; k++) {
+                bz_float wp = bz_set1(bu[k] * bv[j]);
+                bz_float wu = bz_set1(bu[4 + k] * bv[j]);
+                bz_float wv = bz_set1(bu[k] * bv[4 + j]);
+                const float* c = block + (j * 4 + k) * 3 * BEZIER_LANES;
+                for (int l = 0; l < 3; l++) {
+                    bz_float x = bz_load(c + l * BEZIER_LANES);
+                    pos[l] = bz_add(pos[l], bz_mul(wp, x));
+                    pu[l]  = bz_add(pu[l],  bz_mul(wu, x));
+                    pv[l]  = bz_add(pv[l],  bz_mul(wv, x));
+                }
+            }
+        }
+        bz_float n[3];
+        n[0] = bz_sub(bz_mul(pu[1], pv[2]), bz_mul(pu[2], pv[1]));
+        n[1] = bz_sub(bz_mul(pu[2], pv[0]), bz_mul(pu[0], pv[2]));
+        n[2] = bz_sub(bz_mul(pu[0], pv[1]), bz_mul(pu[1], pv[0]));
+        bz_float len = bz_sqrt(bz_add(bz_mul(n[0], n[0]),
+                                      bz_add(bz_mul(n[1], n[1]),
+                                             bz_mul(n[2], n[2]))));
+        for (int l = 0; l < 3; l++) {
+            bz_store(res + l * BEZIER_LANES, pos[l]);
+            bz_store(res + (3 + l) * BEZIER_LANES, n[l]);
+        }
+        bz_store(res + 6 * BEZIER_LANES, len);
+    }
+
+    void Resolve(const float* res, int lane, int n, float u, float v,
+                 BezierSample& s) const {
+        float len = res[6 * BEZIER_LANES + lane];
+        if (len < 1e-6f) {
+            // rare degenerate sample, defer to the reference path
+            BezierPatch::Evaluate(nets[n], u, v, s);
+            return;
+        }
+        len = 1.0f / len;
+        for (int l = 0; l < 3; l++) {
+            s.position[l] = res[l * BEZIER_LANES + lane];
+            s.normal[l] = res[(3 + l) * BEZIER_LANES + lane] * len;
+        }
+    }
+};
+
+#endif // _BEZIER_PATCH_H_
@@ -0,0 +1,47 @@
+// Checks of the SIMD patch evaluator against the scalar one.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "TeaPotMesh.h"
+#include "TestCheck.h"
+
+// Largest position or normal difference between the batch and the
+// scalar reference for the first count teapot patches.
+static float MaxDeviation(int count, int grid) {
+    float patches[TEAPOT_PATCHES][4][4][3];
+    TeaPotMesh::BuildPatches(patches);
+    BezierPatchBatch batch(patches, count);
+    int n = count * (grid + 1) * (grid + 1);
+    std::vector<BezierSample> a(n + 1), b(n + 1);
+    batch.EvaluateGrid(grid, &a[0]);
+    BezierPatch::EvaluateGrid(patches, count, grid, &b[0]);
+    float worst = 0.0f;
+    for (int s = 0; s < n; s++)
+        for (int l = 0; l < 3; l++) {
+            worst = std::max(worst, std::fabs(a[s].position[l] - b[s].position[l]));
+            worst = std::max(worst, std::fabs(a[s].normal[l] - b[s].normal[l]));
+        }
+    return worst;
+}
+
+int main(int argc, char** argv) {
+    CHECK(MaxDeviation(TEAPOT_PATCHES, 7) < 1e-4f);
+    CHECK(MaxDeviation(TEAPOT_PATCHES, 28) < 1e-4f);
+    // a last block padded with copies of the final patch
+    CHECK(MaxDeviation(BEZIER_LANES + 1, 4) < 1e-4f);
+    CHECK(MaxDeviation(1, 4) < 1e-4f);
+
+    // no patches: nothing is evaluated or written
+    BezierPatchBatch empty(NULL, 0);
+    CHECK(empty.GetCount() == 0);
+    BezierSample untouched = { {1.0f, 2.0f, 3.0f}, {0.0f, 0.0f, 1.0f} };
+    empty.EvaluateGrid(4, &untouched);
+    CHECK(untouched.position[0] == 1.0f && untouched.normal[2] == 1.0f);
+    CHECK(BezierPatchBatch(NULL, -3).GetCount() == 0);
+    return TestFailures();
+}
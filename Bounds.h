@@ -0,0 +1,144 @@
+// Bounding volumes and view frustum tests.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _BOUNDS_H_
+#define _BOUNDS_H_
+
+#include <Meta/OpenGL.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+struct BoundingSphere {
+    float center[3];
+    float radius;
+};
+
+struct BoundingBox {
+    float min[3], max[3];
+
+    void Clear() {
+        for (int i = 0; i < 3; i++) {
+            min[i] = FLT_MAX;
+            max[i] = -FLT_MAX;
+        }
+    }
+
+    bool IsEmpty() const { return min[0] > max[0]; }
+
+    void Add(const BoundingBox& b) {
+        for (int i = 0; i < 3; i++) {
+            min[i] = std::min(min[i], b.min[i]);
+            max[i] = std::max(max[i], b.max[i]);
+        }
+    }
+
+    void Add(const BoundingSphere& s) {
+        for (int i = 0; i < 3; i++) {
+            min[i] = std::min(min[i], s.center[i] - s.radius);
+            max[i] = std::max(max[i], s.center[i] + s.radius);
+        }
+    }
+
+    BoundingSphere GetSphere() const {
+        BoundingSphere s;
+        float r = 0.0f;
+        for (int i = 0; i < 3; i++) {
+            s.center[i] = (min[i] + max[i]) * 0.5f;
+            float h = (max[i] - min[i]) * 0.5f;
+            r += h * h;
+        }
+        s.radius = std::sqrt(r);
+        return s;
+    }
+};
+
+// Render nodes that know the extent of what they draw, in their own
+// coordinate system.
+class IBounded {
+public:
+    virtual ~IBounded() {}
+    virtual BoundingSphere GetBounds() const = 0;
+};
+
+/**
+ * The six clip planes of a projection and modelview, in the
+ * coordinate system the modelview maps from. Taking the planes from
+ * the current GL matrices culls against whatever view is being
+ * rendered, be it the camera or a light.
+ */
+class FrustumPlanes {
+public:
+    static const unsigned int ALL = 0x3f;
+
+    void FromCurrentGL() {
+        float proj[16], mv[16];
+        glGetFloatv(GL_PROJECTION_MATRIX, proj);
+        glGetFloatv(GL_MODELVIEW_MATRIX, mv);
+        FromMatrices(proj, mv);
+    }
+
+    // Column major matrices, as returned by glGetFloatv.
+    void FromMatrices(const float proj[16], const float mv[16]) {
+        float m[16];
+        for (int c = 0; c < 4; c++)
+            for (int r = 0; r < 4; r++) {
+                float v = 0.0f;
+                for (int k = 0; k < 4; k++)
+                    v += proj[k * 4 + r] * mv[c * 4 + k];
+                m[c * 4 + r] = v;
+            }
+        // w +- x, w +- y, w +- z
+        for (int p = 0; p < 6; p++) {
+            int row = p / 2;
+            float sign = p % 2 ? -1.0f : 1.0f;
+            for (int c = 0; c < 4; c++)
+                planes[p][c] = m[c * 4 + 3] + sign * m[c * 4 + row];
+            float len = std::sqrt(planes[p][0] * planes[p][0] +
+                                  planes[p][1] * planes[p][1] +
+                                  planes[p][2] * planes[p][2]);
+            if (len > 0.0f)
+                for (int c = 0; c < 4; c++) planes[p][c] /= len;
+        }
+    }
+
+    // True if the box is outside. Planes the box is entirely inside
+    // are cleared from mask, so children of the box skip them.
+    bool Cull(const BoundingBox& box, unsigned int& mask) const {
+        for (int p = 0; p < 6; p++) {
+            if (!(mask & (1u << p))) continue;
+            const float* n = planes[p];
+            // signed distances of the corners most and least inside
+            float most = n[3], least = n[3];
+            for (int i = 0; i < 3; i++) {
+                most  += n[i] * (n[i] > 0.0f ? box.max[i] : box.min[i]);
+                least += n[i] * (n[i] > 0.0f ? box.min[i] : box.max[i]);
+            }
+            if (most < 0.0f) return true;
+            if (least >= 0.0f) mask &= ~(1u << p);
+        }
+        return false;
+    }
+
+    bool Cull(const BoundingSphere& sphere) const {
+        for (int p = 0; p < 6; p++) {
+            const float* n = planes[p];
+            float d = n[0] * sphere.center[0] + n[1] * sphere.center[1] +
+                n[2] * sphere.center[2] + n[3];
+            if (d < -sphere.radius) return true;
+        }
+        return false;
+    }
+
+private:
+    float planes[6][4];    // inside where a*x + b*y + c*z + d >= 0
+};
+
+#endif // _BOUNDS_H_
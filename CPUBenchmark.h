@@ -0,0 +1,136 @@
+// Throughput benchmark and offline batch mode for the CPU effects.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _CPU_BENCHMARK_H_
+#define _CPU_BENCHMARK_H_
+
+#include "CPUEffects.h"
+
+#include <Logging/Logger.h>
+#include <Utils/Timer.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace OpenEngine;
+using std::string;
+
+// Deterministic frame with smooth gradients, hard edges and a depth
+// ramp, so every effect has something to do.
+inline void MakeCPUTestImage(CPUImage& color, CPUImage& depth,
+                             int width, int height) {
+    color.Resize(width, height);
+    depth.Resize(width, height);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++) {
+            float u = (float)x / width, v = (float)y / height;
+            bool check = ((x / 32) + (y / 32)) % 2 == 0;
+            float* c = color.Pixel(x, y);
+            c[0] = u;
+            c[1] = v;
+            c[2] = check ? 0.9f : 0.1f;
+            c[3] = 1.0f;
+            depth.Pixel(x, y)[0] = 1.0f + 20.0f * u;
+        }
+}
+
+/**
+ * Runs every CPU effect on a width x height frame with 1, 2, 4, ...
+ * threads up to maxThreads and logs megapixels per second. Each
+ * measurement repeats the effect for at least a fifth of a second.
+ */
+inline void RunCPUBenchmark(int width, int height, unsigned int maxThreads) {
+    CPUImage in, depth, out;
+    MakeCPUTestImage(in, depth, width, height);
+    TileScheduler scheduler;
+    CPUEffects effects(scheduler);
+    std::vector<string> names = CPUEffects::GetNames();
+
+    std::vector<unsigned int> counts;
+    for (unsigned int t = 1; t < maxThreads; t *= 2) counts.push_back(t);
+    counts.push_back(maxThreads);
+
+    logger.info << "CPU effects on " << width << "x" << height
+                << (CPU_IMAGE_SIMD ? " (SSE)" : " (scalar)") << logger.end;
+    for (unsigned int n = 0; n < names.size(); n++) {
+        std::ostringstream line;
+        line << names[n] << ":";
+        for (unsigned int c = 0; c < counts.size(); c++) {
+            scheduler.SetThreadCount(counts[c]);
+            unsigned int runs = 0;
+            unsigned long long start = Utils::Timer::GetTime().AsInt(), elapsed;
+            do {
+                effects.Apply(names[n], in, &depth, out);
+                runs++;
+                elapsed = Utils::Timer::GetTime().AsInt() - start;
+            } while (elapsed < 200000);
+            double mps = (double)width * height * runs / elapsed;
+            line << " " << counts[c] << "t " << mps << " MP/s";
+        }
+        logger.info << line.str() << logger.end;
+    }
+}
+
+/**
+ * Applies a comma separated list of effects, in order, to every frame
+ * named in a list file and writes the results with the same file name
+ * into outDir. A line of the list is a PPM path, optionally followed by
+ * a PFM with linear depth for the effects that need it.
+ */
+inline bool RunCPUBatch(const string& effectList, const string& listFile,
+                        const string& outDir, unsigned int threads) {
+    std::vector<string> chain;
+    std::istringstream names(effectList);
+    for (string name; std::getline(names, name, ','); )
+        if (!name.empty()) chain.push_back(name);
+
+    std::ifstream list(listFile.c_str());
+    if (!list.good()) {
+        logger.error << "Can not open frame list '" << listFile << "'"
+                     << logger.end;
+        return false;
+    }
+    TileScheduler scheduler(threads);
+    CPUEffects effects(scheduler);
+    unsigned int frames = 0;
+    unsigned long long start = Utils::Timer::GetTime().AsInt();
+    for (string line; std::getline(list, line); ) {
+        std::istringstream fields(line);
+        string colorPath, depthPath;
+        if (!(fields >> colorPath)) continue;
+        fields >> depthPath;
+
+        CPUImage a, b, depth;
+        if (!a.LoadPPM(colorPath)) return false;
+        if (!depthPath.empty() && !depth.LoadDepthPFM(depthPath)) return false;
+        for (unsigned int i = 0; i < chain.size(); i++) {
+            if (!effects.Apply(chain[i], a, depth.IsEmpty() ? NULL : &depth, b)) {
+                logger.error << "Can not apply '" << chain[i] << "' to "
+                             << colorPath
+                             << (CPUEffects::NeedsDepth(chain[i]) ?
+                                 " (needs a depth image)" : "")
+                             << logger.end;
+                return false;
+            }
+            a.Swap(b);
+        }
+        string::size_type slash = colorPath.find_last_of("/\\");
+        string file = slash == string::npos ? colorPath : colorPath.substr(slash + 1);
+        if (!a.SavePPM(outDir + "/" + file)) return false;
+        frames++;
+    }
+    double seconds = (Utils::Timer::GetTime().AsInt() - start) / 1000000.0;
+    logger.info << "Processed " << frames << " frames in " << seconds
+                << " s" << logger.end;
+    return true;
+}
+
+#endif // _CPU_BENCHMARK_H_
@@ -0,0 +1,343 @@
+// CPU approximations of the post processing effects.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _CPU_EFFECTS_H_
+#define _CPU_EFFECTS_H_
+
+#include "CPUImage.h"
+#include "TileScheduler.h"
+
+#include <string>
+#include <vector>
+
+/**
+ * The effect set on float images, without a GL context.
+ *
+ * These are CPU-only approximations under the names of the effects,
+ * written without the shader sources of the effects extension that
+ * the GPU path runs: the glow gain, the focus of the depth of field
+ * and the like are the backend's own. Their output is not a reference
+ * for the GPU frames. CPUEffectsTest checks every kernel on hand
+ * computed pixels, and that the output does not depend on the number
+ * of threads. Pixels are processed one RGBA register at a time and the
+ * image is split into tiles across the threads of the scheduler.
+ * Borders are clamped like GL_CLAMP_TO_EDGE. in and out must be
+ * different images.
+ */
+class CPUEffects {
+public:
+    CPUEffects(TileScheduler& scheduler) : scheduler(scheduler) {}
+
+    void GrayScale(const CPUImage& in, CPUImage& out) {
+        Pointwise<GrayScaleOp>(in, out);
+    }
+
+    // Distance from the luminance doubled.
+    void Saturate(const CPUImage& in, CPUImage& out) {
+        Pointwise<SaturateOp>(in, out);
+    }
+
+    // Channels quantized to five levels.
+    void Toon(const CPUImage& in, CPUImage& out) {
+        Pointwise<ToonOp>(in, out);
+    }
+
+    // Every 8x8 block takes the color at its centre.
+    void Pixelate(const CPUImage& in, CPUImage& out) {
+        out.Resize(in.GetWidth(), in.GetHeight());
+        PixelateKernel k(in, out);
+        scheduler.Run(k, in.GetWidth(), in.GetHeight());
+    }
+
+    // Sobel gradient magnitude of the luminance.
+    void EdgeDetection(const CPUImage& in, CPUImage& out) {
+        out.Resize(in.GetWidth(), in.GetHeight());
+        EdgeKernel k(in, out);
+        scheduler.Run(k, in.GetWidth(), in.GetHeight());
+    }
+
+    // 3x3 box filter.
+    void SimpleBlur(const CPUImage& in, CPUImage& out) {
+        static const float box[] = { 1.0f / 3.0f, 1.0f / 3.0f };
+        Separable(in, out, box, 1);
+    }
+
+    // Separable 9 tap gaussian.
+    void GaussianBlur(const CPUImage& in, CPUImage& out) {
+        Separable(in, out, Gaussian(), 4);
+    }
+
+    // Bright pass, blurred twice and added on top.
+    void Glow(const CPUImage& in, CPUImage& out) {
+        CPUImage bright, blurred;
+        Pointwise<BrightOp>(in, bright);
+        GaussianBlur(bright, blurred);
+        GaussianBlur(blurred, bright);
+        Combine<GlowOp>(in, bright, NULL, out);
+    }
+
+    // Blur blended in by distance from the depth at the centre of the
+    // screen. depth holds linear eye depth in the red channel.
+    void SimpleDoF(const CPUImage& in, const CPUImage& depth, CPUImage& out) {
+        CPUImage blurred;
+        GaussianBlur(in, blurred);
+        DoFOp op;
+        op.focus = depth.Pixel(depth.GetWidth() / 2, depth.GetHeight() / 2)[0];
+        Combine<DoFOp>(in, blurred, &depth, out, op);
+    }
+
+    static std::vector<std::string> GetNames() {
+        static const char* names[] = {
+            "grayscale", "saturate", "toon", "pixelate", "edgeDetection",
+            "simpleBlur", "gaussianBlur", "glow", "simpleDoF"
+        };
+        return std::vector<std::string>(names, names + sizeof(names) / sizeof(names[0]));
+    }
+
+    static bool NeedsDepth(const std::string& name) {
+        return name == "simpleDoF";
+    }
+
+    // Run an effect by the name used in main.cpp. Returns false for
+    // unknown names or a missing depth image.
+    bool Apply(const std::string& name, const CPUImage& in,
+               const CPUImage* depth, CPUImage& out) {
+        if (name == "grayscale") GrayScale(in, out);
+        else if (name == "saturate") Saturate(in, out);
+        else if (name == "toon") Toon(in, out);
+        else if (name == "pixelate") Pixelate(in, out);
+        else if (name == "edgeDetection") EdgeDetection(in, out);
+        else if (name == "simpleBlur") SimpleBlur(in, out);
+        else if (name == "gaussianBlur") GaussianBlur(in, out);
+        else if (name == "glow") Glow(in, out);
+        else if (name == "simpleDoF" && depth) SimpleDoF(in, *depth, out);
+        else return false;
+        return true;
+    }
+
+private:
+    TileScheduler& scheduler;
+
+    // 9 tap gaussian, from the centre out.
+    static const float* Gaussian() {
+        static const float w[] = {
+            0.2270270270f, 0.1945945946f, 0.1216216216f, 0.0540540541f, 0.0162162162f
+        };
+        return w;
+    }
+
+    static px_float Luminance() { return px_set(0.299f, 0.587f, 0.114f, 0.0f); }
+
+    // point-wise operations
+
+    struct GrayScaleOp {
+        px_float operator()(px_float c) const {
+            return px_keep_alpha(px_dot3(c, Luminance()), c);
+        }
+    };
+
+    struct SaturateOp {
+        px_float operator()(px_float c) const {
+            px_float l = px_dot3(c, Luminance());
+            px_float s = px_add(l, px_mul(px_sub(c, l), px_set1(2.0f)));
+            s = px_min(px_max(s, px_set1(0.0f)), px_set1(1.0f));
+            return px_keep_alpha(s, c);
+        }
+    };
+
+    struct ToonOp {
+        px_float operator()(px_float c) const {
+            px_float q = px_floor(px_add(px_mul(px_max(c, px_set1(0.0f)),
+                                                px_set1(4.0f)), px_set1(0.5f)));
+            return px_keep_alpha(px_mul(q, px_set1(0.25f)), c);
+        }
+    };
+
+    struct BrightOp {
+        px_float operator()(px_float c) const {
+            return px_mul(px_max(px_sub(c, px_set1(0.6f)), px_set1(0.0f)),
+                          px_set1(2.5f));
+        }
+    };
+
+    // combine operations on (frame, processed, depth)
+
+    struct GlowOp {
+        px_float operator()(px_float c, px_float b, float) const {
+            return px_keep_alpha(px_add(c, px_mul(b, px_set1(1.5f))), c);
+        }
+    };
+
+    struct DoFOp {
+        float focus;
+        px_float operator()(px_float c, px_float b, float z) const {
+            float t = std::fabs(z - focus) / (0.5f * focus);
+            t = std::max(0.0f, std::min(1.0f, t));
+            return px_add(c, px_mul(px_sub(b, c), px_set1(t)));
+        }
+    };
+
+    template <class Op>
+    class PointwiseKernel : public ITileKernel {
+    public:
+        PointwiseKernel(const CPUImage& in, CPUImage& out) : in(in), out(out) {}
+        void Run(int x0, int y0, int x1, int y1) {
+            for (int y = y0; y < y1; y++) {
+                const float* src = in.Row(y);
+                float* dst = out.Row(y);
+                for (int x = x0; x < x1; x++)
+                    px_store(dst + 4 * x, op(px_load(src + 4 * x)));
+            }
+        }
+    private:
+        const CPUImage& in;
+        CPUImage& out;
+        Op op;
+    };
+
+    template <class Op>
+    class CombineKernel : public ITileKernel {
+    public:
+        CombineKernel(const CPUImage& a, const CPUImage& b,
+                      const CPUImage* depth, CPUImage& out, Op op)
+            : a(a), b(b), depth(depth), out(out), op(op) {}
+        void Run(int x0, int y0, int x1, int y1) {
+            for (int y = y0; y < y1; y++) {
+                const float* pa = a.Row(y);
+                const float* pb = b.Row(y);
+                const float* pz = depth ? depth->Row(y) : NULL;
+                float* dst = out.Row(y);
+                for (int x = x0; x < x1; x++)
+                    px_store(dst + 4 * x, op(px_load(pa + 4 * x), px_load(pb + 4 * x),
+                                             pz ? pz[4 * x] : 0.0f));
+            }
+        }
+    private:
+        const CPUImage& a;
+        const CPUImage& b;
+        const CPUImage* depth;
+        CPUImage& out;
+        Op op;
+    };
+
+    // One direction of a symmetric filter with taps w[0..radius].
+    class ConvolveKernel : public ITileKernel {
+    public:
+        ConvolveKernel(const CPUImage& in, CPUImage& out, const float* w,
+                       int radius, bool vertical)
+            : in(in), out(out), w(w), radius(radius), vertical(vertical) {}
+        void Run(int x0, int y0, int x1, int y1) {
+            const int width = in.GetWidth(), height = in.GetHeight();
+            for (int y = y0; y < y1; y++) {
+                float* dst = out.Row(y);
+                for (int x = x0; x < x1; x++) {
+                    px_float sum = px_mul(px_load(in.Row(y) + 4 * x), px_set1(w[0]));
+                    for (int k = 1; k <= radius; k++) {
+                        const float *p, *m;
+                        if (vertical) {
+                            p = in.Row(std::min(height - 1, y + k)) + 4 * x;
+                            m = in.Row(std::max(0, y - k)) + 4 * x;
+                        }
+                        else {
+                            p = in.Row(y) + 4 * std::min(width - 1, x + k);
+                            m = in.Row(y) + 4 * std::max(0, x - k);
+                        }
+                        sum = px_add(sum, px_mul(px_add(px_load(p), px_load(m)),
+                                                 px_set1(w[k])));
+                    }
+                    px_store(dst + 4 * x, sum);
+                }
+            }
+        }
+    private:
+        const CPUImage& in;
+        CPUImage& out;
+        const float* w;
+        int radius;
+        bool vertical;
+    };
+
+    class PixelateKernel : public ITileKernel {
+    public:
+        PixelateKernel(const CPUImage& in, CPUImage& out) : in(in), out(out) {}
+        void Run(int x0, int y0, int x1, int y1) {
+            for (int y = y0; y < y1; y++) {
+                // the block centre falls between texels 3 and 4
+                int by = y / 8 * 8 + 3;
+                float* dst = out.Row(y);
+                for (int x = x0; x < x1; x++) {
+                    int bx = x / 8 * 8 + 3;
+                    px_float s = px_add(px_add(px_load(in.Pixel(bx, by)),
+                                               px_load(in.Pixel(bx + 1, by))),
+                                        px_add(px_load(in.Pixel(bx, by + 1)),
+                                               px_load(in.Pixel(bx + 1, by + 1))));
+                    px_store(dst + 4 * x, px_mul(s, px_set1(0.25f)));
+                }
+            }
+        }
+    private:
+        const CPUImage& in;
+        CPUImage& out;
+    };
+
+    class EdgeKernel : public ITileKernel {
+    public:
+        EdgeKernel(const CPUImage& in, CPUImage& out) : in(in), out(out) {}
+        void Run(int x0, int y0, int x1, int y1) {
+            const px_float lum = Luminance();
+            for (int y = y0; y < y1; y++) {
+                float* dst = out.Row(y);
+                for (int x = x0; x < x1; x++) {
+                    float l[3][3];
+                    for (int j = 0; j < 3; j++)
+                        for (int i = 0; i < 3; i++) {
+                            float t[4];
+                            px_store(t, px_dot3(px_load(in.Pixel(x + i - 1, y + j - 1)), lum));
+                            l[j][i] = t[0];
+                        }
+                    float gx = (l[0][2] + 2 * l[1][2] + l[2][2]) -
+                        (l[0][0] + 2 * l[1][0] + l[2][0]);
+                    float gy = (l[2][0] + 2 * l[2][1] + l[2][2]) -
+                        (l[0][0] + 2 * l[0][1] + l[0][2]);
+                    float e = std::min(1.0f, std::sqrt(gx * gx + gy * gy));
+                    px_store(dst + 4 * x, px_set(e, e, e, in.Row(y)[4 * x + 3]));
+                }
+            }
+        }
+    private:
+        const CPUImage& in;
+        CPUImage& out;
+    };
+
+    template <class Op>
+    void Pointwise(const CPUImage& in, CPUImage& out) {
+        out.Resize(in.GetWidth(), in.GetHeight());
+        PointwiseKernel<Op> k(in, out);
+        scheduler.Run(k, in.GetWidth(), in.GetHeight());
+    }
+
+    template <class Op>
+    void Combine(const CPUImage& a, const CPUImage& b, const CPUImage* depth,
+                 CPUImage& out, Op op = Op()) {
+        out.Resize(a.GetWidth(), a.GetHeight());
+        CombineKernel<Op> k(a, b, depth, out, op);
+        scheduler.Run(k, a.GetWidth(), a.GetHeight());
+    }
+
+    void Separable(const CPUImage& in, CPUImage& out, const float* w, int radius) {
+        CPUImage temp(in.GetWidth(), in.GetHeight());
+        out.Resize(in.GetWidth(), in.GetHeight());
+        ConvolveKernel h(in, temp, w, radius, false);
+        scheduler.Run(h, in.GetWidth(), in.GetHeight());
+        ConvolveKernel v(temp, out, w, radius, true);
+        scheduler.Run(v, in.GetWidth(), in.GetHeight());
+    }
+};
+
+#endif // _CPU_EFFECTS_H_
@@ -0,0 +1,169 @@
+// Checks of the CPU effects on hand computed pixels.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "CPUBenchmark.h"
+#include "TestCheck.h"
+
+#include <cstring>
+
+static bool Near(float a, float b) {
+    return std::fabs(a - b) < 1e-5f;
+}
+
+static bool PixelNear(const CPUImage& image, int x, int y,
+                      float r, float g, float b, float a) {
+    const float* p = image.Pixel(x, y);
+    return Near(p[0], r) && Near(p[1], g) && Near(p[2], b) && Near(p[3], a);
+}
+
+static void Fill(CPUImage& image, int width, int height,
+                 float r, float g, float b, float a) {
+    image.Resize(width, height);
+    for (int y = 0; y < height; y++)
+        for (int x = 0; x < width; x++) {
+            float* p = image.Pixel(x, y);
+            p[0] = r; p[1] = g; p[2] = b; p[3] = a;
+        }
+}
+
+static void Set(CPUImage& image, int x, int y,
+                float r, float g, float b, float a) {
+    float* p = image.Pixel(x, y);
+    p[0] = r; p[1] = g; p[2] = b; p[3] = a;
+}
+
+static void TestPointwise(CPUEffects& effects) {
+    CPUImage in, out;
+    Fill(in, 3, 2, 0.0f, 0.0f, 0.0f, 1.0f);
+    Set(in, 0, 0, 1.0f, 0.5f, 0.0f, 0.25f);
+    Set(in, 1, 0, 0.5f, 0.5f, 0.2f, 1.0f);
+    Set(in, 2, 0, 0.1f, 0.3f, 0.62f, 0.5f);
+
+    // luminance 0.299 + 0.587 / 2, alpha kept
+    effects.GrayScale(in, out);
+    CHECK(PixelNear(out, 0, 0, 0.5925f, 0.5925f, 0.5925f, 0.25f));
+
+    // 2c - l with l = 0.4658, clamped to [0,1]
+    effects.Saturate(in, out);
+    CHECK(PixelNear(out, 1, 0, 0.5342f, 0.5342f, 0.0f, 1.0f));
+    CHECK(PixelNear(out, 0, 0, 1.0f, 0.4075f, 0.0f, 0.25f));
+
+    // rounded to quarters
+    effects.Toon(in, out);
+    CHECK(PixelNear(out, 2, 0, 0.0f, 0.25f, 0.5f, 0.5f));
+    CHECK(PixelNear(out, 0, 0, 1.0f, 0.5f, 0.0f, 0.25f));
+}
+
+static void TestPixelate(CPUEffects& effects) {
+    // red holds x + 100 y; a block takes the mean of its four centre
+    // texels
+    CPUImage in, out;
+    Fill(in, 16, 8, 0.0f, 0.0f, 0.0f, 1.0f);
+    for (int y = 0; y < 8; y++)
+        for (int x = 0; x < 16; x++)
+            in.Pixel(x, y)[0] = x + 100.0f * y;
+    effects.Pixelate(in, out);
+    CHECK(Near(out.Pixel(0, 0)[0], 353.5f));
+    CHECK(Near(out.Pixel(5, 2)[0], 353.5f));
+    CHECK(Near(out.Pixel(9, 7)[0], 361.5f));
+}
+
+static void TestEdgeDetection(CPUEffects& effects) {
+    // a vertical step from black to a gray of luminance 0.1
+    CPUImage in, out;
+    Fill(in, 8, 4, 0.0f, 0.0f, 0.0f, 0.5f);
+    for (int y = 0; y < 4; y++)
+        for (int x = 4; x < 8; x++)
+            Set(in, x, y, 0.1f, 0.1f, 0.1f, 0.5f);
+    effects.EdgeDetection(in, out);
+    CHECK(PixelNear(out, 1, 1, 0.0f, 0.0f, 0.0f, 0.5f));
+    CHECK(PixelNear(out, 3, 1, 0.4f, 0.4f, 0.4f, 0.5f));
+    CHECK(PixelNear(out, 4, 0, 0.4f, 0.4f, 0.4f, 0.5f));
+    CHECK(PixelNear(out, 6, 2, 0.0f, 0.0f, 0.0f, 0.5f));
+}
+
+static void TestBlurs(CPUEffects& effects) {
+    // an impulse spreads by the product of the taps
+    CPUImage in, out;
+    Fill(in, 11, 11, 0.0f, 0.0f, 0.0f, 1.0f);
+    Set(in, 5, 5, 1.0f, 0.0f, 0.0f, 1.0f);
+
+    effects.SimpleBlur(in, out);
+    CHECK(PixelNear(out, 5, 5, 1.0f / 9.0f, 0.0f, 0.0f, 1.0f));
+    CHECK(PixelNear(out, 4, 6, 1.0f / 9.0f, 0.0f, 0.0f, 1.0f));
+    CHECK(PixelNear(out, 3, 5, 0.0f, 0.0f, 0.0f, 1.0f));
+
+    const float w0 = 0.2270270270f, w1 = 0.1945945946f, w4 = 0.0162162162f;
+    effects.GaussianBlur(in, out);
+    CHECK(PixelNear(out, 5, 5, w0 * w0, 0.0f, 0.0f, 1.0f));
+    CHECK(PixelNear(out, 6, 4, w1 * w1, 0.0f, 0.0f, 1.0f));
+    CHECK(PixelNear(out, 9, 5, w4 * w0, 0.0f, 0.0f, 1.0f));
+    CHECK(PixelNear(out, 10, 5, 0.0f, 0.0f, 0.0f, 1.0f));
+}
+
+static void TestGlow(CPUEffects& effects) {
+    // on a flat frame the blurs change nothing: 2.5 (c - 0.6) above
+    // the threshold, added with a gain of 1.5
+    CPUImage in, out;
+    Fill(in, 20, 10, 0.8f, 0.4f, 0.6f, 1.0f);
+    effects.Glow(in, out);
+    CHECK(PixelNear(out, 0, 0, 1.55f, 0.4f, 0.6f, 1.0f));
+    CHECK(PixelNear(out, 13, 7, 1.55f, 0.4f, 0.6f, 1.0f));
+}
+
+static void TestSimpleDoF(CPUEffects& effects) {
+    // in focus at depth 2 (the centre), fully blurred from depth 3 on
+    CPUImage in, depth, out;
+    Fill(in, 9, 9, 0.0f, 0.0f, 0.0f, 1.0f);
+    Fill(depth, 9, 9, 2.0f, 0.0f, 0.0f, 1.0f);
+    for (int y = 0; y < 9; y++)
+        for (int x = 0; x < 4; x++)
+            depth.Pixel(x, y)[0] = 4.0f;
+    Set(in, 1, 4, 1.0f, 1.0f, 1.0f, 1.0f);
+    Set(in, 6, 4, 1.0f, 1.0f, 1.0f, 1.0f);
+    effects.SimpleDoF(in, depth, out);
+    const float w0 = 0.2270270270f;
+    CHECK(PixelNear(out, 1, 4, w0 * w0, w0 * w0, w0 * w0, 1.0f));
+    CHECK(PixelNear(out, 6, 4, 1.0f, 1.0f, 1.0f, 1.0f));
+
+    CHECK(!effects.Apply("simpleDoF", in, NULL, out));
+    CHECK(!effects.Apply("bloom", in, &depth, out));
+}
+
+// Every effect gives the same bits with one thread and with several,
+// on a frame that is not a whole number of tiles.
+static void TestThreads() {
+    CPUImage in, depth, serial, parallel;
+    MakeCPUTestImage(in, depth, 200, 150);
+    TileScheduler one(1), four(4);
+    CPUEffects a(one), b(four);
+    std::vector<string> names = CPUEffects::GetNames();
+    for (unsigned int i = 0; i < names.size(); i++) {
+        CHECK(a.Apply(names[i], in, &depth, serial));
+        CHECK(b.Apply(names[i], in, &depth, parallel));
+        bool same = serial.GetWidth() == 200 && parallel.GetWidth() == 200 &&
+            std::memcmp(serial.Row(0), parallel.Row(0),
+                        4 * 200 * 150 * sizeof(float)) == 0;
+        if (!same) fprintf(stderr, "%s differs\n", names[i].c_str());
+        CHECK(same);
+    }
+}
+
+int main(int argc, char** argv) {
+    TileScheduler scheduler(2);
+    CPUEffects effects(scheduler);
+    TestPointwise(effects);
+    TestPixelate(effects);
+    TestEdgeDetection(effects);
+    TestBlurs(effects);
+    TestGlow(effects);
+    TestSimpleDoF(effects);
+    TestThreads();
+    return TestFailures();
+}
@@ -0,0 +1,274 @@
+// Float RGBA image for the CPU effect backend.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _CPU_IMAGE_H_
+#define _CPU_IMAGE_H_
+
+#include <Logging/Logger.h>
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+// One RGBA pixel in a register. The kernels are written against
+// these wrappers so they also build without SSE2.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CPU_IMAGE_SIMD 1
+typedef __m128 px_float;
+inline px_float px_set1(float a)               { return _mm_set1_ps(a); }
+inline px_float px_set(float r, float g, float b, float a) { return _mm_setr_ps(r, g, b, a); }
+inline px_float px_load(const float* p)        { return _mm_load_ps(p); }
+inline void     px_store(float* p, px_float a) { _mm_store_ps(p, a); }
+inline px_float px_add(px_float a, px_float b) { return _mm_add_ps(a, b); }
+inline px_float px_sub(px_float a, px_float b) { return _mm_sub_ps(a, b); }
+inline px_float px_mul(px_float a, px_float b) { return _mm_mul_ps(a, b); }
+inline px_float px_min(px_float a, px_float b) { return _mm_min_ps(a, b); }
+inline px_float px_max(px_float a, px_float b) { return _mm_max_ps(a, b); }
+// floor for values >= 0
+inline px_float px_floor(px_float a) { return _mm_cvtepi32_ps(_mm_cvttps_epi32(a)); }
+// all lanes set to the dot product of the rgb lanes with w.rgb
+inline px_float px_dot3(px_float a, px_float w) {
+    float t[4];
+    _mm_storeu_ps(t, _mm_mul_ps(a, w));
+    return _mm_set1_ps(t[0] + t[1] + t[2]);
+}
+// a with the alpha lane taken from b
+inline px_float px_keep_alpha(px_float a, px_float b) {
+    const __m128 mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+#else
+#define CPU_IMAGE_SIMD 0
+struct px_float { float v[4]; };
+inline px_float px_set(float r, float g, float b, float a) {
+    px_float p; p.v[0] = r; p.v[1] = g; p.v[2] = b; p.v[3] = a; return p;
+}
+inline px_float px_set1(float a) { return px_set(a, a, a, a); }
+inline px_float px_load(const float* p) { return px_set(p[0], p[1], p[2], p[3]); }
+inline void px_store(float* p, px_float a) { for (int i = 0; i < 4; i++) p[i] = a.v[i]; }
+#define PX_LANEWISE(name, expr) \
+    inline px_float name(px_float a, px_float b) { \
+        px_float r; for (int i = 0; i < 4; i++) r.v[i] = expr; return r; }
+PX_LANEWISE(px_add, a.v[i] + b.v[i])
+PX_LANEWISE(px_sub, a.v[i] - b.v[i])
+PX_LANEWISE(px_mul, a.v[i] * b.v[i])
+PX_LANEWISE(px_min, std::min(a.v[i], b.v[i]))
+PX_LANEWISE(px_max, std::max(a.v[i], b.v[i]))
+#undef PX_LANEWISE
+inline px_float px_floor(px_float a) {
+    px_float r; for (int i = 0; i < 4; i++) r.v[i] = std::floor(a.v[i]); return r;
+}
+inline px_float px_dot3(px_float a, px_float w) {
+    return px_set1(a.v[0] * w.v[0] + a.v[1] * w.v[1] + a.v[2] * w.v[2]);
+}
+inline px_float px_keep_alpha(px_float a, px_float b) {
+    a.v[3] = b.v[3]; return a;
+}
+#endif
+
+using namespace OpenEngine;
+
+/**
+ * Image of float RGBA pixels in [0,1], rows stored bottom-up like GL
+ * read-backs. Pixel data is 16 byte aligned so a pixel can be loaded
+ * into one SSE register.
+ */
+class CPUImage {
+public:
+    CPUImage() : width(0), height(0), data(NULL) {}
+    CPUImage(int width, int height) : width(0), height(0), data(NULL) {
+        Resize(width, height);
+    }
+    CPUImage(const CPUImage& other) : width(0), height(0), data(NULL) {
+        *this = other;
+    }
+
+    CPUImage& operator=(const CPUImage& other) {
+        if (this == &other) return *this;
+        Resize(other.width, other.height);
+        std::copy(other.data, other.data + 4 * width * height, data);
+        return *this;
+    }
+
+    void Resize(int w, int h) {
+        width = w;
+        height = h;
+        // over-allocate so the start can be aligned
+        storage.assign(4 * w * h + 4, 0.0f);
+        size_t offset = (16 - ((size_t)&storage[0] & 15)) & 15;
+        data = (float*)((char*)&storage[0] + offset);
+    }
+
+    // Exchanges the pixels without copying.
+    void Swap(CPUImage& other) {
+        std::swap(width, other.width);
+        std::swap(height, other.height);
+        std::swap(data, other.data);
+        storage.swap(other.storage);
+    }
+
+    int GetWidth() const { return width; }
+    int GetHeight() const { return height; }
+    bool IsEmpty() const { return width == 0 || height == 0; }
+
+    float* Row(int y) { return data + 4 * width * y; }
+    const float* Row(int y) const { return data + 4 * width * y; }
+    float* Pixel(int x, int y) { return data + 4 * (width * y + x); }
+    // Clamped to the border, like GL_CLAMP_TO_EDGE.
+    const float* Pixel(int x, int y) const {
+        x = std::max(0, std::min(width - 1, x));
+        y = std::max(0, std::min(height - 1, y));
+        return data + 4 * (width * y + x);
+    }
+
+    void FromRGBA8(const unsigned char* pixels, int w, int h) {
+        Resize(w, h);
+        for (int i = 0; i < 4 * w * h; i++)
+            data[i] = pixels[i] * (1.0f / 255.0f);
+    }
+
+    void ToRGBA8(std::vector<unsigned char>& pixels) const {
+        pixels.resize(4 * width * height);
+        for (int i = 0; i < 4 * width * height; i++)
+            pixels[i] = ToByte(data[i]);
+    }
+
+    // Binary PPM (P6) with 8 bit channels; alpha is set to 1.
+    bool LoadPPM(const std::string& path) {
+        std::ifstream in(path.c_str(), std::ios::binary);
+        std::string magic;
+        int w = 0, h = 0, max = 0;
+        in >> magic >> w >> h >> max;
+        in.get();
+        if (!in.good() || magic != "P6" || w <= 0 || h <= 0 || max != 255) {
+            logger.error << "Can not read PPM image '" << path << "'"
+                         << logger.end;
+            return false;
+        }
+        std::vector<unsigned char> rgb(3 * w * h);
+        in.read((char*)&rgb[0], rgb.size());
+        if (!in.good()) {
+            logger.error << "Truncated PPM image '" << path << "'"
+                         << logger.end;
+            return false;
+        }
+        Resize(w, h);
+        // PPM is stored top-down
+        for (int y = 0; y < h; y++) {
+            float* row = Row(h - 1 - y);
+            for (int x = 0; x < w; x++) {
+                for (int c = 0; c < 3; c++)
+                    row[4 * x + c] = rgb[3 * (w * y + x) + c] * (1.0f / 255.0f);
+                row[4 * x + 3] = 1.0f;
+            }
+        }
+        return true;
+    }
+
+    bool SavePPM(const std::string& path) const {
+        std::ofstream out(path.c_str(), std::ios::binary);
+        if (!out.good()) {
+            logger.error << "Can not write PPM image '" << path << "'"
+                         << logger.end;
+            return false;
+        }
+        out << "P6\n" << width << " " << height << "\n255\n";
+        std::vector<unsigned char> rgb(3 * width);
+        for (int y = height - 1; y >= 0; y--) {
+            const float* row = Row(y);
+            for (int x = 0; x < width; x++)
+                for (int c = 0; c < 3; c++)
+                    rgb[3 * x + c] = ToByte(row[4 * x + c]);
+            out.write((const char*)&rgb[0], rgb.size());
+        }
+        return out.good();
+    }
+
+    // Grayscale PFM ("Pf") holding linear depth, read into the red
+    // channel. PFM rows are stored bottom-up already.
+    bool LoadDepthPFM(const std::string& path) {
+        std::ifstream in(path.c_str(), std::ios::binary);
+        std::string magic;
+        int w = 0, h = 0;
+        float scale = 0.0f;
+        in >> magic >> w >> h >> scale;
+        in.get();
+        if (!in.good() || magic != "Pf" || w <= 0 || h <= 0) {
+            logger.error << "Can not read PFM depth '" << path << "'"
+                         << logger.end;
+            return false;
+        }
+        std::vector<float> depth(w * h);
+        in.read((char*)&depth[0], depth.size() * sizeof(float));
+        if (!in.good()) {
+            logger.error << "Truncated PFM depth '" << path << "'"
+                         << logger.end;
+            return false;
+        }
+        // a positive scale means big endian data
+        if (scale > 0.0f)
+            for (unsigned int i = 0; i < depth.size(); i++) {
+                unsigned char* b = (unsigned char*)&depth[i];
+                std::swap(b[0], b[3]);
+                std::swap(b[1], b[2]);
+            }
+        Resize(w, h);
+        for (int i = 0; i < w * h; i++)
+            data[4 * i] = depth[i];
+        return true;
+    }
+
+    // Largest absolute channel difference (rgb only), or a negative
+    // value when the sizes differ. mean gets the mean difference of
+    // the channels, p99 the difference that 99% of the pixels stay
+    // within, taking the largest channel of each pixel, to 1/1024.
+    double Compare(const CPUImage& other, double* mean = NULL,
+                   double* p99 = NULL) const {
+        if (width != other.width || height != other.height) return -1.0;
+        static const int BINS = 1024;
+        std::vector<unsigned long> histogram(BINS + 1, 0);
+        double worst = 0.0, sum = 0.0;
+        for (int i = 0; i < width * height; i++) {
+            double pixel = 0.0;
+            for (int c = 0; c < 3; c++) {
+                double d = std::fabs(data[4 * i + c] - other.data[4 * i + c]);
+                pixel = std::max(pixel, d);
+                sum += d;
+            }
+            worst = std::max(worst, pixel);
+            histogram[std::min(BINS, (int)std::ceil(pixel * BINS))]++;
+        }
+        const unsigned long pixels = (unsigned long)width * height;
+        if (mean) *mean = pixels ? sum / (3.0 * pixels) : 0.0;
+        if (p99) {
+            unsigned long count = 0;
+            int bin = 0;
+            for (; bin < BINS; bin++) {
+                count += histogram[bin];
+                if (count * 100 >= pixels * 99) break;
+            }
+            *p99 = std::min(worst, (double)bin / BINS);
+        }
+        return worst;
+    }
+
+private:
+    int width, height;
+    std::vector<float> storage;
+    float* data;
+
+    static unsigned char ToByte(float v) {
+        return (unsigned char)(std::max(0.0f, std::min(1.0f, v)) * 255.0f + 0.5f);
+    }
+};
+
+#endif // _CPU_IMAGE_H_
@@ -0,0 +1,232 @@
+// Bounding volume hierarchy with frustum culling for scene subtrees.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _CULL_NODE_H_
+#define _CULL_NODE_H_
+
+#include "Bounds.h"
+
+#include <Scene/RenderNode.h>
+#include <Scene/TransformationNode.h>
+#include <Renderers/IRenderingView.h>
+#include <Math/Vector.h>
+#include <Math/Quaternion.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace OpenEngine;
+using namespace OpenEngine::Math;
+using namespace OpenEngine::Scene;
+
+/**
+ * Render node drawing a set of transformation node subtrees, culled
+ * hierarchically against the view frustum.
+ *
+ * Every subtree is given with the bounding sphere of its content in
+ * the frame of its transformation node. The spheres are placed with
+ * the position and rotation of the nodes (scaling is not supported)
+ * and the boxes around them form a binary hierarchy, split at the
+ * median of the longest axis. Before drawing, nodes whose position or
+ * rotation changed since the last pass have their leaf and the boxes
+ * above it refitted; the hierarchy is rebuilt only when subtrees are
+ * added.
+ *
+ * The frustum is taken from the GL matrices at the time the node is
+ * applied, so a shadow pass drawing the scene from a light is culled
+ * against the light frustum. The subtrees are owned by this node and
+ * drawn by handing them to the rendering view; do not also add them
+ * to the scene graph.
+ */
+class CullNode : public Scene::RenderNode {
+public:
+    // Counts since the node was created, one pass per Apply().
+    struct Stats {
+        unsigned int passes, visited, drawn, entries;
+    };
+
+    CullNode() : built(false) {
+        stats.passes = stats.visited = stats.drawn = stats.entries = 0;
+    }
+
+    ~CullNode() {
+        for (unsigned int i = 0; i < entries.size(); i++)
+            delete entries[i].node;
+    }
+
+    // Takes over node, local is the bounds of its content.
+    void Add(TransformationNode* node, const BoundingSphere& local) {
+        Entry e;
+        e.node = node;
+        e.local = local;
+        e.leaf = 0;
+        entries.push_back(e);
+        built = false;
+    }
+
+    void Add(TransformationNode* node, const IBounded& content) {
+        Add(node, content.GetBounds());
+    }
+
+    unsigned int GetEntryCount() const { return entries.size(); }
+
+    Stats GetStats() const {
+        Stats s = stats;
+        s.entries = entries.size();
+        return s;
+    }
+
+    void Apply(Renderers::IRenderingView* view) {
+        if (entries.empty()) return;
+        if (!built) Build();
+        else Refit();
+        FrustumPlanes frustum;
+        frustum.FromCurrentGL();
+        stats.passes++;
+        Traverse(0, frustum, FrustumPlanes::ALL, view);
+    }
+
+private:
+    struct Entry {
+        TransformationNode* node;
+        BoundingSphere local;
+        // placement the leaf box was computed for
+        Vector<3,float> position;
+        Quaternion<float> rotation;
+        unsigned int leaf;
+    };
+
+    struct Node {
+        BoundingBox box;
+        int parent;
+        int left, right;    // -1 for leaves
+        unsigned int entry;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<Node> nodes;
+    bool built;
+    Stats stats;
+
+    // The local sphere moved to the current placement of the node.
+    BoundingSphere Place(Entry& e) {
+        e.position = e.node->GetPosition();
+        e.rotation = e.node->GetRotation();
+        float w = e.rotation.GetReal();
+        Vector<3,float> q = e.rotation.GetImaginary();
+        const float* v = e.local.center;
+        // v + 2w(q x v) + 2q x (q x v)
+        float t[3] = { 2.0f * (q[1] * v[2] - q[2] * v[1]),
+                       2.0f * (q[2] * v[0] - q[0] * v[2]),
+                       2.0f * (q[0] * v[1] - q[1] * v[0]) };
+        BoundingSphere s;
+        s.center[0] = v[0] + w * t[0] + (q[1] * t[2] - q[2] * t[1]) + e.position[0];
+        s.center[1] = v[1] + w * t[1] + (q[2] * t[0] - q[0] * t[2]) + e.position[1];
+        s.center[2] = v[2] + w * t[2] + (q[0] * t[1] - q[1] * t[0]) + e.position[2];
+        s.radius = e.local.radius;
+        return s;
+    }
+
+    static bool Moved(const Entry& e) {
+        Vector<3,float> p = e.node->GetPosition();
+        Quaternion<float> r = e.node->GetRotation();
+        Vector<3,float> i = r.GetImaginary(), j = e.rotation.GetImaginary();
+        return p[0] != e.position[0] || p[1] != e.position[1] ||
+            p[2] != e.position[2] || r.GetReal() != e.rotation.GetReal() ||
+            i[0] != j[0] || i[1] != j[1] || i[2] != j[2];
+    }
+
+    void Build() {
+        built = true;
+        nodes.clear();
+        std::vector<unsigned int> order(entries.size());
+        std::vector<BoundingBox> boxes(entries.size());
+        for (unsigned int i = 0; i < entries.size(); i++) {
+            order[i] = i;
+            boxes[i].Clear();
+            boxes[i].Add(Place(entries[i]));
+        }
+        Split(order, boxes, 0, order.size(), -1);
+    }
+
+    struct AxisLess {
+        const std::vector<BoundingBox>& boxes;
+        int axis;
+        AxisLess(const std::vector<BoundingBox>& boxes, int axis)
+            : boxes(boxes), axis(axis) {}
+        bool operator()(unsigned int a, unsigned int b) const {
+            return boxes[a].min[axis] + boxes[a].max[axis] <
+                boxes[b].min[axis] + boxes[b].max[axis];
+        }
+    };
+
+    int Split(std::vector<unsigned int>& order,
+              const std::vector<BoundingBox>& boxes,
+              unsigned int begin, unsigned int end, int parent) {
+        int index = nodes.size();
+        nodes.push_back(Node());
+        Node n;
+        n.parent = parent;
+        n.left = n.right = -1;
+        n.entry = 0;
+        n.box.Clear();
+        for (unsigned int i = begin; i < end; i++) n.box.Add(boxes[order[i]]);
+
+        if (end - begin == 1) {
+            n.entry = order[begin];
+            entries[n.entry].leaf = index;
+            nodes[index] = n;
+            return index;
+        }
+        int axis = 0;
+        for (int a = 1; a < 3; a++)
+            if (n.box.max[a] - n.box.min[a] > n.box.max[axis] - n.box.min[axis])
+                axis = a;
+        unsigned int mid = (begin + end) / 2;
+        std::nth_element(order.begin() + begin, order.begin() + mid,
+                         order.begin() + end, AxisLess(boxes, axis));
+        nodes[index] = n;
+        int left = Split(order, boxes, begin, mid, index);
+        int right = Split(order, boxes, mid, end, index);
+        nodes[index].left = left;
+        nodes[index].right = right;
+        return index;
+    }
+
+    void Refit() {
+        for (unsigned int i = 0; i < entries.size(); i++) {
+            Entry& e = entries[i];
+            if (!Moved(e)) continue;
+            Node& leaf = nodes[e.leaf];
+            leaf.box.Clear();
+            leaf.box.Add(Place(e));
+            for (int p = leaf.parent; p >= 0; p = nodes[p].parent) {
+                Node& n = nodes[p];
+                n.box = nodes[n.left].box;
+                n.box.Add(nodes[n.right].box);
+            }
+        }
+    }
+
+    void Traverse(int index, const FrustumPlanes& frustum, unsigned int mask,
+                  Renderers::IRenderingView* view) {
+        const Node& n = nodes[index];
+        stats.visited++;
+        if (mask && frustum.Cull(n.box, mask)) return;
+        if (n.left < 0) {
+            stats.drawn++;
+            entries[n.entry].node->Accept(*view);
+            return;
+        }
+        Traverse(n.left, frustum, mask, view);
+        Traverse(n.right, frustum, mask, view);
+    }
+};
+
+#endif // _CULL_NODE_H_
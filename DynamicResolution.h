@@ -0,0 +1,213 @@
+// Render resolution following a frame time target.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _DYNAMIC_RESOLUTION_H_
+#define _DYNAMIC_RESOLUTION_H_
+
+#include "EffectProfiler.h"
+#include "GLProgram.h"
+#include "ProgramCache.h"
+#include "RenderTargetPool.h"
+#include "ScreenPipeline.h"
+
+#include <Display/IFrame.h>
+#include <Display/Viewport.h>
+#include <Logging/Logger.h>
+#include <Math/Vector.h>
+#include <Meta/OpenGL.h>
+
+#include <algorithm>
+
+using namespace OpenEngine;
+using namespace OpenEngine::Display;
+using OpenEngine::Math::Vector;
+
+/**
+ * Viewport covering a scaled down corner of its frame. The scene,
+ * the chain and the screen stages all render into the lower left
+ * width * scale by height * scale pixels; the window keeps its size.
+ */
+class ScaledViewport : public Viewport {
+public:
+    ScaledViewport(IFrame& frame) : Viewport(frame), scale(1.0f) {}
+
+    Vector<4,int> GetDimension() {
+        Vector<4,int> full = Viewport::GetDimension();
+        if (scale == 1.0f) return full;
+        return Vector<4,int>(full[0], full[1],
+                             std::max(1, (int)(full[2] * scale)),
+                             std::max(1, (int)(full[3] * scale)));
+    }
+
+    Vector<4,int> GetFullDimension() { return Viewport::GetDimension(); }
+
+    void SetScale(float scale) { this->scale = scale; }
+    float GetScale() const { return scale; }
+
+private:
+    float scale;
+};
+
+/**
+ * Holds a GPU frame time target by stepping the resolution of a
+ * ScaledViewport, and scales the finished frame back up to the window
+ * with a sharpening pass.
+ *
+ * The frame time is the "frame" zone of the effect profiler, averaged
+ * over the last WINDOW frames. Above HIGH of the target the resolution
+ * goes one step down. It goes one step up only when the time predicted
+ * for the larger step (by pixel count) stays below LOW of the target;
+ * the gap between the two keeps it from oscillating. After a change
+ * the controller waits until the average only holds frames at the new
+ * size, and a step up that had to be taken back waits twice as long
+ * before it is tried again.
+ *
+ * The effects of the post processing chain allocate their buffers at
+ * the window size, so while the chain is active the full resolution
+ * is used. The effects reduced by an EffectStage run outside the
+ * chain and follow the step, with an instance per size. Without GL
+ * timer queries the controller stays at full resolution.
+ */
+class DynamicResolution {
+public:
+    DynamicResolution(ScaledViewport& viewport, EffectProfiler& profiler,
+                      RenderTargetPool& pool, ProgramCache& cache,
+                      double targetMs)
+        : viewport(viewport), profiler(profiler), pool(pool), cache(cache)
+        , targetMs(targetMs), step(0), wait(WINDOW), hold(0), upHold(WINDOW)
+        , raised(false), changes(0), program(0) {}
+
+    // Call before the scene is drawn, with the chain decided.
+    void BeginFrame(bool chainActive) {
+        viewport.SetScale(chainActive ? 1.0f : STEPS[step]);
+    }
+
+    // Call after the screen stages, with the frame still bound.
+    void EndFrame(bool chainActive) {
+        if (viewport.GetScale() < 1.0f) Upscale();
+        if (!chainActive) Control();
+    }
+
+    float GetScale() const { return STEPS[step]; }
+    unsigned int GetChanges() const { return changes; }
+
+private:
+    static const unsigned int WINDOW = 20;
+    static const unsigned int STEP_COUNT = 5;
+    static const float STEPS[STEP_COUNT];
+    static const double HIGH, LOW;
+
+    ScaledViewport& viewport;
+    EffectProfiler& profiler;
+    RenderTargetPool& pool;
+    ProgramCache& cache;
+    double targetMs;
+    unsigned int step, wait, hold, upHold;
+    bool raised;            // the last change was a step up
+    unsigned int changes;
+    GLuint program;
+
+    void Control() {
+        if (wait) {
+            wait--;
+            return;
+        }
+        if (hold) hold--;
+        double ms;
+        if (!profiler.HasGPUTimings() ||
+            !profiler.GetRecentGPU("frame", WINDOW, ms))
+            return;
+        if (ms > targetMs * HIGH && step + 1 < STEP_COUNT) {
+            // a step up that did not hold is tried less eagerly
+            if (raised) {
+                upHold = std::min(upHold * 2, 32 * WINDOW);
+                hold = upHold;
+            }
+            Change(step + 1, ms);
+            raised = false;
+        }
+        else if (step > 0 && hold == 0) {
+            double ratio = STEPS[step - 1] / STEPS[step];
+            if (ms * ratio * ratio < targetMs * LOW) {
+                Change(step - 1, ms);
+                raised = true;
+            }
+        }
+    }
+
+    void Change(unsigned int next, double ms) {
+        step = next;
+        changes++;
+        // the samples lag two frames behind the frame drawn
+        wait = WINDOW + 2;
+        logger.info << "Dynamic resolution " << (int)(STEPS[step] * 100)
+                    << "% at " << ms << " ms per frame" << logger.end;
+    }
+
+    void Upscale() {
+        if (program == 0)
+            program = cache.Request(GLProgram::ScreenVertexShader(),
+                "uniform sampler2D color;\n"
+                "uniform vec2 texel;\n"
+                "uniform float sharpness;\n"
+                "void main() {\n"
+                "  vec2 uv = gl_TexCoord[0].st;\n"
+                "  vec4 c = texture2D(color, uv);\n"
+                "  vec4 n = texture2D(color, uv + vec2(0.0, texel.y));\n"
+                "  vec4 s = texture2D(color, uv - vec2(0.0, texel.y));\n"
+                "  vec4 e = texture2D(color, uv + vec2(texel.x, 0.0));\n"
+                "  vec4 w = texture2D(color, uv - vec2(texel.x, 0.0));\n"
+                // unsharp mask, clamped to the neighbourhood so edges
+                // do not ring
+                "  vec4 lo = min(c, min(min(n, s), min(e, w)));\n"
+                "  vec4 hi = max(c, max(max(n, s), max(e, w)));\n"
+                "  gl_FragColor = clamp(c + (4.0 * c - n - s - e - w) * sharpness,\n"
+                "                       lo, hi);\n"
+                "}\n", "upscale");
+
+        GLint vp[4];
+        glGetIntegerv(GL_VIEWPORT, vp);
+        Vector<4,int> full = viewport.GetFullDimension();
+        RenderTarget* source = pool.Acquire(vp[2], vp[3], GL_RGBA8);
+        glPushAttrib(GL_ENABLE_BIT | GL_DEPTH_BUFFER_BIT |
+                     GL_TEXTURE_BIT | GL_VIEWPORT_BIT);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_LIGHTING);
+        glDepthMask(GL_FALSE);
+        glActiveTexture(GL_TEXTURE0);
+        glEnable(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, source->texture);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, vp[0], vp[1], vp[2], vp[3]);
+        glViewport(full[0], full[1], full[2], full[3]);
+        // plain bilinear until the program is built
+        bool sharpen = cache.IsReady(program);
+        if (sharpen) {
+            glUseProgram(program);
+            glUniform1i(glGetUniformLocation(program, "color"), 0);
+            glUniform2f(glGetUniformLocation(program, "texel"),
+                        1.0f / vp[2], 1.0f / vp[3]);
+            // the more the frame is stretched, the more it is sharpened
+            glUniform1f(glGetUniformLocation(program, "sharpness"),
+                        0.5f * (1.0f - viewport.GetScale()));
+        }
+        ScreenPipeline::DrawQuad();
+        if (sharpen) glUseProgram(0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glPopAttrib();
+        pool.Release(source);
+        GLDiagnostics::Check("upscale");
+    }
+};
+
+const float DynamicResolution::STEPS[DynamicResolution::STEP_COUNT] =
+    { 1.0f, 0.85f, 0.7f, 0.6f, 0.5f };
+const double DynamicResolution::HIGH = 0.95;
+const double DynamicResolution::LOW = 0.8;
+
+#endif // _DYNAMIC_RESOLUTION_H_
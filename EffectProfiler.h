@@ -0,0 +1,275 @@
+// GPU and CPU timing of the post processing passes.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _EFFECT_PROFILER_H_
+#define _EFFECT_PROFILER_H_
+
+#include <Core/IListener.h>
+#include <Core/IEngine.h>
+#include <Logging/Logger.h>
+#include <Utils/Timer.h>
+#include <Meta/OpenGL.h>
+#include <Renderers/OpenGL/IPostProcessingEffect.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+#include <string>
+#include <fstream>
+
+using namespace OpenEngine;
+using namespace OpenEngine::Core;
+using namespace OpenEngine::Renderers::OpenGL;
+using std::string;
+
+// Zone label for the effect set that is currently enabled.
+inline string ActiveEffects(const std::vector<IPostProcessingEffect*>& effects,
+                            const std::vector<string>& names) {
+    string label;
+    for (unsigned int i = 0; i < effects.size(); i++) {
+        if (!effects[i]->GetEnabled()) continue;
+        if (!label.empty()) label += "+";
+        label += names[i];
+    }
+    return label.empty() ? "none" : label;
+}
+
+/**
+ * Named timing zones measured with GL timestamp queries, falling back
+ * to CPU timestamps when ARB_timer_query is unavailable.
+ *
+ * Every zone owns two query pairs used on alternating frames. The
+ * pair of a frame is only read back when the zone is entered again
+ * two frames later, and only if the result is already available, so
+ * the pipeline is never stalled; results that are late are dropped.
+ * Averages are kept over a rolling window of samples and are written
+ * as CSV and JSON at deinitialization when a dump name is set. With
+ * history enabled every sample is kept as well, for percentiles.
+ */
+class EffectProfiler : public IListener<DeinitializeEventArg> {
+public:
+    EffectProfiler(unsigned int window = 120)
+        : window(window), frame(0), gpu(false), checked(false)
+        , history(false) {}
+
+    ~EffectProfiler() {
+        for (ZoneMap::iterator itr = zones.begin(); itr != zones.end(); ++itr) {
+            if (itr->second->queries[0][0])
+                glDeleteQueries(4, &itr->second->queries[0][0]);
+            delete itr->second;
+        }
+    }
+
+    // Call once per frame before the first zone.
+    void NextFrame() {
+        frame++;
+        if (!checked) {
+            gpu = GLEW_ARB_timer_query;
+            checked = true;
+            logger.info << "Effect profiler using "
+                        << (gpu ? "GL timer queries" : "CPU timestamps")
+                        << logger.end;
+        }
+    }
+
+    void Begin(const string& name) {
+        Zone& zone = GetZone(name);
+        unsigned int slot = frame & 1;
+        if (zone.pending[slot]) Collect(zone, slot);
+        if (gpu) glQueryCounter(zone.queries[slot][0], GL_TIMESTAMP);
+        zone.cpuStart = Now();
+    }
+
+    void End(const string& name) {
+        Zone& zone = GetZone(name);
+        unsigned int slot = frame & 1;
+        double cpuMs = (Now() - zone.cpuStart) / 1000.0;
+        zone.cpu.Add(cpuMs);
+        if (history) zone.cpuHistory.push_back(cpuMs);
+        if (gpu) {
+            glQueryCounter(zone.queries[slot][1], GL_TIMESTAMP);
+            zone.pending[slot] = true;
+        }
+    }
+
+    bool HasGPUTimings() const { return gpu; }
+
+    // Rolling averages in milliseconds, false for unknown zones.
+    bool GetAverage(const string& name, double& gpuMs, double& cpuMs) const {
+        ZoneMap::const_iterator itr = zones.find(name);
+        if (itr == zones.end()) return false;
+        gpuMs = itr->second->gpu.Average();
+        cpuMs = itr->second->cpu.Average();
+        return true;
+    }
+
+    // GPU average of the last count samples (at most the window),
+    // false for unknown zones or before the first sample.
+    bool GetRecentGPU(const string& name, unsigned int count, double& gpuMs) const {
+        ZoneMap::const_iterator itr = zones.find(name);
+        if (itr == zones.end() || itr->second->gpu.total == 0) return false;
+        gpuMs = itr->second->gpu.Recent(count);
+        return true;
+    }
+
+    std::vector<string> GetZoneNames() const {
+        std::vector<string> names;
+        for (ZoneMap::const_iterator itr = zones.begin(); itr != zones.end(); ++itr)
+            names.push_back(itr->first);
+        return names;
+    }
+
+    // Keep all samples of all zones from now on.
+    void SetHistory(bool keep) { history = keep; }
+
+    // All samples in milliseconds since history was enabled, false
+    // for unknown zones. GPU samples lag two frames behind and may
+    // have gaps where results were dropped.
+    bool GetSamples(const string& name, std::vector<double>& gpuMs,
+                    std::vector<double>& cpuMs) const {
+        ZoneMap::const_iterator itr = zones.find(name);
+        if (itr == zones.end()) return false;
+        gpuMs = itr->second->gpuHistory;
+        cpuMs = itr->second->cpuHistory;
+        return true;
+    }
+
+    // Nearest rank percentile, p in [0,100].
+    static double Percentile(std::vector<double> samples, double p) {
+        if (samples.empty()) return 0.0;
+        std::sort(samples.begin(), samples.end());
+        // the smallest sample with at least p% of the samples at or
+        // below it
+        double rank = std::ceil(p / 100.0 * samples.size());
+        unsigned int index = rank < 1.0 ? 0 : (unsigned int)rank - 1;
+        return samples[std::min<unsigned int>(index, samples.size() - 1)];
+    }
+
+    // Base name for the CSV/JSON dump at deinitialization.
+    void SetDumpName(const string& name) { dumpName = name; }
+
+    void WriteCSV(std::ostream& out) const {
+        out << "zone,gpu_ms,cpu_ms,samples,dropped" << std::endl;
+        for (ZoneMap::const_iterator itr = zones.begin(); itr != zones.end(); ++itr) {
+            const Zone& z = *itr->second;
+            out << itr->first << "," << z.gpu.Average() << ","
+                << z.cpu.Average() << "," << z.cpu.total << ","
+                << z.dropped << std::endl;
+        }
+    }
+
+    void WriteJSON(std::ostream& out) const {
+        out << "{\"timer\": \"" << (gpu ? "gpu" : "cpu") << "\", \"zones\": [";
+        for (ZoneMap::const_iterator itr = zones.begin(); itr != zones.end(); ++itr) {
+            const Zone& z = *itr->second;
+            out << (itr == zones.begin() ? "" : ",") << std::endl
+                << "  {\"name\": \"" << itr->first << "\""
+                << ", \"gpu_ms\": " << z.gpu.Average()
+                << ", \"cpu_ms\": " << z.cpu.Average()
+                << ", \"samples\": " << z.cpu.total
+                << ", \"dropped\": " << z.dropped << "}";
+        }
+        out << std::endl << "]}" << std::endl;
+    }
+
+    void Handle(DeinitializeEventArg arg) {
+        if (dumpName.empty()) return;
+        std::ofstream csv((dumpName + ".csv").c_str());
+        std::ofstream json((dumpName + ".json").c_str());
+        if (!csv.good() || !json.good()) {
+            logger.error << "Can not write effect timings to '"
+                         << dumpName << ".{csv,json}'" << logger.end;
+            return;
+        }
+        WriteCSV(csv);
+        WriteJSON(json);
+        logger.info << "Saved effect timings to '" << dumpName
+                    << ".csv' and '" << dumpName << ".json'" << logger.end;
+    }
+
+private:
+    // Fixed size window of samples with a running sum.
+    struct Rolling {
+        std::vector<double> samples;
+        unsigned int next, total;
+        double sum;
+        Rolling(unsigned int size) : samples(size, 0.0), next(0), total(0), sum(0) {}
+        void Add(double value) {
+            sum += value - samples[next];
+            samples[next] = value;
+            next = (next + 1) % samples.size();
+            total++;
+        }
+        double Average() const {
+            unsigned int n = total < samples.size() ? total : samples.size();
+            return n ? sum / n : 0.0;
+        }
+        double Recent(unsigned int count) const {
+            unsigned int n = std::min<unsigned int>(count, std::min<unsigned int>(
+                total, samples.size()));
+            double recent = 0.0;
+            for (unsigned int i = 1; i <= n; i++)
+                recent += samples[(next + samples.size() - i) % samples.size()];
+            return n ? recent / n : 0.0;
+        }
+    };
+
+    struct Zone {
+        GLuint queries[2][2];
+        bool pending[2];
+        double cpuStart;
+        Rolling gpu, cpu;
+        std::vector<double> gpuHistory, cpuHistory;
+        unsigned int dropped;
+        Zone(unsigned int window)
+            : cpuStart(0), gpu(window), cpu(window), dropped(0) {
+            queries[0][0] = 0;
+            pending[0] = pending[1] = false;
+        }
+    };
+    typedef std::map<string, Zone*> ZoneMap;
+
+    ZoneMap zones;
+    unsigned int window, frame;
+    bool gpu, checked, history;
+    string dumpName;
+
+    Zone& GetZone(const string& name) {
+        ZoneMap::iterator itr = zones.find(name);
+        if (itr != zones.end()) return *itr->second;
+        Zone* zone = new Zone(window);
+        if (gpu) glGenQueries(4, &zone->queries[0][0]);
+        zones[name] = zone;
+        return *zone;
+    }
+
+    void Collect(Zone& zone, unsigned int slot) {
+        zone.pending[slot] = false;
+        GLint available = 0;
+        glGetQueryObjectiv(zone.queries[slot][1], GL_QUERY_RESULT_AVAILABLE,
+                           &available);
+        if (!available) {
+            zone.dropped++;
+            return;
+        }
+        GLuint64 start, end;
+        glGetQueryObjectui64v(zone.queries[slot][0], GL_QUERY_RESULT, &start);
+        glGetQueryObjectui64v(zone.queries[slot][1], GL_QUERY_RESULT, &end);
+        double gpuMs = (end - start) / 1000000.0;
+        zone.gpu.Add(gpuMs);
+        if (history) zone.gpuHistory.push_back(gpuMs);
+    }
+
+    static double Now() {
+        return (double)Utils::Timer::GetTime().AsInt();
+    }
+};
+
+#endif // _EFFECT_PROFILER_H_
@@ -0,0 +1,66 @@
+// Engine driven by a virtual clock with a fixed time step.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _FIXED_STEP_ENGINE_H_
+#define _FIXED_STEP_ENGINE_H_
+
+#include <Core/IEngine.h>
+#include <Core/Event.h>
+#include <Utils/Timer.h>
+
+using namespace OpenEngine;
+using namespace OpenEngine::Core;
+
+/**
+ * Engine loop where every process event advances time by exactly one
+ * step, however long the frame took to render.
+ *
+ * Listeners see the virtual time in ProcessEventArg (start counts
+ * from zero, approx is always the step), so a run renders the same
+ * sequence of frames on every machine. Used for benchmarks, golden
+ * image tests and frame capture.
+ */
+class FixedStepEngine : public IEngine {
+public:
+    // step in microseconds
+    FixedStepEngine(unsigned int step)
+        : step(step), time(0), frame(0), running(false) {}
+
+    void Start() {
+        running = true;
+        initialize.Notify(InitializeEventArg());
+        while (running) {
+            process.Notify(ProcessEventArg(Utils::Time(time), step));
+            time += step;
+            frame++;
+        }
+        deinitialize.Notify(DeinitializeEventArg());
+    }
+
+    void Stop() { running = false; }
+
+    IEvent<InitializeEventArg>& InitializeEvent() { return initialize; }
+    IEvent<ProcessEventArg>& ProcessEvent() { return process; }
+    IEvent<DeinitializeEventArg>& DeinitializeEvent() { return deinitialize; }
+
+    unsigned int GetStep() const { return step; }
+    unsigned long long GetTime() const { return time; }
+    unsigned int GetFrame() const { return frame; }
+
+private:
+    Event<InitializeEventArg> initialize;
+    Event<ProcessEventArg> process;
+    Event<DeinitializeEventArg> deinitialize;
+    unsigned int step;
+    unsigned long long time;
+    unsigned int frame;
+    bool running;
+};
+
+#endif // _FIXED_STEP_ENGINE_H_
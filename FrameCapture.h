@@ -0,0 +1,392 @@
+// Asynchronous capture of the rendered frames to disk.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _FRAME_CAPTURE_H_
+#define _FRAME_CAPTURE_H_
+
+#include "Signal.h"
+
+#include <Core/IEngine.h>
+#include <Core/IListener.h>
+#include <Core/Mutex.h>
+#include <Core/Thread.h>
+#include <Logging/Logger.h>
+#include <Renderers/IRenderer.h>
+#include <Meta/OpenGL.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+using namespace OpenEngine;
+using namespace OpenEngine::Core;
+using namespace OpenEngine::Renderers;
+using std::string;
+
+/**
+ * Records the finished frames without stalling the renderer.
+ *
+ * Every frame is read into the next of a ring of pixel buffer
+ * objects; the transfer runs asynchronously and a buffer is only
+ * mapped when the ring comes back to it, RING (three) frames later,
+ * when the copy has long finished. The mapped pixels are copied into
+ * a free buffer and handed to a writer thread through a bounded
+ * queue, which converts and writes them:
+ *
+ *   RAW  bottom-up RGBA frames appended to one file
+ *   PPM  one numbered top-down P6 file per frame, path_000000.ppm,
+ *        path_000001.ppm, ... (a .ppm extension of path is dropped)
+ *   Y4M  YUV4MPEG2 4:2:0 stream, playable and encodable by most tools
+ *
+ * The writer sleeps until a frame is queued. When the queue is full
+ * the frame is dropped (and counted) unless the capture is blocking,
+ * which is meant for fixed step runs where waiting only slows down
+ * the virtual clock; the renderer then sleeps until the writer frees
+ * a frame. Without pixel buffer objects frames are read
+ * synchronously.
+ */
+class FrameCapture : public IListener<RenderingEventArg>
+                   , public IListener<DeinitializeEventArg> {
+public:
+    enum Format { RAW, PPM, Y4M };
+
+    FrameCapture(const string& path, Format format,
+                 unsigned int queueSize = 8, bool blocking = false)
+        : path(path), format(format), blocking(blocking), queueSize(queueSize)
+        , width(0), height(0), next(0), captured(0), dropped(0)
+        , writer(NULL), fpsNum(60), fpsDen(1) {
+        pbos[0] = pbos[1] = pbos[2] = 0;
+        pending[0] = pending[1] = pending[2] = false;
+    }
+
+    // Frame rate stored in the Y4M header.
+    void SetFrameRate(unsigned int num, unsigned int den) {
+        fpsNum = num;
+        fpsDen = den;
+    }
+
+    static bool ParseFormat(const string& name, Format& format) {
+        if (name == "raw") format = RAW;
+        else if (name == "ppm") format = PPM;
+        else if (name == "y4m") format = Y4M;
+        else return false;
+        return true;
+    }
+
+    void Handle(RenderingEventArg arg) {
+        if (width == 0 && !Start()) return;
+
+        if (pbos[0] == 0) {
+            Frame* frame = Acquire();
+            if (frame == NULL) return;
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE,
+                         &frame->pixels[0]);
+            Submit(frame);
+            return;
+        }
+
+        // the slot written now was last written RING frames ago
+        unsigned int slot = next;
+        next = (next + 1) % RING;
+        if (pending[slot]) Collect(slot);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        pending[slot] = true;
+    }
+
+    void Handle(DeinitializeEventArg arg) {
+        if (width == 0) return;
+        // the remaining frames in the ring, oldest first
+        for (unsigned int i = 0; i < RING; i++) {
+            unsigned int slot = (next + i) % RING;
+            if (pending[slot]) Collect(slot);
+        }
+        if (pbos[0]) glDeleteBuffers(RING, pbos);
+        writer->Finish();
+        writer->Wait();
+        logger.info << "Captured " << writer->GetWritten() << " of "
+                    << captured << " frames to '" << path << "', "
+                    << dropped << " dropped" << logger.end;
+        delete writer;
+        writer = NULL;
+        for (unsigned int i = 0; i < frames.size(); i++)
+            delete frames[i];
+        frames.clear();
+        width = 0;
+    }
+
+    unsigned int GetDroppedFrames() const { return dropped; }
+
+private:
+    static const unsigned int RING = 3;
+
+    struct Frame {
+        std::vector<unsigned char> pixels;
+        unsigned int number;
+    };
+
+    // Converts and writes queued frames on its own thread.
+    class Writer : public Thread {
+    public:
+        Writer(FrameCapture& capture)
+            : capture(capture), file(NULL), finished(false), written(0) {}
+
+        void Finish() {
+            lock.Lock();
+            finished = true;
+            lock.Unlock();
+            capture.queued.Set();
+        }
+
+        unsigned int GetWritten() const { return written; }
+
+        void Run() {
+            for (;;) {
+                Frame* frame = capture.Pop();
+                if (frame == NULL) {
+                    lock.Lock();
+                    bool done = finished;
+                    lock.Unlock();
+                    // finished is set after the last push
+                    if (done && (frame = capture.Pop()) == NULL) break;
+                    if (frame == NULL) {
+                        capture.queued.Wait();
+                        continue;
+                    }
+                }
+                if (Write(*frame)) written++;
+                capture.Recycle(frame);
+            }
+            if (file) fclose(file);
+        }
+
+    private:
+        FrameCapture& capture;
+        FILE* file;
+        Mutex lock;
+        bool finished;
+        unsigned int written;
+        std::vector<unsigned char> scratch;
+
+        bool Write(const Frame& frame) {
+            const int w = capture.width, h = capture.height;
+            const unsigned char* rgba = &frame.pixels[0];
+            switch (capture.format) {
+            case RAW:
+                if (!Open()) return false;
+                return fwrite(rgba, 4 * w * h, 1, file) == 1;
+            case PPM: {
+                char name[1024];
+                snprintf(name, sizeof(name), "%s_%06u.ppm",
+                         capture.base.c_str(), frame.number);
+                FILE* out = fopen(name, "wb");
+                if (out == NULL) return Failed(name);
+                fprintf(out, "P6\n%d %d\n255\n", w, h);
+                scratch.resize(3 * w);
+                for (int y = h - 1; y >= 0; y--) {
+                    const unsigned char* row = rgba + 4 * w * y;
+                    for (int x = 0; x < w; x++)
+                        for (int c = 0; c < 3; c++)
+                            scratch[3 * x + c] = row[4 * x + c];
+                    fwrite(&scratch[0], scratch.size(), 1, out);
+                }
+                return fclose(out) == 0;
+            }
+            case Y4M:
+                if (!Open()) return false;
+                ToYUV420(rgba, w, h);
+                fputs("FRAME\n", file);
+                return fwrite(&scratch[0], scratch.size(), 1, file) == 1;
+            }
+            return false;
+        }
+
+        bool Open() {
+            if (file) return true;
+            file = fopen(capture.path.c_str(), "wb");
+            if (file == NULL) return Failed(capture.path);
+            if (capture.format == Y4M)
+                fprintf(file, "YUV4MPEG2 W%d H%d F%u:%u Ip A1:1 C420jpeg\n",
+                        capture.width, capture.height,
+                        capture.fpsNum, capture.fpsDen);
+            return true;
+        }
+
+        bool Failed(const string& name) {
+            logger.error << "Can not write capture to '" << name << "'"
+                         << logger.end;
+            return false;
+        }
+
+        // Full range BT.601, chroma averaged over 2x2 blocks.
+        void ToYUV420(const unsigned char* rgba, int w, int h) {
+            const int cw = (w + 1) / 2, ch = (h + 1) / 2;
+            scratch.resize(w * h + 2 * cw * ch);
+            unsigned char* py = &scratch[0];
+            unsigned char* pu = py + w * h;
+            unsigned char* pv = pu + cw * ch;
+            for (int y = 0; y < h; y++) {
+                const unsigned char* row = rgba + 4 * w * (h - 1 - y);
+                for (int x = 0; x < w; x++) {
+                    const unsigned char* p = row + 4 * x;
+                    py[w * y + x] = Clamp(0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2]);
+                }
+            }
+            for (int cy = 0; cy < ch; cy++)
+                for (int cx = 0; cx < cw; cx++) {
+                    float r = 0, g = 0, b = 0;
+                    for (int j = 0; j < 2; j++)
+                        for (int i = 0; i < 2; i++) {
+                            int sx = std::min(w - 1, 2 * cx + i);
+                            int sy = std::min(h - 1, 2 * cy + j);
+                            const unsigned char* p = rgba + 4 * (w * (h - 1 - sy) + sx);
+                            r += p[0]; g += p[1]; b += p[2];
+                        }
+                    r *= 0.25f; g *= 0.25f; b *= 0.25f;
+                    pu[cw * cy + cx] = Clamp(128.0f - 0.168736f * r - 0.331264f * g + 0.5f * b);
+                    pv[cw * cy + cx] = Clamp(128.0f + 0.5f * r - 0.418688f * g - 0.081312f * b);
+                }
+        }
+
+        static unsigned char Clamp(float v) {
+            return (unsigned char)(v < 0.0f ? 0 : v > 255.0f ? 255 : v + 0.5f);
+        }
+    };
+
+    string path, base;
+    Format format;
+    bool blocking;
+    unsigned int queueSize;
+    GLint x, y;
+    int width, height;
+    GLuint pbos[RING];
+    bool pending[RING];
+    unsigned int next, captured, dropped;
+    Writer* writer;
+    unsigned int fpsNum, fpsDen;
+
+    // frames owned by the capture, queued ones and free ones
+    std::vector<Frame*> frames;
+    std::deque<Frame*> queue, free;
+    Mutex lock;
+    Signal queued, freed;
+
+    bool Start() {
+        GLint vp[4];
+        glGetIntegerv(GL_VIEWPORT, vp);
+        x = vp[0];
+        y = vp[1];
+        width = vp[2];
+        height = vp[3];
+        base = path;
+        if (format == PPM && base.size() > 4 &&
+            base.compare(base.size() - 4, 4, ".ppm") == 0)
+            base.erase(base.size() - 4);
+        if (format == Y4M && (width % 2 || height % 2))
+            logger.warning << "Y4M capture of odd size " << width << "x"
+                           << height << ", chroma is clamped at the border"
+                           << logger.end;
+
+        // one spare frame per queue entry plus the one being written
+        for (unsigned int i = 0; i < queueSize + 1; i++) {
+            Frame* frame = new Frame();
+            frame->pixels.resize(4 * width * height);
+            frames.push_back(frame);
+            free.push_back(frame);
+        }
+        if (GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object) {
+            glGenBuffers(RING, pbos);
+            for (unsigned int i = 0; i < RING; i++) {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+                glBufferData(GL_PIXEL_PACK_BUFFER, 4 * width * height, NULL,
+                             GL_STREAM_READ);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        else
+            logger.warning << "No pixel buffer objects, capture reads "
+                           << "frames synchronously" << logger.end;
+        writer = new Writer(*this);
+        writer->Start();
+        logger.info << "Capturing " << width << "x" << height << " to '"
+                    << path << "'" << logger.end;
+        return true;
+    }
+
+    void Collect(unsigned int slot) {
+        pending[slot] = false;
+        Frame* frame = Acquire();
+        if (frame == NULL) return;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[slot]);
+        void* data = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+        if (data) {
+            memcpy(&frame->pixels[0], data, frame->pixels.size());
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if (data) Submit(frame);
+        else Recycle(frame);
+    }
+
+    // A free frame, or NULL when the writer is behind and the frame
+    // must be dropped.
+    Frame* Acquire() {
+        for (;;) {
+            lock.Lock();
+            Frame* frame = NULL;
+            if (!free.empty()) {
+                frame = free.front();
+                free.pop_front();
+            }
+            lock.Unlock();
+            if (frame) return frame;
+            if (!blocking) {
+                dropped++;
+                captured++;
+                return NULL;
+            }
+            freed.Wait();
+        }
+    }
+
+    void Submit(Frame* frame) {
+        frame->number = captured++;
+        lock.Lock();
+        queue.push_back(frame);
+        lock.Unlock();
+        queued.Set();
+    }
+
+    Frame* Pop() {
+        lock.Lock();
+        Frame* frame = NULL;
+        if (!queue.empty()) {
+            frame = queue.front();
+            queue.pop_front();
+        }
+        lock.Unlock();
+        return frame;
+    }
+
+    void Recycle(Frame* frame) {
+        lock.Lock();
+        free.push_back(frame);
+        lock.Unlock();
+        freed.Set();
+    }
+};
+
+#endif // _FRAME_CAPTURE_H_
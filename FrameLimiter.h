@@ -0,0 +1,40 @@
+// Stops the engine after a fixed number of frames.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _FRAME_LIMITER_H_
+#define _FRAME_LIMITER_H_
+
+#include <Core/IEngine.h>
+#include <Core/IListener.h>
+#include <Logging/Logger.h>
+
+using namespace OpenEngine;
+using namespace OpenEngine::Core;
+
+class FrameLimiter : public IListener<ProcessEventArg> {
+public:
+    FrameLimiter(IEngine& engine, unsigned int frames)
+        : engine(engine), frames(frames), count(0) {}
+
+    void Handle(ProcessEventArg arg) {
+        if (++count == frames) {
+            logger.info << "Rendered " << count << " frames, stopping"
+                        << logger.end;
+            engine.Stop();
+        }
+    }
+
+    unsigned int GetFrameCount() const { return count; }
+
+private:
+    IEngine& engine;
+    unsigned int frames, count;
+};
+
+#endif // _FRAME_LIMITER_H_
@@ -0,0 +1,282 @@
+// GL error reporting through debug output or sampled glGetError.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _GL_DIAGNOSTICS_H_
+#define _GL_DIAGNOSTICS_H_
+
+#include "Atomic.h"
+
+#include <Core/IEngine.h>
+#include <Core/IListener.h>
+#include <Core/Mutex.h>
+#include <Logging/Logger.h>
+#include <Renderers/IRenderer.h>
+#include <Meta/OpenGL.h>
+
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace OpenEngine;
+using namespace OpenEngine::Core;
+using namespace OpenEngine::Renderers;
+using std::string;
+
+/**
+ * Finds GL errors without a glGetError round trip after every pass.
+ *
+ * DEBUG_CALLBACK installs a KHR_debug (or ARB_debug_output)
+ * callback. The driver reports errors on its own, asynchronously, so
+ * the render thread never waits for it. Begin() and End() mark the
+ * effect being rendered: with KHR_debug as debug groups, which arrive
+ * in the message stream in order with the errors, with
+ * ARB_debug_output as the scope last begun, which may be a later one
+ * than the scope of an error.
+ *
+ * SAMPLED calls glGetError at the Check() points, but only every
+ * interval frames; errors of the frames in between are reported at
+ * the first check point of the next sampled frame.
+ *
+ * OFF does nothing; Begin(), End() and Check() return after a
+ * compare. AUTO picks DEBUG_CALLBACK when the driver has debug output
+ * and otherwise SAMPLED; in NDEBUG builds AUTO is OFF, and only an
+ * explicit mode turns the diagnostics on.
+ *
+ * Drivers only have to report through debug output in a debug
+ * context, and the SDL frame has no way to ask for one.
+ * DEBUG_CALLBACK is therefore only used when the context has the
+ * debug flag (a driver may set it, e.g. through its control panel or
+ * environment); without it both DEBUG_CALLBACK and AUTO fall back to
+ * SAMPLED.
+ *
+ * The statics use the last diagnostics created, so any code can have
+ * check points without being handed the instance. The mode is fixed
+ * on the first frame, when there is a context.
+ */
+class GLDiagnostics : public IListener<RenderingEventArg>
+                    , public IListener<DeinitializeEventArg> {
+public:
+    enum Mode { AUTO, OFF, SAMPLED, DEBUG_CALLBACK };
+
+    GLDiagnostics(Mode mode = AUTO, unsigned int interval = 60)
+        : mode(mode), interval(interval ? interval : 1), initialized(false)
+        , khr(false), frame(0), scope(-1), errors(0), warnings(0) {
+        scopes.reserve(MAX_SCOPES);
+        current = this;
+    }
+
+    ~GLDiagnostics() {
+        if (current == this) current = NULL;
+    }
+
+    // Parses off, sampled, sampled=frames, callback or auto; frames
+    // is a whole number from 1 to 1000000.
+    static bool ParseMode(const string& value, Mode& mode, unsigned int& interval) {
+        string::size_type eq = value.find('=');
+        string name = value.substr(0, eq);
+        if (eq != string::npos) {
+            if (name != "sampled") return false;
+            const char* text = value.c_str() + eq + 1;
+            char* end;
+            long n = strtol(text, &end, 10);
+            if (end == text || *end != '\0' || n < 1 || n > 1000000)
+                return false;
+            interval = n;
+        }
+        if (name == "auto") mode = AUTO;
+        else if (name == "off") mode = OFF;
+        else if (name == "sampled") mode = SAMPLED;
+        else if (name == "callback") mode = DEBUG_CALLBACK;
+        else return false;
+        return true;
+    }
+
+    Mode GetMode() const { return mode; }
+
+    void Handle(RenderingEventArg arg) {
+        if (!initialized) Initialize();
+        frame++;
+    }
+
+    void Handle(DeinitializeEventArg arg) {
+        if (mode == DEBUG_CALLBACK) {
+            if (khr) {
+                glDisable(GL_DEBUG_OUTPUT);
+                glDebugMessageCallback(NULL, NULL);
+            }
+            else glDebugMessageCallbackARB(NULL, NULL);
+        }
+        if (mode != OFF)
+            logger.info << "GL diagnostics: " << errors << " errors, "
+                        << warnings << " warnings" << logger.end;
+    }
+
+    // Marks the GL calls until End() as belonging to scope.
+    static void Begin(const string& scope) {
+        GLDiagnostics* d = current;
+        if (d == NULL || (d->mode != SAMPLED && d->mode != DEBUG_CALLBACK))
+            return;
+        if (d->mode == SAMPLED) d->sampledScope = scope;
+        else if (d->khr)
+            glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, scope.c_str());
+        else Atomic::Store(&d->scope, d->Intern(scope));
+    }
+
+    static void End() {
+        GLDiagnostics* d = current;
+        if (d == NULL || (d->mode != SAMPLED && d->mode != DEBUG_CALLBACK))
+            return;
+        if (d->mode == SAMPLED) d->sampledScope.clear();
+        else if (d->khr) glPopDebugGroup();
+        else Atomic::Store(&d->scope, -1);
+    }
+
+    // Check point for SAMPLED, where names it in the report.
+    static void Check(const char* where) {
+        GLDiagnostics* d = current;
+        if (d == NULL || d->mode != SAMPLED || d->frame % d->interval) return;
+        for (GLenum e = glGetError(); e != GL_NO_ERROR; e = glGetError()) {
+            Atomic::Add(&d->errors, 1);
+            logger.error << "GL error " << ErrorName(e) << " at " << where
+                         << (d->sampledScope.empty() ? "" : " in ")
+                         << d->sampledScope << ", frame " << d->frame
+                         << " or earlier" << logger.end;
+        }
+    }
+
+private:
+    static const int MAX_SCOPES = 256;
+    static const int MAX_REPORTS = 100;
+
+    static GLDiagnostics* current;
+
+    Mode mode;
+    unsigned int interval;
+    bool initialized, khr;
+    unsigned int frame;
+    volatile int scope;             // index into scopes, -1 for none
+    volatile int errors, warnings;
+    string sampledScope;
+    // only appended to and never reallocated, so the callback may read
+    // any index it has seen published
+    std::vector<string> scopes;
+    std::map<string, int> scopeIndex;
+    std::vector<string> groups;     // debug group stack, callback only
+    Mutex groupLock;
+
+    void Initialize() {
+        initialized = true;
+        bool requested = mode == DEBUG_CALLBACK;
+        if (mode == AUTO) {
+#ifdef NDEBUG
+            mode = OFF;
+#else
+            mode = DEBUG_CALLBACK;
+#endif
+        }
+        if (mode != DEBUG_CALLBACK) return;
+        GLint flags = 0;
+        if (GLEW_VERSION_3_0) glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+        if (!(GLEW_KHR_debug || GLEW_ARB_debug_output) ||
+            !(flags & GL_CONTEXT_FLAG_DEBUG_BIT)) {
+            if (requested)
+                logger.warning << "No GL debug context, sampling glGetError"
+                               << " instead" << logger.end;
+            mode = SAMPLED;
+            return;
+        }
+        khr = GLEW_KHR_debug;
+        if (khr) {
+            glDebugMessageCallback((GLDEBUGPROC)Callback, this);
+            glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE,
+                                  GL_DEBUG_SEVERITY_NOTIFICATION, 0, NULL, GL_FALSE);
+            glDebugMessageControl(GL_DEBUG_SOURCE_APPLICATION,
+                                  GL_DEBUG_TYPE_PUSH_GROUP, GL_DONT_CARE,
+                                  0, NULL, GL_TRUE);
+            glDebugMessageControl(GL_DEBUG_SOURCE_APPLICATION,
+                                  GL_DEBUG_TYPE_POP_GROUP, GL_DONT_CARE,
+                                  0, NULL, GL_TRUE);
+            glEnable(GL_DEBUG_OUTPUT);
+        }
+        else glDebugMessageCallbackARB((GLDEBUGPROCARB)Callback, this);
+        logger.info << "GL diagnostics: "
+                    << (khr ? "KHR_debug" : "ARB_debug_output")
+                    << " callback" << logger.end;
+    }
+
+    static string ErrorName(GLenum error) {
+        switch (error) {
+        case GL_INVALID_ENUM:      return "GL_INVALID_ENUM";
+        case GL_INVALID_VALUE:     return "GL_INVALID_VALUE";
+        case GL_INVALID_OPERATION: return "GL_INVALID_OPERATION";
+        case GL_STACK_OVERFLOW:    return "GL_STACK_OVERFLOW";
+        case GL_STACK_UNDERFLOW:   return "GL_STACK_UNDERFLOW";
+        case GL_OUT_OF_MEMORY:     return "GL_OUT_OF_MEMORY";
+        case GL_INVALID_FRAMEBUFFER_OPERATION:
+            return "GL_INVALID_FRAMEBUFFER_OPERATION";
+        default:                   return "unknown";
+        }
+    }
+
+    int Intern(const string& name) {
+        std::map<string, int>::iterator itr = scopeIndex.find(name);
+        if (itr != scopeIndex.end()) return itr->second;
+        if ((int)scopes.size() == MAX_SCOPES) return -1;
+        scopes.push_back(name);
+        scopeIndex[name] = scopes.size() - 1;
+        return scopes.size() - 1;
+    }
+
+    static void GLAPIENTRY Callback(GLenum source, GLenum type, GLuint id,
+                                    GLenum severity, GLsizei length,
+                                    const GLchar* message, const void* user) {
+        ((GLDiagnostics*)user)->Report(type, severity, message);
+    }
+
+    // May run on a driver thread, and the driver is free to call it
+    // from more than one, so the group stack is locked.
+    void Report(GLenum type, GLenum severity, const GLchar* message) {
+        if (type == GL_DEBUG_TYPE_PUSH_GROUP) {
+            groupLock.Lock();
+            groups.push_back(message);
+            groupLock.Unlock();
+            return;
+        }
+        if (type == GL_DEBUG_TYPE_POP_GROUP) {
+            groupLock.Lock();
+            if (!groups.empty()) groups.pop_back();
+            groupLock.Unlock();
+            return;
+        }
+        if (severity == GL_DEBUG_SEVERITY_NOTIFICATION) return;
+        bool error = type == GL_DEBUG_TYPE_ERROR;
+        int count = Atomic::Add(error ? &errors : &warnings, 1);
+        if (count > MAX_REPORTS) return;
+        int active = Atomic::Load(&scope);
+        groupLock.Lock();
+        string where = !groups.empty() ? groups.back()
+            : active >= 0 ? scopes[active] : "no effect";
+        groupLock.Unlock();
+        if (error)
+            logger.error << "GL error in " << where << ": " << message
+                         << logger.end;
+        else
+            logger.warning << "GL warning in " << where << ": " << message
+                           << logger.end;
+        if (count == MAX_REPORTS)
+            logger.warning << "GL diagnostics: further "
+                           << (error ? "errors" : "warnings")
+                           << " are only counted" << logger.end;
+    }
+};
+
+GLDiagnostics* GLDiagnostics::current = NULL;
+
+#endif // _GL_DIAGNOSTICS_H_
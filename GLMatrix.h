@@ -0,0 +1,108 @@
+// Column major 4x4 matrix helpers matching the GL conventions.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _GL_MATRIX_H_
+#define _GL_MATRIX_H_
+
+#include <algorithm>
+#include <cmath>
+
+// Matrices are float[16] laid out like glLoadMatrixf expects.
+class GLMatrix {
+public:
+    static void Identity(float m[16]) {
+        for (int i = 0; i < 16; i++) m[i] = i % 5 == 0 ? 1.0f : 0.0f;
+    }
+
+    // out = a * b, out may not alias a or b.
+    static void Multiply(const float* a, const float* b, float* out) {
+        for (int c = 0; c < 4; c++)
+            for (int r = 0; r < 4; r++)
+                out[c * 4 + r] = a[r] * b[c * 4] + a[4 + r] * b[c * 4 + 1] +
+                    a[8 + r] * b[c * 4 + 2] + a[12 + r] * b[c * 4 + 3];
+    }
+
+    // out = m * (x, y, z, w)
+    static void Transform(const float* m, const float* v, float* out) {
+        for (int r = 0; r < 4; r++)
+            out[r] = m[r] * v[0] + m[4 + r] * v[1] + m[8 + r] * v[2] + m[12 + r] * v[3];
+    }
+
+    // General inverse by cofactors, false if m is singular.
+    static bool Invert(const float* m, float* out) {
+        float inv[16];
+        inv[0] = m[5]*m[10]*m[15] - m[5]*m[11]*m[14] - m[9]*m[6]*m[15] + m[9]*m[7]*m[14] + m[13]*m[6]*m[11] - m[13]*m[7]*m[10];
+        inv[4] = -m[4]*m[10]*m[15] + m[4]*m[11]*m[14] + m[8]*m[6]*m[15] - m[8]*m[7]*m[14] - m[12]*m[6]*m[11] + m[12]*m[7]*m[10];
+        inv[8] = m[4]*m[9]*m[15] - m[4]*m[11]*m[13] - m[8]*m[5]*m[15] + m[8]*m[7]*m[13] + m[12]*m[5]*m[11] - m[12]*m[7]*m[9];
+        inv[12] = -m[4]*m[9]*m[14] + m[4]*m[10]*m[13] + m[8]*m[5]*m[14] - m[8]*m[6]*m[13] - m[12]*m[5]*m[10] + m[12]*m[6]*m[9];
+        inv[1] = -m[1]*m[10]*m[15] + m[1]*m[11]*m[14] + m[9]*m[2]*m[15] - m[9]*m[3]*m[14] - m[13]*m[2]*m[11] + m[13]*m[3]*m[10];
+        inv[5] = m[0]*m[10]*m[15] - m[0]*m[11]*m[14] - m[8]*m[2]*m[15] + m[8]*m[3]*m[14] + m[12]*m[2]*m[11] - m[12]*m[3]*m[10];
+        inv[9] = -m[0]*m[9]*m[15] + m[0]*m[11]*m[13] + m[8]*m[1]*m[15] - m[8]*m[3]*m[13] - m[12]*m[1]*m[11] + m[12]*m[3]*m[9];
+        inv[13] = m[0]*m[9]*m[14] - m[0]*m[10]*m[13] - m[8]*m[1]*m[14] + m[8]*m[2]*m[13] + m[12]*m[1]*m[10] - m[12]*m[2]*m[9];
+        inv[2] = m[1]*m[6]*m[15] - m[1]*m[7]*m[14] - m[5]*m[2]*m[15] + m[5]*m[3]*m[14] + m[13]*m[2]*m[7] - m[13]*m[3]*m[6];
+        inv[6] = -m[0]*m[6]*m[15] + m[0]*m[7]*m[14] + m[4]*m[2]*m[15] - m[4]*m[3]*m[14] - m[12]*m[2]*m[7] + m[12]*m[3]*m[6];
+        inv[10] = m[0]*m[5]*m[15] - m[0]*m[7]*m[13] - m[4]*m[1]*m[15] + m[4]*m[3]*m[13] + m[12]*m[1]*m[7] - m[12]*m[3]*m[5];
+        inv[14] = -m[0]*m[5]*m[14] + m[0]*m[6]*m[13] + m[4]*m[1]*m[14] - m[4]*m[2]*m[13] - m[12]*m[1]*m[6] + m[12]*m[2]*m[5];
+        inv[3] = -m[1]*m[6]*m[11] + m[1]*m[7]*m[10] + m[5]*m[2]*m[11] - m[5]*m[3]*m[10] - m[9]*m[2]*m[7] + m[9]*m[3]*m[6];
+        inv[7] = m[0]*m[6]*m[11] - m[0]*m[7]*m[10] - m[4]*m[2]*m[11] + m[4]*m[3]*m[10] + m[8]*m[2]*m[7] - m[8]*m[3]*m[6];
+        inv[11] = -m[0]*m[5]*m[11] + m[0]*m[7]*m[9] + m[4]*m[1]*m[11] - m[4]*m[3]*m[9] - m[8]*m[1]*m[7] + m[8]*m[3]*m[5];
+        inv[15] = m[0]*m[5]*m[10] - m[0]*m[6]*m[9] - m[4]*m[1]*m[10] + m[4]*m[2]*m[9] + m[8]*m[1]*m[6] - m[8]*m[2]*m[5];
+        float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+        if (det == 0.0f) return false;
+        for (int i = 0; i < 16; i++) out[i] = inv[i] / det;
+        return true;
+    }
+
+    // Like gluLookAt.
+    static void LookAt(const float eye[3], const float center[3],
+                       const float up[3], float m[16]) {
+        float f[3] = { center[0] - eye[0], center[1] - eye[1], center[2] - eye[2] };
+        Normalize(f);
+        float s[3];
+        Cross(f, up, s);
+        Normalize(s);
+        float u[3];
+        Cross(s, f, u);
+        Identity(m);
+        for (int i = 0; i < 3; i++) {
+            m[i * 4] = s[i];
+            m[i * 4 + 1] = u[i];
+            m[i * 4 + 2] = -f[i];
+        }
+        m[12] = -(s[0] * eye[0] + s[1] * eye[1] + s[2] * eye[2]);
+        m[13] = -(u[0] * eye[0] + u[1] * eye[1] + u[2] * eye[2]);
+        m[14] = f[0] * eye[0] + f[1] * eye[1] + f[2] * eye[2];
+    }
+
+    // Like gluPerspective, fovy in radians.
+    static void Perspective(float fovy, float aspect, float zNear, float zFar,
+                            float m[16]) {
+        float f = 1.0f / std::tan(fovy * 0.5f);
+        for (int i = 0; i < 16; i++) m[i] = 0.0f;
+        m[0] = f / aspect;
+        m[5] = f;
+        m[10] = (zFar + zNear) / (zNear - zFar);
+        m[11] = -1.0f;
+        m[14] = 2.0f * zFar * zNear / (zNear - zFar);
+    }
+
+    static void Cross(const float a[3], const float b[3], float out[3]) {
+        out[0] = a[1] * b[2] - a[2] * b[1];
+        out[1] = a[2] * b[0] - a[0] * b[2];
+        out[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    static void Normalize(float v[3]) {
+        float len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+        if (len > 0.0f)
+            for (int i = 0; i < 3; i++) v[i] /= len;
+    }
+};
+
+#endif // _GL_MATRIX_H_
@@ -0,0 +1,95 @@
+// Small helpers for building GLSL programs.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _GL_PROGRAM_H_
+#define _GL_PROGRAM_H_
+
+#include <Logging/Logger.h>
+#include <Meta/OpenGL.h>
+
+#include <string>
+#include <vector>
+
+using namespace OpenEngine;
+using std::string;
+
+class GLProgram {
+public:
+    // Pass through vertex shader for screen aligned quads.
+    static string ScreenVertexShader() {
+        return
+            "void main() {\n"
+            "  gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+            "  gl_Position = gl_Vertex;\n"
+            "}\n";
+    }
+
+    // Compile and link, returns 0 and logs the info log on failure.
+    static GLuint Build(const string& vertex, const string& fragment,
+                        const string& name) {
+        GLuint vs = Compile(GL_VERTEX_SHADER, vertex, name);
+        GLuint fs = Compile(GL_FRAGMENT_SHADER, fragment, name);
+        if (vs == 0 || fs == 0) {
+            if (vs) glDeleteShader(vs);
+            if (fs) glDeleteShader(fs);
+            return 0;
+        }
+        GLuint program = glCreateProgram();
+        glAttachShader(program, vs);
+        glAttachShader(program, fs);
+        glLinkProgram(program);
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+        if (!CheckLinked(program, name)) {
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    static bool CheckLinked(GLuint program, const string& name) {
+        GLint status;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status) return true;
+        logger.error << "Linking program '" << name << "' failed: "
+                     << ProgramLog(program) << logger.end;
+        return false;
+    }
+
+    static string ProgramLog(GLuint program) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        if (length <= 1) return "";
+        std::vector<GLchar> log(length);
+        glGetProgramInfoLog(program, length, NULL, &log[0]);
+        return string(&log[0]);
+    }
+
+    static GLuint Compile(GLenum type, const string& source,
+                          const string& name) {
+        GLuint shader = glCreateShader(type);
+        const GLchar* src = source.c_str();
+        glShaderSource(shader, 1, &src, NULL);
+        glCompileShader(shader);
+        GLint status;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if (status) return shader;
+
+        GLint length = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+        std::vector<GLchar> log(length > 1 ? length : 1, 0);
+        glGetShaderInfoLog(shader, log.size(), NULL, &log[0]);
+        logger.error << "Compiling shader for '" << name << "' failed: "
+                     << &log[0] << logger.end;
+        glDeleteShader(shader);
+        return 0;
+    }
+};
+
+#endif // _GL_PROGRAM_H_
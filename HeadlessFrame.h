@@ -0,0 +1,113 @@
+// Offscreen frame for running the demo without a display.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _HEADLESS_FRAME_H_
+#define _HEADLESS_FRAME_H_
+
+#include <Display/IFrame.h>
+#include <Core/Exceptions.h>
+#include <Logging/Logger.h>
+#include <Meta/OpenGL.h>
+
+#ifdef HAVE_OSMESA
+#include <GL/osmesa.h>
+#endif
+
+#include <vector>
+
+using namespace OpenEngine;
+using namespace OpenEngine::Core;
+using namespace OpenEngine::Display;
+
+/**
+ * Frame backed by an OSMesa (software, e.g. llvmpipe) context
+ * rendering into client memory.
+ *
+ * Needs no window system, so the complete renderer and post
+ * processing chain can run in containers and on render nodes.
+ * The color buffer is bottom-up RGBA and can be read with
+ * GetPixels() after the frame has been processed.
+ */
+class HeadlessFrame : public IFrame {
+public:
+    HeadlessFrame(unsigned int width, unsigned int height,
+                  unsigned int depth, FrameOption options = FrameOption())
+        : width(width), height(height), depth(depth)
+        , options(options), context(NULL) {}
+
+    bool IsFocused() const { return true; }
+    unsigned int GetWidth() const { return width; }
+    unsigned int GetHeight() const { return height; }
+    unsigned int GetDepth() const { return depth; }
+    FrameOption GetOptions() const { return options; }
+    bool GetOption(const FrameOption option) const {
+        return (option & options) == option;
+    }
+
+    // The buffer is allocated on initialize, changes after that are
+    // ignored like on a fixed size window.
+    void SetWidth(const unsigned int width) {
+        if (context == NULL) this->width = width;
+    }
+    void SetHeight(const unsigned int height) {
+        if (context == NULL) this->height = height;
+    }
+    void SetDepth(const unsigned int depth) {
+        if (context == NULL) this->depth = depth;
+    }
+    void SetOptions(const FrameOption options) {
+        this->options = options;
+    }
+    void ToggleOption(const FrameOption option) {
+        options = FrameOption(options ^ option);
+    }
+
+    const unsigned char* GetPixels() const {
+        return buffer.empty() ? NULL : &buffer[0];
+    }
+
+    void Handle(InitializeEventArg arg) {
+#ifdef HAVE_OSMESA
+        context = OSMesaCreateContextExt(OSMESA_RGBA, 24, 8, 0, NULL);
+        if (context == NULL)
+            throw Exception("Could not create OSMesa context.");
+        buffer.resize(width * height * 4);
+        if (!OSMesaMakeCurrent((OSMesaContext)context, &buffer[0],
+                               GL_UNSIGNED_BYTE, width, height))
+            throw Exception("Could not make OSMesa context current.");
+        OSMesaPixelStore(OSMESA_Y_UP, 1);
+        logger.info << "Headless frame " << width << "x" << height
+                    << " (" << glGetString(GL_RENDERER) << ")"
+                    << logger.end;
+#else
+        throw Exception("Headless mode needs OSMesa support, "
+                        "rebuild with OSMesa installed.");
+#endif
+    }
+
+    void Handle(ProcessEventArg arg) {
+        // nothing to present, just make sure the frame is done
+        glFinish();
+    }
+
+    void Handle(DeinitializeEventArg arg) {
+#ifdef HAVE_OSMESA
+        if (context) OSMesaDestroyContext((OSMesaContext)context);
+#endif
+        context = NULL;
+    }
+
+private:
+    unsigned int width, height, depth;
+    FrameOption options;
+    void* context;
+    std::vector<unsigned char> buffer;
+};
+
+#endif // _HEADLESS_FRAME_H_
@@ -0,0 +1,180 @@
+// Decoding of TGA and PPM files into RGBA mip chains.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _IMAGE_DECODER_H_
+#define _IMAGE_DECODER_H_
+
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using std::string;
+
+// One level of a mip chain, RGBA8 rows bottom-up like GL expects.
+struct ImageLevel {
+    int width, height;
+    std::vector<unsigned char> pixels;
+};
+
+/**
+ * Reads an image file into RGBA8 and box filters it down to 1x1, so
+ * all of the work is done before anything is handed to GL. Reads
+ * uncompressed and run length encoded true color TGA (24 or 32 bit)
+ * and binary PPM (P6, 8 bit). Runs on any thread.
+ *
+ * Files are untrusted: images larger than MAX_SIZE on a side, and
+ * headers promising more pixels than the file can hold, are rejected
+ * before anything is allocated.
+ */
+class ImageDecoder {
+public:
+    static const int MAX_SIZE = 16384;
+
+    // Level 0 is the full image. False if the file can not be read.
+    static bool Decode(const string& path, std::vector<ImageLevel>& levels) {
+        levels.clear();
+        MappedFile file(path);
+        if (!file.IsOpen()) return false;
+        levels.resize(1);
+        const unsigned char* data = (const unsigned char*)file.GetData();
+        bool ok = file.GetSize() > 2 && data[0] == 'P' && data[1] == '6'
+            ? DecodePPM(data, file.GetSize(), levels[0])
+            : DecodeTGA(data, file.GetSize(), levels[0]);
+        if (!ok) {
+            levels.clear();
+            return false;
+        }
+        while (levels.back().width > 1 || levels.back().height > 1) {
+            levels.push_back(ImageLevel());
+            Downsample(levels[levels.size() - 2], levels.back());
+        }
+        return true;
+    }
+
+private:
+    static bool DecodeTGA(const unsigned char* data, size_t size, ImageLevel& out) {
+        if (size < 18) return false;
+        int idLength = data[0], colorMap = data[1], type = data[2];
+        int width = data[12] | data[13] << 8, height = data[14] | data[15] << 8;
+        int bpp = data[16] / 8, descriptor = data[17];
+        if (colorMap != 0 || (type != 2 && type != 10) ||
+            (bpp != 3 && bpp != 4) || width == 0 || height == 0 ||
+            width > MAX_SIZE || height > MAX_SIZE ||
+            (size_t)18 + idLength > size)
+            return false;
+        // raw pixels have to be there in full; a run length packet
+        // takes at least 1 + bpp bytes for up to 128 pixels
+        const size_t count = (size_t)width * height;
+        const size_t available = size - 18 - idLength;
+        if (type == 2 ? count * bpp > available
+                      : (count + 127) / 128 * (1 + bpp) > available)
+            return false;
+        const unsigned char* p = data + 18 + idLength;
+        const unsigned char* end = data + size;
+        out.width = width;
+        out.height = height;
+        out.pixels.resize(4 * count);
+        unsigned char* o = &out.pixels[0];
+        unsigned char* last = o + out.pixels.size();
+        // BGR(A) pixels, raw or as run length packets
+        while (o < last) {
+            int count = 1;
+            bool run = false;
+            if (type == 10) {
+                if (p >= end) return false;
+                run = (*p & 0x80) != 0;
+                count = (*p++ & 0x7f) + 1;
+            }
+            else count = (last - o) / 4;
+            for (int i = 0; i < count && o < last; i++) {
+                const unsigned char* s = run ? p : p + i * bpp;
+                if (s + bpp > end) return false;
+                o[0] = s[2]; o[1] = s[1]; o[2] = s[0];
+                o[3] = bpp == 4 ? s[3] : 255;
+                o += 4;
+            }
+            p += run ? bpp : count * bpp;
+        }
+        // bit 5 set means the first row is the top one
+        if (descriptor & 0x20) FlipRows(out);
+        return true;
+    }
+
+    static bool DecodePPM(const unsigned char* data, size_t size, ImageLevel& out) {
+        const unsigned char* p = data + 2;
+        const unsigned char* end = data + size;
+        int values[3];
+        for (int i = 0; i < 3; i++) {
+            // whitespace and comments between the header fields
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' ||
+                               *p == '\n' || *p == '#'))
+                if (*p++ == '#')
+                    while (p < end && *p != '\n') p++;
+            // stops counting past MAX_SIZE, so it can not overflow
+            values[i] = 0;
+            while (p < end && *p >= '0' && *p <= '9') {
+                if (values[i] <= MAX_SIZE)
+                    values[i] = values[i] * 10 + (*p - '0');
+                p++;
+            }
+        }
+        if (p >= end) return false;
+        p++;    // single whitespace before the pixels
+        int width = values[0], height = values[1];
+        if (width <= 0 || height <= 0 || width > MAX_SIZE ||
+            height > MAX_SIZE || values[2] != 255)
+            return false;
+        const size_t count = (size_t)width * height;
+        if (3 * count > (size_t)(end - p)) return false;
+        out.width = width;
+        out.height = height;
+        out.pixels.resize(4 * count);
+        for (size_t i = 0; i < count; i++) {
+            out.pixels[4 * i] = p[3 * i];
+            out.pixels[4 * i + 1] = p[3 * i + 1];
+            out.pixels[4 * i + 2] = p[3 * i + 2];
+            out.pixels[4 * i + 3] = 255;
+        }
+        // PPM is stored top-down
+        FlipRows(out);
+        return true;
+    }
+
+    static void FlipRows(ImageLevel& image) {
+        const int row = 4 * image.width;
+        for (int y = 0; y < image.height / 2; y++)
+            std::swap_ranges(image.pixels.begin() + row * y,
+                             image.pixels.begin() + row * (y + 1),
+                             image.pixels.begin() + row * (image.height - 1 - y));
+    }
+
+    // 2x2 box filter, the last row or column is repeated for odd sizes.
+    static void Downsample(const ImageLevel& in, ImageLevel& out) {
+        out.width = std::max(1, in.width / 2);
+        out.height = std::max(1, in.height / 2);
+        out.pixels.resize(4 * out.width * out.height);
+        for (int y = 0; y < out.height; y++) {
+            int y0 = std::min(2 * y, in.height - 1), y1 = std::min(2 * y + 1, in.height - 1);
+            for (int x = 0; x < out.width; x++) {
+                int x0 = std::min(2 * x, in.width - 1), x1 = std::min(2 * x + 1, in.width - 1);
+                for (int c = 0; c < 4; c++)
+                    out.pixels[4 * (out.width * y + x) + c] = (unsigned char)
+                        ((in.pixels[4 * (in.width * y0 + x0) + c] +
+                          in.pixels[4 * (in.width * y0 + x1) + c] +
+                          in.pixels[4 * (in.width * y1 + x0) + c] +
+                          in.pixels[4 * (in.width * y1 + x1) + c] + 2) / 4);
+            }
+        }
+    }
+};
+
+#endif // _IMAGE_DECODER_H_
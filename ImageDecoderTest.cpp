@@ -0,0 +1,139 @@
+// Checks of the image decoder on good and hostile files.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "ImageDecoder.h"
+#include "TestCheck.h"
+
+#include <cstdio>
+#include <string>
+
+using std::string;
+
+static const char* PATH = "ImageDecoderTest.tmp";
+
+// Decodes bytes written to a scratch file.
+static bool Decode(const string& bytes, std::vector<ImageLevel>& levels) {
+    FILE* out = fopen(PATH, "wb");
+    if (out == NULL) return false;
+    fwrite(bytes.data(), 1, bytes.size(), out);
+    fclose(out);
+    bool ok = ImageDecoder::Decode(PATH, levels);
+    remove(PATH);
+    return ok;
+}
+
+static string TGAHeader(int type, int width, int height, int bits,
+                        int descriptor = 0, int idLength = 0) {
+    string h(18, '\0');
+    h[0] = (char)idLength;
+    h[2] = (char)type;
+    h[12] = (char)(width & 0xff);
+    h[13] = (char)(width >> 8);
+    h[14] = (char)(height & 0xff);
+    h[15] = (char)(height >> 8);
+    h[16] = (char)bits;
+    h[17] = (char)descriptor;
+    return h;
+}
+
+static bool Pixel(const ImageLevel& image, int x, int y,
+                  int r, int g, int b, int a) {
+    const unsigned char* p = &image.pixels[4 * (image.width * y + x)];
+    return p[0] == r && p[1] == g && p[2] == b && p[3] == a;
+}
+
+static void TestPPM() {
+    std::vector<ImageLevel> levels;
+    // 3x2, top row red green blue, bottom row white
+    string ppm = "P6\n# comment\n3 2\n255\n";
+    const unsigned char rgb[18] = { 255, 0, 0, 0, 255, 0, 0, 0, 255,
+                                    255, 255, 255, 255, 255, 255, 255, 255, 255 };
+    ppm.append((const char*)rgb, sizeof(rgb));
+    CHECK(Decode(ppm, levels));
+    CHECK(levels.size() == 2);
+    if (levels.size() != 2) return;
+    CHECK(levels[0].width == 3 && levels[0].height == 2);
+    // stored bottom-up
+    CHECK(Pixel(levels[0], 0, 1, 255, 0, 0, 255));
+    CHECK(Pixel(levels[0], 2, 1, 0, 0, 255, 255));
+    CHECK(Pixel(levels[0], 1, 0, 255, 255, 255, 255));
+    CHECK(levels[1].width == 1 && levels[1].height == 1);
+
+    // one byte short
+    CHECK(!Decode(ppm.substr(0, ppm.size() - 1), levels));
+    CHECK(levels.empty());
+    // header without pixels or without the last field
+    CHECK(!Decode("P6\n3 2\n255", levels));
+    CHECK(!Decode("P6 3 2", levels));
+    CHECK(!Decode("P6\n3 2\n65535\n", levels));
+}
+
+static void TestPPMBounds() {
+    std::vector<ImageLevel> levels;
+    // sizes whose product overflows an int, or too large to be a
+    // texture, must fail without allocating
+    CHECK(!Decode("P6\n65536 65536\n255\n" + string(64, 'x'), levels));
+    CHECK(!Decode("P6\n99999999999999 1\n255\n" + string(64, 'x'), levels));
+    CHECK(!Decode("P6\n1 4294967297\n255\n" + string(64, 'x'), levels));
+    CHECK(!Decode("P6\n16385 1\n255\n" + string(3 * 16385, 'x'), levels));
+    CHECK(!Decode("P6\n0 5\n255\n", levels));
+    // the largest allowed side is fine
+    CHECK(Decode("P6\n16384 1\n255\n" + string(3 * 16384, 'x'), levels));
+    CHECK(!levels.empty() && levels[0].width == 16384);
+}
+
+static void TestTGA() {
+    std::vector<ImageLevel> levels;
+    // 2x1 uncompressed 24 bit, BGR
+    string raw = TGAHeader(2, 2, 1, 24);
+    const unsigned char bgr[6] = { 1, 2, 3, 4, 5, 6 };
+    raw.append((const char*)bgr, sizeof(bgr));
+    CHECK(Decode(raw, levels));
+    if (!levels.empty()) {
+        CHECK(Pixel(levels[0], 0, 0, 3, 2, 1, 255));
+        CHECK(Pixel(levels[0], 1, 0, 6, 5, 4, 255));
+    }
+    CHECK(!Decode(raw.substr(0, raw.size() - 1), levels));
+
+    // 4x1 run length encoded 32 bit: a run of three and a raw pixel,
+    // behind an id field
+    string rle = TGAHeader(10, 4, 1, 32, 0, 2) + "id";
+    const unsigned char packets[10] = { 0x82, 10, 20, 30, 40,
+                                        0x00, 50, 60, 70, 80 };
+    rle.append((const char*)packets, sizeof(packets));
+    CHECK(Decode(rle, levels));
+    if (!levels.empty()) {
+        CHECK(Pixel(levels[0], 0, 0, 30, 20, 10, 40));
+        CHECK(Pixel(levels[0], 2, 0, 30, 20, 10, 40));
+        CHECK(Pixel(levels[0], 3, 0, 70, 60, 50, 80));
+    }
+    CHECK(!Decode(rle.substr(0, rle.size() - 1), levels));
+}
+
+static void TestTGABounds() {
+    std::vector<ImageLevel> levels;
+    // 65535 on a side, far more than the file holds
+    CHECK(!Decode(TGAHeader(2, 65535, 65535, 32) + string(64, 'x'), levels));
+    CHECK(!Decode(TGAHeader(10, 65535, 65535, 32) + string(64, 'x'), levels));
+    // run length data too short for the packets the size needs
+    CHECK(!Decode(TGAHeader(10, 16384, 16384, 24) + string(1024, '\x7f'), levels));
+    // an id field running past the end
+    CHECK(!Decode(TGAHeader(2, 1, 1, 24, 0, 255) + "abc", levels));
+    CHECK(!Decode(TGAHeader(2, 0, 1, 24) + "abc", levels));
+    CHECK(!Decode(TGAHeader(2, 1, 1, 16) + "abc", levels));
+    CHECK(!Decode(string(10, '\0'), levels));
+}
+
+int main(int argc, char** argv) {
+    TestPPM();
+    TestPPMBounds();
+    TestTGA();
+    TestTGABounds();
+    return TestFailures();
+}
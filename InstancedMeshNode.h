@@ -0,0 +1,271 @@
+// Render node drawing many copies of one mesh with instancing.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _INSTANCED_MESH_NODE_H_
+#define _INSTANCED_MESH_NODE_H_
+
+#include "Bounds.h"
+#include "GLDiagnostics.h"
+#include "GLProgram.h"
+#include "MeshBuffer.h"
+
+#include <Scene/RenderNode.h>
+#include <Renderers/IRenderingView.h>
+#include <Meta/OpenGL.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+using namespace OpenEngine;
+
+// Per instance data, stored contiguously and uploaded as is.
+struct MeshInstance {
+    float transform[16];    // column major, like glMultMatrixf
+    float color[4];
+};
+
+/**
+ * Draws one mesh once per instance with a single instanced call.
+ *
+ * The instances are kept in one array that mirrors a vertex buffer;
+ * SetTransform() and SetColor() widen a dirty range and only that
+ * range is sent with glBufferSubData on the next draw. Scattered
+ * updates in the same frame upload everything between them, so
+ * update neighbouring instances together where possible.
+ *
+ * The transforms feed a vertex program through per instance
+ * attributes (ARB_instanced_arrays) that lights the mesh with light 0,
+ * the instance color and the specular front material. Without
+ * instancing support every instance is drawn with its own
+ * glMultMatrixf and glColor, still without any per instance scene
+ * traversal. Transforms are expected to be rigid
+ * with uniform scale.
+ *
+ * The mesh is not owned by the node and must outlive it. Its bounding
+ * radius around the origin gives the bounds of the node.
+ */
+class InstancedMeshNode : public Scene::RenderNode, public IBounded {
+public:
+    InstancedMeshNode(MeshBuffer* mesh, float meshRadius)
+        : mesh(mesh), meshRadius(meshRadius), vbo(0), capacity(0)
+        , dirtyBegin(0), dirtyEnd(0), version(0), program(0)
+        , checked(false), instanced(false) {}
+
+    ~InstancedMeshNode() {
+        if (vbo) glDeleteBuffers(1, &vbo);
+        if (program) glDeleteProgram(program);
+    }
+
+    // Adds an instance and returns its index.
+    unsigned int AddInstance(const float transform[16], const float color[4]) {
+        MeshInstance instance;
+        std::memcpy(instance.transform, transform, sizeof(instance.transform));
+        std::memcpy(instance.color, color, sizeof(instance.color));
+        instances.push_back(instance);
+        Touch(instances.size() - 1);
+        version++;
+        return instances.size() - 1;
+    }
+
+    void SetTransform(unsigned int i, const float transform[16]) {
+        std::memcpy(instances[i].transform, transform, sizeof(instances[i].transform));
+        Touch(i);
+        version++;
+    }
+
+    void SetColor(unsigned int i, const float color[4]) {
+        std::memcpy(instances[i].color, color, sizeof(instances[i].color));
+        Touch(i);
+    }
+
+    const MeshInstance& GetInstance(unsigned int i) const { return instances[i]; }
+    unsigned int GetInstanceCount() const { return instances.size(); }
+
+    // Sphere around all instances with their current transforms.
+    BoundingSphere GetBounds() const {
+        BoundingBox box;
+        box.Clear();
+        for (unsigned int i = 0; i < instances.size(); i++) {
+            const float* m = instances[i].transform;
+            float scale = std::sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+            BoundingSphere s = { { m[12], m[13], m[14] }, meshRadius * scale };
+            box.Add(s);
+        }
+        if (box.IsEmpty()) {
+            BoundingSphere none = { {0.0f, 0.0f, 0.0f}, 0.0f };
+            return none;
+        }
+        return box.GetSphere();
+    }
+
+    // Bumped whenever an instance is added or moved.
+    unsigned int GetVersion() const { return version; }
+
+    // True if the last draw used the instanced path.
+    bool IsInstanced() const { return instanced; }
+
+    void Apply(Renderers::IRenderingView* view) {
+        if (instances.empty() || mesh->GetIndexCount() == 0) return;
+        if (!checked) Initialize();
+        if (instanced) DrawInstanced();
+        else           DrawLoop();
+    }
+
+private:
+    static const unsigned int ATTRIBUTES = 5;
+
+    MeshBuffer* mesh;
+    float meshRadius;
+    std::vector<MeshInstance> instances;
+    GLuint vbo;
+    unsigned int capacity, dirtyBegin, dirtyEnd, version;
+    GLuint program;
+    GLint attributes[ATTRIBUTES];   // matrix columns and color
+    bool checked, instanced;
+
+    void Touch(unsigned int i) {
+        if (dirtyBegin == dirtyEnd) {
+            dirtyBegin = i;
+            dirtyEnd = i + 1;
+        }
+        else {
+            dirtyBegin = std::min(dirtyBegin, i);
+            dirtyEnd = std::max(dirtyEnd, i + 1);
+        }
+    }
+
+    void Initialize() {
+        checked = true;
+        if (!GLEW_VERSION_2_0 || !GLEW_ARB_instanced_arrays ||
+            !GLEW_ARB_draw_instanced)
+            return;
+        program = GLProgram::Build(VertexShader(), FragmentShader(),
+                                   "instanced mesh");
+        if (program == 0) return;
+        static const char* names[ATTRIBUTES] = {
+            "column0", "column1", "column2", "column3", "color" };
+        for (unsigned int a = 0; a < ATTRIBUTES; a++) {
+            attributes[a] = glGetAttribLocation(program, names[a]);
+            if (attributes[a] < 0) {
+                glDeleteProgram(program);
+                program = 0;
+                return;
+            }
+        }
+        glGenBuffers(1, &vbo);
+        instanced = true;
+    }
+
+    // Sends the dirty instances, reallocating when the array grew.
+    void Upload() {
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        if (capacity < instances.size()) {
+            capacity = instances.capacity();
+            glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(MeshInstance),
+                         NULL, GL_DYNAMIC_DRAW);
+            dirtyBegin = 0;
+            dirtyEnd = instances.size();
+        }
+        if (dirtyBegin != dirtyEnd)
+            glBufferSubData(GL_ARRAY_BUFFER, dirtyBegin * sizeof(MeshInstance),
+                            (dirtyEnd - dirtyBegin) * sizeof(MeshInstance),
+                            &instances[dirtyBegin]);
+        dirtyBegin = dirtyEnd = 0;
+    }
+
+    void DrawInstanced() {
+        mesh->Bind();
+        Upload();
+        for (unsigned int a = 0; a < ATTRIBUTES; a++) {
+            const char* offset = a < 4
+                ? (const char*)offsetof(MeshInstance, transform) + 4 * a * sizeof(float)
+                : (const char*)offsetof(MeshInstance, color);
+            glEnableVertexAttribArray(attributes[a]);
+            glVertexAttribPointer(attributes[a], 4, GL_FLOAT, GL_FALSE,
+                                  sizeof(MeshInstance), offset);
+            glVertexAttribDivisorARB(attributes[a], 1);
+        }
+        glUseProgram(program);
+        mesh->DrawElementsInstanced(instances.size());
+        glUseProgram(0);
+        for (unsigned int a = 0; a < ATTRIBUTES; a++) {
+            glVertexAttribDivisorARB(attributes[a], 0);
+            glDisableVertexAttribArray(attributes[a]);
+        }
+        mesh->Unbind();
+        GLDiagnostics::Check("instanced meshes");
+    }
+
+    void DrawLoop() {
+        glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_LIGHTING_BIT);
+        glEnable(GL_NORMALIZE);
+        glEnable(GL_COLOR_MATERIAL);
+        glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+        mesh->Bind();
+        for (unsigned int i = 0; i < instances.size(); i++) {
+            glPushMatrix();
+            glMultMatrixf(instances[i].transform);
+            glColor4fv(instances[i].color);
+            mesh->DrawElements();
+            glPopMatrix();
+        }
+        mesh->Unbind();
+        glPopAttrib();
+        dirtyBegin = dirtyEnd = 0;
+    }
+
+    static string VertexShader() {
+        return
+            "attribute vec4 column0, column1, column2, column3;\n"
+            "attribute vec4 color;\n"
+            "varying vec3 position;\n"
+            "varying vec3 normal;\n"
+            "varying vec4 tint;\n"
+            "void main() {\n"
+            "  mat4 instance = mat4(column0, column1, column2, column3);\n"
+            "  vec4 eye = gl_ModelViewMatrix * (instance * gl_Vertex);\n"
+            "  mat3 rotation = mat3(column0.xyz, column1.xyz, column2.xyz);\n"
+            "  position = eye.xyz;\n"
+            "  normal = gl_NormalMatrix * (rotation * gl_Normal);\n"
+            "  tint = color;\n"
+            "  gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+            "  gl_Position = gl_ProjectionMatrix * eye;\n"
+            "}\n";
+    }
+
+    // Ambient, diffuse and specular terms of light 0, like the fixed
+    // pipeline with the color as ambient and diffuse material and an
+    // infinite viewer.
+    static string FragmentShader() {
+        return
+            "varying vec3 position;\n"
+            "varying vec3 normal;\n"
+            "varying vec4 tint;\n"
+            "void main() {\n"
+            "  vec4 light = gl_LightSource[0].position;\n"
+            "  vec3 l = normalize(light.w == 0.0 ? light.xyz\n"
+            "                                    : light.xyz - position);\n"
+            "  vec3 n = normalize(normal);\n"
+            "  float diffuse = max(dot(n, l), 0.0);\n"
+            "  vec3 h = normalize(l + vec3(0.0, 0.0, 1.0));\n"
+            "  float specular = diffuse > 0.0\n"
+            "      ? pow(max(dot(n, h), 0.0), gl_FrontMaterial.shininess) : 0.0;\n"
+            "  vec3 c = gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb\n"
+            "         + gl_LightSource[0].diffuse.rgb * diffuse;\n"
+            "  gl_FragColor = vec4(tint.rgb * c + gl_FrontMaterial.specular.rgb\n"
+            "                      * gl_LightSource[0].specular.rgb * specular,\n"
+            "                      tint.a);\n"
+            "}\n";
+    }
+};
+
+#endif // _INSTANCED_MESH_NODE_H_
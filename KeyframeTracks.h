@@ -0,0 +1,188 @@
+// Keyframe animation of many transformation nodes in one pass.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _KEYFRAME_TRACKS_H_
+#define _KEYFRAME_TRACKS_H_
+
+#include "TransformCache.h"
+
+#include <Core/IEngine.h>
+#include <Core/IListener.h>
+#include <Logging/Logger.h>
+#include <Math/Vector.h>
+#include <Math/Quaternion.h>
+#include <Scene/TransformationNode.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace OpenEngine;
+using namespace OpenEngine::Core;
+using namespace OpenEngine::Math;
+using namespace OpenEngine::Scene;
+
+/**
+ * Position and rotation tracks for any number of nodes, updated by a
+ * single process event listener.
+ *
+ * The keys of all tracks live in shared structure-of-arrays storage
+ * (time, position xyz, quaternion wxyz), each track owning a
+ * contiguous range sorted by time. An update runs in three passes:
+ * find the current segment of every track (the cached cursor from the
+ * last frame is almost always right, otherwise binary search), blend
+ * all tracks at once with lerp/nlerp in a flat loop over the segment
+ * arrays, and finally write the results to the nodes.
+ *
+ * Time is the sum of the approx field of the process events, so the
+ * tracks follow the virtual clock of a FixedStepEngine. Tracks loop
+ * over their last key time unless looping is turned off. Written nodes
+ * are invalidated in the transform cache, if one is set.
+ */
+class KeyframeTracks : public IListener<ProcessEventArg> {
+public:
+    KeyframeTracks(bool loop = true) : loop(loop), time(0), cache(NULL) {}
+
+    void SetTransformCache(TransformCache* transforms) { cache = transforms; }
+
+    // New track driving target, returns its id.
+    unsigned int AddTrack(TransformationNode* target) {
+        Track t = { target, (unsigned int)times.size(), 0, 0 };
+        tracks.push_back(t);
+        return tracks.size() - 1;
+    }
+
+    // Keys must be added track by track in increasing time.
+    void AddKey(unsigned int track, unsigned long long usec,
+                const Vector<3,float>& position,
+                const Quaternion<float>& rotation) {
+        Track& t = tracks[track];
+        // ranges are contiguous, so only the last track can grow
+        if (t.first + t.count != times.size() || track + 1 != tracks.size()) {
+            logger.warning << "Keyframe added to track " << track
+                           << " after a later track was started" << logger.end;
+            return;
+        }
+        Vector<3,float> imaginary = rotation.GetImaginary();
+        times.push_back(usec / 1000000.0f);
+        px.push_back(position[0]);
+        py.push_back(position[1]);
+        pz.push_back(position[2]);
+        qw.push_back(rotation.GetReal());
+        qx.push_back(imaginary[0]);
+        qy.push_back(imaginary[1]);
+        qz.push_back(imaginary[2]);
+        t.count++;
+    }
+
+    // Key with the position and rotation of a node.
+    void AddKey(unsigned int track, unsigned long long usec,
+                TransformationNode& key) {
+        AddKey(track, usec, key.GetPosition(), key.GetRotation());
+    }
+
+    unsigned int GetTrackCount() const { return tracks.size(); }
+
+    void Handle(ProcessEventArg arg) {
+        time += arg.approx;
+        Update(time / 1000000.0);
+    }
+
+    // Evaluate all tracks at t seconds and update their nodes.
+    void Update(double t) {
+        const unsigned int n = tracks.size();
+        if (times.empty()) return;
+        from.resize(n);
+        to.resize(n);
+        blend.resize(n);
+        for (unsigned int i = 0; i < n; i++)
+            Locate(tracks[i], t, from[i], to[i], blend[i]);
+
+        ox.resize(n); oy.resize(n); oz.resize(n);
+        ow.resize(n); oqx.resize(n); oqy.resize(n); oqz.resize(n);
+        for (unsigned int i = 0; i < n; i++) {
+            const unsigned int a = from[i], b = to[i];
+            const float f = blend[i], g = 1.0f - f;
+            ox[i] = px[a] * g + px[b] * f;
+            oy[i] = py[a] * g + py[b] * f;
+            oz[i] = pz[a] * g + pz[b] * f;
+            // nlerp along the shorter arc
+            float d = qw[a] * qw[b] + qx[a] * qx[b] + qy[a] * qy[b] + qz[a] * qz[b];
+            float s = d < 0.0f ? -f : f;
+            float w = qw[a] * g + qw[b] * s;
+            float x = qx[a] * g + qx[b] * s;
+            float y = qy[a] * g + qy[b] * s;
+            float z = qz[a] * g + qz[b] * s;
+            float len = 1.0f / std::sqrt(w * w + x * x + y * y + z * z);
+            ow[i] = w * len; oqx[i] = x * len; oqy[i] = y * len; oqz[i] = z * len;
+        }
+
+        for (unsigned int i = 0; i < n; i++) {
+            if (tracks[i].count == 0) continue;
+            tracks[i].target->SetPosition(Vector<3,float>(ox[i], oy[i], oz[i]));
+            tracks[i].target->SetRotation(
+                Quaternion<float>(ow[i], Vector<3,float>(oqx[i], oqy[i], oqz[i])));
+            if (cache) cache->Invalidate(tracks[i].target);
+        }
+    }
+
+private:
+    struct Track {
+        TransformationNode* target;
+        unsigned int first, count;
+        unsigned int cursor;    // segment of the last update, 0-based
+    };
+
+    bool loop;
+    unsigned long long time;
+    TransformCache* cache;
+    std::vector<Track> tracks;
+    // keys of all tracks
+    std::vector<float> times, px, py, pz, qw, qx, qy, qz;
+    // per track results of the passes
+    std::vector<unsigned int> from, to;
+    std::vector<float> blend;
+    std::vector<float> ox, oy, oz, ow, oqx, oqy, oqz;
+
+    // Keys a and b around t and the blend factor between them.
+    // Tracks with one key blend it with itself; empty tracks point at
+    // the first key and are not written.
+    void Locate(Track& track, double t, unsigned int& a, unsigned int& b,
+                float& f) {
+        f = 0.0f;
+        if (track.count < 2) {
+            a = b = track.count ? track.first : 0;
+            return;
+        }
+        const float* keys = &times[track.first];
+        const float start = keys[0], end = keys[track.count - 1];
+        float local = start;
+        if (end > start) {
+            local = (float)(loop ? start + std::fmod(t - start, (double)end - start) : t);
+            local = std::max(start, std::min(end, local));
+        }
+
+        unsigned int c = track.cursor;
+        if (!(keys[c] <= local && local <= keys[c + 1])) {
+            if (c + 2 < track.count && keys[c + 1] <= local && local <= keys[c + 2])
+                c++;
+            else {
+                c = std::upper_bound(keys, keys + track.count, local) - keys;
+                c = c == 0 ? 0 : std::min(c - 1, track.count - 2);
+            }
+            track.cursor = c;
+        }
+        a = track.first + c;
+        b = a + 1;
+        float span = keys[c + 1] - keys[c];
+        if (span > 0.0f) f = (local - keys[c]) / span;
+    }
+};
+
+#endif // _KEYFRAME_TRACKS_H_
@@ -0,0 +1,109 @@
+// Post processing effect constructed on first use.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _LAZY_EFFECT_H_
+#define _LAZY_EFFECT_H_
+
+#include "Tracer.h"
+
+#include <Core/IEngine.h>
+#include <Display/Viewport.h>
+#include <Logging/Logger.h>
+#include <Renderers/OpenGL/PostProcessingEffect.h>
+
+#include <string>
+#include <vector>
+
+using namespace OpenEngine;
+using namespace OpenEngine::Core;
+using namespace OpenEngine::Display;
+using namespace OpenEngine::Renderers::OpenGL;
+using std::string;
+
+/**
+ * Cheap stand-in for a post processing effect.
+ *
+ * Only the name and a factory are kept until the effect is enabled
+ * the first time (normally by EffectHandler). Enabling only records
+ * the request; the real effect is constructed and set up on the next
+ * process event, outside of the key handler. The stand-in listens
+ * after the renderer, so that frame is still drawn without the effect,
+ * and from the frame after on all calls are forwarded to it. Until
+ * then the stand-in is a pass-through, and effects added to it are
+ * handed on once it exists. Without a factory the object is only
+ * an on/off switch, used for effects implemented as screen stages.
+ */
+class LazyEffect : public IPostProcessingEffect
+                 , public IListener<ProcessEventArg> {
+public:
+    typedef PostProcessingEffect* (*Factory)(Viewport*, IEngine&);
+
+    LazyEffect(const string& name, Factory factory,
+               Viewport* viewport, IEngine& engine)
+        : name(name), factory(factory), viewport(viewport), engine(engine)
+        , effect(NULL), enabled(false) {
+        if (factory) Traced(engine.ProcessEvent(), "process").Attach(*this);
+    }
+
+    const string& GetName() const { return name; }
+    PostProcessingEffect* GetEffect() { return effect; }
+
+    void Enable(bool enable) {
+        enabled = enable;
+        if (effect) effect->Enable(enable);
+    }
+
+    bool GetEnabled() { return enabled; }
+
+    void PreRender() {
+        if (effect) effect->PreRender();
+    }
+
+    void PostRender() {
+        if (effect) effect->PostRender();
+    }
+
+    void Add(IPostProcessingEffect* ppe) {
+        if (effect) effect->Add(ppe);
+        else children.push_back(ppe);
+    }
+
+    void Handle(ProcessEventArg arg) {
+        if (enabled && effect == NULL) Instantiate();
+    }
+
+private:
+    string name;
+    Factory factory;
+    Viewport* viewport;
+    IEngine& engine;
+    PostProcessingEffect* effect;
+    bool enabled;
+    std::vector<IPostProcessingEffect*> children;
+
+    void Instantiate() {
+        logger.info << "Loading effect: " << name << logger.end;
+        effect = factory(viewport, engine);
+        // the engine has already been initialized, so run the setup
+        // that would otherwise have happened on InitializeEvent
+        effect->Handle(InitializeEventArg());
+        for (unsigned int i = 0; i < children.size(); i++)
+            effect->Add(children[i]);
+        children.clear();
+        effect->Enable(enabled);
+    }
+};
+
+// Factory for LazyEffect, e.g. LazyEffect::Factory f = &Construct<Glow>;
+template <class T>
+PostProcessingEffect* Construct(Viewport* viewport, IEngine& engine) {
+    return new T(viewport, engine);
+}
+
+#endif // _LAZY_EFFECT_H_
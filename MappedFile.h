@@ -0,0 +1,90 @@
+// Read only memory mapping of a whole file.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using std::string;
+
+/**
+ * Maps a file into memory for reading (mmap, or a file mapping on
+ * Windows), so a parser can walk the bytes without copying them
+ * through read buffers. The data is not NUL terminated. Empty and
+ * missing files give IsOpen() false.
+ */
+class MappedFile {
+public:
+    MappedFile(const string& path) : data(NULL), size(0) {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        mapping = NULL;
+        if (file == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER length;
+        if (!GetFileSizeEx(file, &length) || length.QuadPart == 0) return;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping == NULL) return;
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view == NULL) return;
+        data = (const char*)view;
+        size = (size_t)length.QuadPart;
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* view = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED) {
+                madvise(view, info.st_size, MADV_SEQUENTIAL);
+                data = (const char*)view;
+                size = info.st_size;
+            }
+        }
+        // the mapping stays valid without the descriptor
+        close(fd);
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        if (data) munmap((void*)data, size);
+#endif
+    }
+
+    bool IsOpen() const { return data != NULL; }
+    const char* GetData() const { return data; }
+    size_t GetSize() const { return size; }
+
+private:
+    const char* data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file, mapping;
+#endif
+
+    // not copyable
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+#endif // _MAPPED_FILE_H_
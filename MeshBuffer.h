@@ -0,0 +1,130 @@
+// Retained indexed triangle mesh stored in GPU buffer objects.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _MESH_BUFFER_H_
+#define _MESH_BUFFER_H_
+
+#include <Meta/OpenGL.h>
+#include <vector>
+#include <cstddef>
+
+// Interleaved vertex layout shared by all retained meshes.
+struct MeshVertex {
+    float position[3];
+    float normal[3];
+    float texcoord[2];
+};
+
+/**
+ * Indexed triangle list with interleaved position/normal/texcoord
+ * vertices.
+ *
+ * The data is built on the CPU and uploaded to vertex and index
+ * buffer objects the first time the mesh is drawn (a GL context is
+ * not needed before that). Without buffer object support the mesh
+ * is drawn from client side arrays instead.
+ */
+class MeshBuffer {
+public:
+    // Takes over the contents of the given vectors.
+    MeshBuffer(std::vector<MeshVertex>& verts,
+               std::vector<GLuint>& inds)
+        : vbo(0), ibo(0), count(inds.size()), uploaded(false) {
+        vertices.swap(verts);
+        indices.swap(inds);
+    }
+
+    ~MeshBuffer() {
+        if (vbo) glDeleteBuffers(1, &vbo);
+        if (ibo) glDeleteBuffers(1, &ibo);
+    }
+
+    unsigned int GetIndexCount() const { return count; }
+
+    // Bind the vertex arrays. Must be matched by Unbind().
+    void Bind() {
+        if (!uploaded) Upload();
+        const char* base = NULL;
+        if (vbo) {
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        }
+        else base = (const char*)&vertices[0];
+
+        glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex),
+                        base + offsetof(MeshVertex, position));
+        glNormalPointer(GL_FLOAT, sizeof(MeshVertex),
+                        base + offsetof(MeshVertex, normal));
+        glTexCoordPointer(2, GL_FLOAT, sizeof(MeshVertex),
+                          base + offsetof(MeshVertex, texcoord));
+    }
+
+    void Unbind() {
+        glPopClientAttrib();
+        if (vbo) {
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        }
+    }
+
+    // Issue the indexed draw call. The mesh must be bound.
+    void DrawElements() {
+        const GLvoid* offset = vbo ? NULL : (const GLvoid*)&indices[0];
+        glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, offset);
+    }
+
+    // One draw of the mesh per instance (ARB_draw_instanced). The
+    // mesh must be bound.
+    void DrawElementsInstanced(GLsizei instances) {
+        const GLvoid* offset = vbo ? NULL : (const GLvoid*)&indices[0];
+        glDrawElementsInstancedARB(GL_TRIANGLES, count, GL_UNSIGNED_INT,
+                                   offset, instances);
+    }
+
+    void Draw() {
+        if (count == 0) return;
+        Bind();
+        DrawElements();
+        Unbind();
+    }
+
+private:
+    std::vector<MeshVertex> vertices;
+    std::vector<GLuint> indices;
+    GLuint vbo, ibo;
+    unsigned int count;
+    bool uploaded;
+
+    void Upload() {
+        uploaded = true;
+        if (!GLEW_VERSION_1_5 || count == 0) return;
+
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(MeshVertex),
+                     &vertices[0], GL_STATIC_DRAW);
+        glGenBuffers(1, &ibo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+                     &indices[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        CHECK_FOR_GL_ERROR();
+
+        // the GPU copy is authoritative from now on
+        std::vector<MeshVertex>().swap(vertices);
+        std::vector<GLuint>().swap(indices);
+    }
+};
+
+#endif // _MESH_BUFFER_H_
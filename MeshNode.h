@@ -0,0 +1,59 @@
+// Render node drawing a model once it has finished loading.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _MESH_NODE_H_
+#define _MESH_NODE_H_
+
+#include "Bounds.h"
+#include "ModelLoader.h"
+#include "StreamingTextureLoader.h"
+
+#include <Scene/RenderNode.h>
+#include <Renderers/IRenderingView.h>
+#include <Meta/OpenGL.h>
+
+using namespace OpenEngine;
+
+/**
+ * Draws the mesh of a model handle. Until the load is done the node
+ * draws nothing and has empty bounds, so the scene can be shown while
+ * models are still being parsed. A streamed texture is used as soon
+ * as its coarsest level has arrived.
+ */
+class MeshNode : public Scene::RenderNode, public IBounded {
+public:
+    MeshNode(ModelHandle* model) : model(model), texture(NULL) {}
+
+    void SetTexture(StreamedTexture* texture) { this->texture = texture; }
+
+    void Apply(Renderers::IRenderingView* view) {
+        MeshBuffer* mesh = model->GetMesh();
+        if (mesh == NULL) return;
+        glPushAttrib(GL_ENABLE_BIT);
+        glEnable(GL_NORMALIZE);
+        GLuint id = texture != NULL ? texture->GetTexture() : 0;
+        if (id) {
+            glEnable(GL_TEXTURE_2D);
+            glBindTexture(GL_TEXTURE_2D, id);
+        }
+        mesh->Draw();
+        if (id) glBindTexture(GL_TEXTURE_2D, 0);
+        glPopAttrib();
+    }
+
+    BoundingSphere GetBounds() const { return model->GetBounds(); }
+
+    bool IsLoaded() { return model->IsReady(); }
+
+private:
+    ModelHandle* model;
+    StreamedTexture* texture;
+};
+
+#endif // _MESH_NODE_H_
@@ -0,0 +1,239 @@
+// Background loading of OBJ meshes with a binary cache.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _MODEL_LOADER_H_
+#define _MODEL_LOADER_H_
+
+#include "Atomic.h"
+#include "Bounds.h"
+#include "MappedFile.h"
+#include "MeshBuffer.h"
+#include "ObjParser.h"
+#include "ThreadPool.h"
+#include "TileScheduler.h"
+
+#include <Core/IEngine.h>
+#include <Core/IListener.h>
+#include <Logging/Logger.h>
+#include <Utils/Timer.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+using namespace OpenEngine;
+using namespace OpenEngine::Core;
+using std::string;
+
+/**
+ * Result of an asynchronous model load.
+ *
+ * The loader thread fills in the vertices and publishes the state
+ * with an atomic store; the render thread polls IsDone() and, once
+ * the load succeeded, turns the data into a MeshBuffer with
+ * GetMesh(). Handles belong to the ModelLoader.
+ */
+class ModelHandle {
+public:
+    enum State { LOADING, READY, FAILED };
+
+    ModelHandle(const string& path) : path(path), state(LOADING), mesh(NULL) {}
+    ~ModelHandle() { delete mesh; }
+
+    const string& GetPath() const { return path; }
+    State GetState() { return (State)Atomic::Load(&state); }
+    bool IsDone() { return GetState() != LOADING; }
+    bool IsReady() { return GetState() == READY; }
+
+    // NULL unless the load succeeded. Render thread only.
+    MeshBuffer* GetMesh() {
+        if (mesh == NULL && IsReady()) mesh = new MeshBuffer(vertices, indices);
+        return mesh;
+    }
+
+    // Empty until ready.
+    BoundingSphere GetBounds() {
+        if (IsReady()) return bounds;
+        BoundingSphere none = { {0.0f, 0.0f, 0.0f}, 0.0f };
+        return none;
+    }
+
+private:
+    friend class ModelLoader;
+
+    string path;
+    volatile int state;
+    std::vector<MeshVertex> vertices;
+    std::vector<GLuint> indices;
+    BoundingSphere bounds;
+    MeshBuffer* mesh;
+};
+
+/**
+ * Loads OBJ models on a thread pool, returning a handle at once.
+ *
+ * A load first looks for a binary cache next to the source (the path
+ * with ".mesh" appended) that matches the size and modification time
+ * of the source; it is memory mapped and copied straight into the
+ * vertex and index arrays. Otherwise the source is memory mapped and
+ * parsed with ObjParser, chunks spread over all cores, and the cache
+ * is written for the next run. A cache that can not be written only
+ * costs the speed up.
+ *
+ * The pool is finished on the deinitialize event, or when the loader
+ * is deleted; loads still queued then are completed first.
+ */
+class ModelLoader : public IListener<DeinitializeEventArg> {
+public:
+    // threads loading models at the same time, each parses in parallel
+    ModelLoader(unsigned int threads = 1) : pool(threads) {}
+
+    ~ModelLoader() {
+        pool.Finish();
+        for (unsigned int i = 0; i < handles.size(); i++)
+            delete handles[i];
+    }
+
+    ModelHandle* Load(const string& path) {
+        ModelHandle* handle = new ModelHandle(path);
+        handles.push_back(handle);
+        pool.Add(new LoadJob(*handle));
+        return handle;
+    }
+
+    void Handle(DeinitializeEventArg arg) { pool.Finish(); }
+
+private:
+    // Cache file layout: header, vertices, indices.
+    struct CacheHeader {
+        char magic[8];
+        unsigned int vertexSize, vertexCount, indexCount, reserved;
+        unsigned long long sourceSize, sourceTime;
+    };
+
+    class LoadJob : public IJob {
+    public:
+        LoadJob(ModelHandle& handle) : handle(handle) {}
+        void Run() { Load(handle); }
+    private:
+        ModelHandle& handle;
+    };
+
+    ThreadPool pool;
+    std::vector<ModelHandle*> handles;
+
+    static void Load(ModelHandle& handle) {
+        unsigned long long start = Utils::Timer::GetTime().AsInt();
+        const string& path = handle.path;
+        string cache = path + ".mesh";
+        CacheHeader header;
+        bool ok = false, cached = false;
+        if (Describe(path, header)) {
+            cached = ReadCache(cache, header, handle.vertices, handle.indices);
+            if (!cached) {
+                MappedFile file(path);
+                TileScheduler scheduler;
+                ObjParser parser(scheduler);
+                ok = file.IsOpen() &&
+                    parser.Parse(file.GetData(), file.GetSize(),
+                                 handle.vertices, handle.indices);
+                if (ok && !WriteCache(cache, header, handle.vertices, handle.indices))
+                    logger.warning << "Can not write mesh cache '" << cache
+                                   << "'" << logger.end;
+            }
+            ok = ok || cached;
+        }
+        if (!ok) {
+            logger.error << "Can not load model '" << path << "'" << logger.end;
+            Atomic::Store(&handle.state, ModelHandle::FAILED);
+            return;
+        }
+        handle.bounds = Bounds(handle.vertices);
+        unsigned long long elapsed = Utils::Timer::GetTime().AsInt() - start;
+        logger.info << "Loaded '" << path << "': " << handle.vertices.size()
+                    << " vertices, " << handle.indices.size() / 3
+                    << " triangles in " << elapsed / 1000 << " ms"
+                    << (cached ? " from the cache" : " parsed") << logger.end;
+        Atomic::Store(&handle.state, ModelHandle::READY);
+    }
+
+    // Fills in the header for the source file, false if it is missing.
+    static bool Describe(const string& path, CacheHeader& header) {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) return false;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, "OEMESH1", 8);
+        header.vertexSize = sizeof(MeshVertex);
+        header.sourceSize = info.st_size;
+        header.sourceTime = info.st_mtime;
+        return true;
+    }
+
+    static bool ReadCache(const string& path, const CacheHeader& expected,
+                          std::vector<MeshVertex>& vertices,
+                          std::vector<GLuint>& indices) {
+        MappedFile file(path);
+        if (!file.IsOpen() || file.GetSize() < sizeof(CacheHeader)) return false;
+        CacheHeader header;
+        std::memcpy(&header, file.GetData(), sizeof(header));
+        if (std::memcmp(header.magic, expected.magic, 8) != 0 ||
+            header.vertexSize != expected.vertexSize ||
+            header.sourceSize != expected.sourceSize ||
+            header.sourceTime != expected.sourceTime)
+            return false;
+        size_t vertexBytes = (size_t)header.vertexCount * sizeof(MeshVertex);
+        size_t indexBytes = (size_t)header.indexCount * sizeof(GLuint);
+        if (file.GetSize() != sizeof(header) + vertexBytes + indexBytes ||
+            header.indexCount == 0)
+            return false;
+        const char* data = file.GetData() + sizeof(header);
+        vertices.resize(header.vertexCount);
+        indices.resize(header.indexCount);
+        std::memcpy(&vertices[0], data, vertexBytes);
+        std::memcpy(&indices[0], data + vertexBytes, indexBytes);
+        return true;
+    }
+
+    // Written under a temporary name and renamed, so an interrupted
+    // write never leaves a cache that looks valid.
+    static bool WriteCache(const string& path, CacheHeader header,
+                           const std::vector<MeshVertex>& vertices,
+                           const std::vector<GLuint>& indices) {
+        header.vertexCount = vertices.size();
+        header.indexCount = indices.size();
+        string temp = path + ".tmp";
+        FILE* out = fopen(temp.c_str(), "wb");
+        if (out == NULL) return false;
+        bool ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+            fwrite(&vertices[0], sizeof(MeshVertex), vertices.size(), out) == vertices.size() &&
+            fwrite(&indices[0], sizeof(GLuint), indices.size(), out) == indices.size();
+        ok = fclose(out) == 0 && ok;
+#ifdef _WIN32
+        if (ok) remove(path.c_str());
+#endif
+        if (ok) ok = rename(temp.c_str(), path.c_str()) == 0;
+        if (!ok) remove(temp.c_str());
+        return ok;
+    }
+
+    static BoundingSphere Bounds(const std::vector<MeshVertex>& vertices) {
+        BoundingBox box;
+        box.Clear();
+        for (unsigned int i = 0; i < vertices.size(); i++) {
+            const float* p = vertices[i].position;
+            BoundingSphere point = { { p[0], p[1], p[2] }, 0.0f };
+            box.Add(point);
+        }
+        return box.GetSphere();
+    }
+};
+
+#endif // _MODEL_LOADER_H_
@@ -0,0 +1,292 @@
+// Parallel Wavefront OBJ parser over a block of memory.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _OBJ_PARSER_H_
+#define _OBJ_PARSER_H_
+
+#include "MeshBuffer.h"
+#include "TileScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Turns the geometry of an OBJ file into an indexed MeshVertex list.
+ *
+ * The text is cut into chunks at line breaks and the chunks are
+ * tokenized in parallel on a TileScheduler, each into its own arrays
+ * of positions, normals, texture coordinates and face corners. Faces
+ * keep the raw OBJ indices together with how many elements their
+ * chunk had read so far, which is all a negative (relative) index
+ * needs once the chunk offsets are known. A serial pass then
+ * concatenates the arrays, resolves the indices, shares vertices with
+ * the same position/texcoord/normal triple and fans polygons into
+ * triangles. Vertices without a normal get the area weighted normal
+ * of their faces.
+ *
+ * Only v, vt, vn and f are read; groups, materials and smoothing
+ * groups are ignored. Numbers are parsed by hand, as the mapped data
+ * is not NUL terminated.
+ */
+class ObjParser {
+public:
+    ObjParser(TileScheduler& scheduler) : scheduler(scheduler), chunkCount(0) {}
+
+    // False if the data holds no faces.
+    bool Parse(const char* data, size_t size,
+               std::vector<MeshVertex>& vertices, std::vector<GLuint>& indices) {
+        const size_t CHUNK = 1 << 20;
+        std::vector<Chunk> chunks;
+        size_t begin = 0;
+        while (begin < size) {
+            size_t end = std::min(size, begin + CHUNK);
+            while (end < size && data[end - 1] != '\n') end++;
+            Chunk c;
+            c.begin = data + begin;
+            c.end = data + end;
+            chunks.push_back(c);
+            begin = end;
+        }
+        chunkCount = chunks.size();
+        Tokenizer tokenizer(chunks);
+        scheduler.Run(tokenizer, chunks.size(), 1, 1);
+        Assemble(chunks, vertices, indices);
+        return !indices.empty();
+    }
+
+    unsigned int GetChunkCount() const { return chunkCount; }
+
+private:
+    struct Face {
+        unsigned int first, size;       // range of corners
+        int positions, texcoords, normals;  // read by the chunk so far
+    };
+
+    struct Chunk {
+        const char *begin, *end;
+        std::vector<float> positions, texcoords, normals;
+        std::vector<int> corners;       // raw v, vt, vn, 0 if missing
+        std::vector<Face> faces;
+    };
+
+    class Tokenizer : public ITileKernel {
+    public:
+        Tokenizer(std::vector<Chunk>& chunks) : chunks(chunks) {}
+        void Run(int x0, int y0, int x1, int y1) {
+            for (int i = x0; i < x1; i++) Tokenize(chunks[i]);
+        }
+    private:
+        std::vector<Chunk>& chunks;
+    };
+
+    TileScheduler& scheduler;
+    unsigned int chunkCount;
+
+    static bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    static void SkipSpace(const char*& p, const char* end) {
+        while (p < end && IsSpace(*p)) p++;
+    }
+
+    static float ParseFloat(const char*& p, const char* end) {
+        SkipSpace(p, end);
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+        double value = 0.0;
+        while (p < end && *p >= '0' && *p <= '9') value = value * 10.0 + (*p++ - '0');
+        if (p < end && *p == '.') {
+            p++;
+            double scale = 0.1;
+            while (p < end && *p >= '0' && *p <= '9') {
+                value += (*p++ - '0') * scale;
+                scale *= 0.1;
+            }
+        }
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            p++;
+            bool negExp = false;
+            if (p < end && (*p == '-' || *p == '+')) negExp = *p++ == '-';
+            int exponent = 0;
+            while (p < end && *p >= '0' && *p <= '9') exponent = exponent * 10 + (*p++ - '0');
+            value *= std::pow(10.0, negExp ? -exponent : exponent);
+        }
+        return (float)(negative ? -value : value);
+    }
+
+    static int ParseInt(const char*& p, const char* end) {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+        int value = 0;
+        while (p < end && *p >= '0' && *p <= '9') value = value * 10 + (*p++ - '0');
+        return negative ? -value : value;
+    }
+
+    static void Tokenize(Chunk& c) {
+        const char* p = c.begin;
+        const char* end = c.end;
+        while (p < end) {
+            SkipSpace(p, end);
+            if (p + 1 < end && p[0] == 'v' && IsSpace(p[1])) {
+                p++;
+                for (int i = 0; i < 3; i++) c.positions.push_back(ParseFloat(p, end));
+            }
+            else if (p + 2 < end && p[0] == 'v' && p[1] == 'n' && IsSpace(p[2])) {
+                p += 2;
+                for (int i = 0; i < 3; i++) c.normals.push_back(ParseFloat(p, end));
+            }
+            else if (p + 2 < end && p[0] == 'v' && p[1] == 't' && IsSpace(p[2])) {
+                p += 2;
+                for (int i = 0; i < 2; i++) c.texcoords.push_back(ParseFloat(p, end));
+            }
+            else if (p + 1 < end && p[0] == 'f' && IsSpace(p[1])) {
+                p++;
+                Face f = { (unsigned int)c.corners.size() / 3, 0,
+                           (int)c.positions.size() / 3,
+                           (int)c.texcoords.size() / 2,
+                           (int)c.normals.size() / 3 };
+                for (;;) {
+                    SkipSpace(p, end);
+                    if (p >= end || *p == '\n' || *p == '#') break;
+                    // v, v/vt, v//vn or v/vt/vn
+                    int v = ParseInt(p, end), t = 0, n = 0;
+                    if (p < end && *p == '/') {
+                        p++;
+                        if (p < end && *p != '/') t = ParseInt(p, end);
+                        if (p < end && *p == '/') {
+                            p++;
+                            n = ParseInt(p, end);
+                        }
+                    }
+                    if (v == 0) break;  // malformed, drop the rest
+                    c.corners.push_back(v);
+                    c.corners.push_back(t);
+                    c.corners.push_back(n);
+                    f.size++;
+                    while (p < end && !IsSpace(*p) && *p != '\n') p++;
+                }
+                if (f.size >= 3) c.faces.push_back(f);
+                else c.corners.resize(3 * f.first);
+            }
+            // skip whatever is left of the line
+            while (p < end && *p != '\n') p++;
+            p++;
+        }
+    }
+
+    // 0-based index of a raw OBJ index, -1 if missing or out of range.
+    static int Resolve(int raw, int offset, int seen, int count) {
+        int i = raw > 0 ? raw - 1 : raw < 0 ? offset + seen + raw : -1;
+        return i >= 0 && i < count ? i : -1;
+    }
+
+    static void Assemble(std::vector<Chunk>& chunks,
+                         std::vector<MeshVertex>& vertices,
+                         std::vector<GLuint>& indices) {
+        std::vector<float> positions, texcoords, normals;
+        std::vector<int> offsets(3 * chunks.size());
+        for (unsigned int i = 0; i < chunks.size(); i++) {
+            offsets[3 * i] = positions.size() / 3;
+            offsets[3 * i + 1] = texcoords.size() / 2;
+            offsets[3 * i + 2] = normals.size() / 3;
+            positions.insert(positions.end(), chunks[i].positions.begin(),
+                             chunks[i].positions.end());
+            texcoords.insert(texcoords.end(), chunks[i].texcoords.begin(),
+                             chunks[i].texcoords.end());
+            normals.insert(normals.end(), chunks[i].normals.begin(),
+                           chunks[i].normals.end());
+            std::vector<float>().swap(chunks[i].positions);
+            std::vector<float>().swap(chunks[i].texcoords);
+            std::vector<float>().swap(chunks[i].normals);
+        }
+        const int positionCount = positions.size() / 3;
+        const int texcoordCount = texcoords.size() / 2;
+        const int normalCount = normals.size() / 3;
+
+        // vertices sharing a position are chained, so finding an
+        // existing vertex only looks at the few with that position
+        std::vector<int> first(positionCount, -1);
+        std::vector<int> next, keys;    // keys: texcoord, normal
+        std::vector<unsigned char> computed;
+        std::vector<GLuint> polygon;
+        vertices.clear();
+        indices.clear();
+        for (unsigned int i = 0; i < chunks.size(); i++) {
+            const Chunk& c = chunks[i];
+            const int* o = &offsets[3 * i];
+            for (unsigned int f = 0; f < c.faces.size(); f++) {
+                const Face& face = c.faces[f];
+                polygon.clear();
+                for (unsigned int k = 0; k < face.size; k++) {
+                    const int* raw = &c.corners[3 * (face.first + k)];
+                    int v = Resolve(raw[0], o[0], face.positions, positionCount);
+                    int t = Resolve(raw[1], o[1], face.texcoords, texcoordCount);
+                    int n = Resolve(raw[2], o[2], face.normals, normalCount);
+                    if (v < 0) break;
+                    int index = first[v];
+                    while (index >= 0 && (keys[2 * index] != t || keys[2 * index + 1] != n))
+                        index = next[index];
+                    if (index < 0) {
+                        index = vertices.size();
+                        MeshVertex vertex;
+                        for (int j = 0; j < 3; j++) {
+                            vertex.position[j] = positions[3 * v + j];
+                            vertex.normal[j] = n >= 0 ? normals[3 * n + j] : 0.0f;
+                        }
+                        vertex.texcoord[0] = t >= 0 ? texcoords[2 * t] : 0.0f;
+                        vertex.texcoord[1] = t >= 0 ? texcoords[2 * t + 1] : 0.0f;
+                        vertices.push_back(vertex);
+                        keys.push_back(t);
+                        keys.push_back(n);
+                        next.push_back(first[v]);
+                        computed.push_back(n < 0);
+                        first[v] = index;
+                    }
+                    polygon.push_back(index);
+                }
+                if (polygon.size() != face.size) continue;
+                for (unsigned int k = 2; k < polygon.size(); k++) {
+                    indices.push_back(polygon[0]);
+                    indices.push_back(polygon[k - 1]);
+                    indices.push_back(polygon[k]);
+                }
+            }
+        }
+
+        // area weighted face normals for vertices that had none
+        for (unsigned int i = 0; i + 2 < indices.size(); i += 3) {
+            MeshVertex* t[3] = { &vertices[indices[i]], &vertices[indices[i + 1]],
+                                 &vertices[indices[i + 2]] };
+            if (!computed[indices[i]] && !computed[indices[i + 1]] &&
+                !computed[indices[i + 2]])
+                continue;
+            float a[3], b[3], n[3];
+            for (int j = 0; j < 3; j++) {
+                a[j] = t[1]->position[j] - t[0]->position[j];
+                b[j] = t[2]->position[j] - t[0]->position[j];
+            }
+            n[0] = a[1] * b[2] - a[2] * b[1];
+            n[1] = a[2] * b[0] - a[0] * b[2];
+            n[2] = a[0] * b[1] - a[1] * b[0];
+            for (int k = 0; k < 3; k++)
+                if (computed[indices[i + k]])
+                    for (int j = 0; j < 3; j++) t[k]->normal[j] += n[j];
+        }
+        for (unsigned int i = 0; i < vertices.size(); i++) {
+            if (!computed[i]) continue;
+            float* n = vertices[i].normal;
+            float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (length > 0.0f)
+                for (int j = 0; j < 3; j++) n[j] /= length;
+        }
+    }
+};
+
+#endif // _OBJ_PARSER_H_
@@ -0,0 +1,151 @@
+// Checks of the parallel OBJ parser.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "ObjParser.h"
+#include "TestCheck.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+using std::string;
+
+static bool Near(float a, float b) {
+    return std::fabs(a - b) < 1e-5f;
+}
+
+static bool Parse(const string& text, std::vector<MeshVertex>& vertices,
+                  std::vector<GLuint>& indices, unsigned int threads = 2) {
+    TileScheduler scheduler(threads);
+    ObjParser parser(scheduler);
+    return parser.Parse(text.data(), text.size(), vertices, indices);
+}
+
+static void TestTriangle() {
+    std::vector<MeshVertex> vertices;
+    std::vector<GLuint> indices;
+    // no normals given, so they are computed from the face
+    CHECK(Parse("# a triangle\n"
+                "v 0 0 0\n"
+                "v 1.5e0 0 0\r\n"
+                "v 0 2. -0\n"
+                "f 1 2 3\n", vertices, indices));
+    CHECK(vertices.size() == 3);
+    CHECK(indices.size() == 3);
+    if (vertices.size() != 3) return;
+    CHECK(Near(vertices[1].position[0], 1.5f));
+    CHECK(Near(vertices[2].position[1], 2.0f));
+    for (int i = 0; i < 3; i++) {
+        CHECK(Near(vertices[i].normal[0], 0.0f));
+        CHECK(Near(vertices[i].normal[1], 0.0f));
+        CHECK(Near(vertices[i].normal[2], 1.0f));
+    }
+}
+
+static void TestCorners() {
+    std::vector<MeshVertex> vertices;
+    std::vector<GLuint> indices;
+    // a quad is fanned, corners with the same triple are shared and
+    // a different normal on a position makes a vertex of its own
+    CHECK(Parse("v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+                "vt 0.25 0.75\n"
+                "vn 0 0 1\nvn 0 0 -1\n"
+                "f 1/1/1 2/1/1 3/1/1 4/1/1\n"
+                "f 1//2 3//2 2//2\n"
+                "f 1/1/1 3/1/1 4/1/1\n", vertices, indices));
+    CHECK(indices.size() == 12);
+    CHECK(vertices.size() == 7);
+    if (indices.size() != 12 || vertices.size() != 7) return;
+    const GLuint fan[6] = { 0, 1, 2, 0, 2, 3 };
+    for (int i = 0; i < 6; i++) CHECK(indices[i] == fan[i]);
+    CHECK(indices[9] == 0 && indices[10] == 2 && indices[11] == 3);
+    CHECK(Near(vertices[0].texcoord[0], 0.25f));
+    CHECK(Near(vertices[0].texcoord[1], 0.75f));
+    CHECK(Near(vertices[4].normal[2], -1.0f));
+    CHECK(Near(vertices[4].texcoord[0], 0.0f));
+}
+
+static void TestRelative() {
+    std::vector<MeshVertex> vertices;
+    std::vector<GLuint> indices;
+    CHECK(Parse("v 0 0 0\nv 1 0 0\nv 0 1 0\nf -3 -2 -1\n"
+                "v 5 5 5\nf -4 -1 -2\n", vertices, indices));
+    CHECK(indices.size() == 6);
+    CHECK(vertices.size() == 4);
+    if (vertices.size() == 4) CHECK(Near(vertices[3].position[0], 5.0f));
+}
+
+static void TestMalformed() {
+    std::vector<MeshVertex> vertices;
+    std::vector<GLuint> indices;
+    // out of range, too few corners and unknown statements are
+    // dropped; the good face stays
+    CHECK(Parse("o name\nmtllib x.mtl\nv 0 0 0\nv 1 0 0\nv 0 1 0\n"
+                "f 1 2 9\n"
+                "f 1 2\n"
+                "f 1 x 3\n"
+                "usemtl red\ns 1\n"
+                "f 1 2 3 # comment\n", vertices, indices));
+    CHECK(indices.size() == 3);
+
+    CHECK(!Parse("v 0 0 0\nv 1 0 0\n", vertices, indices));
+    CHECK(indices.empty());
+    CHECK(!Parse("", vertices, indices));
+}
+
+// Enough text for several chunks, each triangle with three vertices
+// of its own referenced relatively, so the offsets of the chunks have
+// to be right for every face to find its vertices.
+static void TestChunks() {
+    const int TRIANGLES = 40000;
+    string text;
+    char line[128];
+    for (int i = 0; i < TRIANGLES; i++) {
+        for (int k = 0; k < 3; k++) {
+            snprintf(line, sizeof(line), "v %d.0000000 %d.0000000 %d.0000000\n",
+                     i, k, i % 7);
+            text += line;
+        }
+        text += i % 2 ? "f -3 -2 -1\n" : "f -3/-1/-1 -2 -1\n";
+    }
+    std::vector<MeshVertex> vertices;
+    std::vector<GLuint> indices;
+    TileScheduler scheduler(4);
+    ObjParser parser(scheduler);
+    CHECK(parser.Parse(text.data(), text.size(), vertices, indices));
+    CHECK(parser.GetChunkCount() > 2);
+    CHECK(vertices.size() == 3 * TRIANGLES);
+    CHECK(indices.size() == 3 * TRIANGLES);
+    if (indices.size() != 3 * TRIANGLES) return;
+    bool placed = true;
+    for (int i = 0; i < TRIANGLES; i++)
+        for (int k = 0; k < 3; k++) {
+            const float* p = vertices[indices[3 * i + k]].position;
+            placed = placed && p[0] == i && p[1] == k && p[2] == i % 7;
+        }
+    CHECK(placed);
+
+    // the same without threads
+    std::vector<MeshVertex> serial;
+    std::vector<GLuint> serialIndices;
+    CHECK(Parse(text, serial, serialIndices, 1));
+    CHECK(serialIndices == indices);
+    CHECK(serial.size() == vertices.size() &&
+          std::memcmp(&serial[0], &vertices[0],
+                      serial.size() * sizeof(MeshVertex)) == 0);
+}
+
+int main(int argc, char** argv) {
+    TestTriangle();
+    TestCorners();
+    TestRelative();
+    TestMalformed();
+    TestChunks();
+    return TestFailures();
+}
@@ -0,0 +1,206 @@
+// Engine running the simulation one frame ahead on its own thread.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _PIPELINED_ENGINE_H_
+#define _PIPELINED_ENGINE_H_
+
+#include "Atomic.h"
+#include "Tracer.h"
+#include "TransformCache.h"
+
+#include <Core/IEngine.h>
+#include <Core/Event.h>
+#include <Core/Thread.h>
+#include <Logging/Logger.h>
+#include <Math/Vector.h>
+#include <Math/Quaternion.h>
+#include <Scene/TransformationNode.h>
+#include <Utils/Timer.h>
+
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace OpenEngine;
+using namespace OpenEngine::Core;
+using namespace OpenEngine::Math;
+using namespace OpenEngine::Scene;
+
+/**
+ * Transformation state shared between the simulation and the
+ * renderer.
+ *
+ * Every shared node exists twice: the simulation moves its own copy,
+ * the scene holds the rendered one. After each simulation step
+ * Capture() copies the position and rotation of all simulated nodes
+ * into a snapshot and publishes it through a triple buffer; Apply()
+ * on the render thread takes the newest snapshot, if there is one,
+ * writes it to the rendered nodes and invalidates them in their
+ * transform cache. Nodes must be added before the engine starts.
+ */
+class SceneState {
+public:
+    void AddTransformation(TransformationNode* simulated,
+                           TransformationNode* rendered,
+                           TransformCache* cache = NULL) {
+        Shared s = { simulated, rendered, cache };
+        shared.push_back(s);
+    }
+
+    // Simulation thread, after a step.
+    void Capture() {
+        std::vector<float>& out = snapshots.Back();
+        out.resize(shared.size() * FLOATS);
+        for (unsigned int i = 0; i < shared.size(); i++) {
+            float* o = &out[i * FLOATS];
+            Vector<3,float> p = shared[i].simulated->GetPosition();
+            Quaternion<float> q = shared[i].simulated->GetRotation();
+            Vector<3,float> v = q.GetImaginary();
+            o[0] = p[0]; o[1] = p[1]; o[2] = p[2];
+            o[3] = q.GetReal(); o[4] = v[0]; o[5] = v[1]; o[6] = v[2];
+        }
+        snapshots.Publish();
+    }
+
+    // Render thread, before a frame. False if nothing new arrived.
+    bool Apply() {
+        if (!snapshots.Update()) return false;
+        const std::vector<float>& in = snapshots.Front();
+        for (unsigned int i = 0; i < shared.size(); i++) {
+            const float* s = &in[i * FLOATS];
+            TransformationNode* node = shared[i].rendered;
+            node->SetPosition(Vector<3,float>(s[0], s[1], s[2]));
+            node->SetRotation(
+                Quaternion<float>(s[3], Vector<3,float>(s[4], s[5], s[6])));
+            if (shared[i].cache) shared[i].cache->Invalidate(node);
+        }
+        return true;
+    }
+
+private:
+    static const unsigned int FLOATS = 7;   // position xyz, rotation wxyz
+
+    struct Shared {
+        TransformationNode* simulated;
+        TransformationNode* rendered;
+        TransformCache* cache;
+    };
+
+    std::vector<Shared> shared;
+    TripleBuffer<std::vector<float> > snapshots;
+};
+
+/**
+ * Engine loop that simulates frame N+1 while frame N is rendered.
+ *
+ * Listeners of SimulationEvent() run on a worker thread and must only
+ * touch their own data and the simulated nodes of the SceneState.
+ * Everything attached to ProcessEvent() stays on the calling thread,
+ * which owns the GL context and the window: input, camera handlers,
+ * the renderer and the frame. Each frame starts by applying the newest
+ * snapshot of the scene state.
+ *
+ * The simulation runs at most one step ahead of the frame being
+ * rendered and waits for the renderer otherwise, so both sides advance
+ * one step per frame. With a step the clock is virtual like in
+ * FixedStepEngine, otherwise both threads measure the wall clock.
+ */
+class PipelinedEngine : public IEngine {
+public:
+    // step in microseconds, 0 for the wall clock
+    PipelinedEngine(unsigned int step = 0)
+        : step(step), running(0), simulated(0), rendered(0), stale(0) {}
+
+    void Start() {
+        Atomic::Store(&running, 1);
+        initialize.Notify(InitializeEventArg());
+        Simulation worker(*this);
+        worker.Start();
+        unsigned long long time = 0, last = Now();
+        while (Atomic::Load(&running)) {
+            if (!state.Apply()) stale++;
+            unsigned long long now = Now();
+            unsigned int approx = step ? step : (unsigned int)(now - last);
+            last = now;
+            process.Notify(ProcessEventArg(Utils::Time(time), approx));
+            time += approx;
+            Atomic::Add(&rendered, 1);
+        }
+        worker.Wait();
+        logger.info << "Pipelined engine: " << rendered << " frames, "
+                    << simulated << " simulation steps, " << stale
+                    << " frames without a new state" << logger.end;
+        deinitialize.Notify(DeinitializeEventArg());
+    }
+
+    void Stop() { Atomic::Store(&running, 0); }
+
+    IEvent<InitializeEventArg>& InitializeEvent() { return initialize; }
+    IEvent<ProcessEventArg>& ProcessEvent() { return process; }
+    IEvent<DeinitializeEventArg>& DeinitializeEvent() { return deinitialize; }
+    // Run on the worker thread.
+    IEvent<ProcessEventArg>& SimulationEvent() { return simulation; }
+
+    SceneState& GetState() { return state; }
+
+private:
+    class Simulation : public Thread {
+    public:
+        Simulation(PipelinedEngine& engine) : engine(engine) {}
+        void Run() { engine.Simulate(); }
+    private:
+        PipelinedEngine& engine;
+    };
+
+    Event<InitializeEventArg> initialize;
+    Event<ProcessEventArg> process;
+    Event<ProcessEventArg> simulation;
+    Event<DeinitializeEventArg> deinitialize;
+    SceneState state;
+    unsigned int step;
+    volatile int running, simulated, rendered;
+    unsigned int stale;
+
+    void Simulate() {
+        Tracer::NameThread("simulation");
+        unsigned long long time = 0, last = Now();
+        while (Atomic::Load(&running)) {
+            // rendering frame N needs step N, we may prepare N+1
+            if (Atomic::Load(&simulated) > Atomic::Load(&rendered) + 1) {
+                Pause();
+                continue;
+            }
+            unsigned long long now = Now();
+            unsigned int approx = step ? step : (unsigned int)(now - last);
+            last = now;
+            simulation.Notify(ProcessEventArg(Utils::Time(time), approx));
+            time += approx;
+            TraceZone zone("simulation/capture");
+            state.Capture();
+            Atomic::Add(&simulated, 1);
+        }
+    }
+
+    static unsigned long long Now() {
+        return Utils::Timer::GetTime().AsInt();
+    }
+
+    static void Pause() {
+#ifdef _WIN32
+        Sleep(0);
+#else
+        usleep(100);
+#endif
+    }
+};
+
+#endif // _PIPELINED_ENGINE_H_
@@ -0,0 +1,204 @@
+// Asynchronous GLSL program building with an on-disk binary cache.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _PROGRAM_CACHE_H_
+#define _PROGRAM_CACHE_H_
+
+#include "GLProgram.h"
+
+#include <Logging/Logger.h>
+#include <Meta/OpenGL.h>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#ifndef GL_COMPLETION_STATUS_ARB
+#define GL_COMPLETION_STATUS_ARB 0x91B1
+#endif
+
+using namespace OpenEngine;
+using std::string;
+
+/**
+ * Builds GLSL programs without blocking the frame.
+ *
+ * Request() returns a program object immediately. With
+ * ARB_parallel_shader_compile the driver compiles and links it on its
+ * own threads and IsReady() polls for completion; callers draw a
+ * pass-through until then. Linked programs are stored in the cache
+ * directory as driver binaries (ARB_get_program_binary) keyed by a
+ * hash of the sources, the renderer and the driver version, so later
+ * runs skip compilation altogether.
+ */
+class ProgramCache {
+public:
+    ProgramCache(const string& directory)
+        : directory(directory), checked(false), binaries(false) {}
+
+    GLuint Request(const string& vertex, const string& fragment,
+                   const string& name) {
+        Check();
+        string key = Key(vertex + "\n//\n" + fragment);
+        GLuint program = LoadBinary(key);
+        if (program) {
+            ready[program] = true;
+            return program;
+        }
+
+        GLuint vs = Start(GL_VERTEX_SHADER, vertex);
+        GLuint fs = Start(GL_FRAGMENT_SHADER, fragment);
+        program = glCreateProgram();
+        if (binaries)
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                                GL_TRUE);
+        glAttachShader(program, vs);
+        glAttachShader(program, fs);
+        glLinkProgram(program);
+        // flagged for deletion, freed together with the program
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+
+        Pending p = { key, name };
+        pending[program] = p;
+        ready[program] = false;
+        return program;
+    }
+
+    // True once the program can be used. Failed programs never
+    // become ready.
+    bool IsReady(GLuint program) {
+        if (program == 0) return false;
+        std::map<GLuint, bool>::iterator r = ready.find(program);
+        if (r != ready.end() && r->second) return true;
+        std::map<GLuint, Pending>::iterator itr = pending.find(program);
+        if (itr == pending.end()) return false;
+
+        if (GLEW_ARB_parallel_shader_compile) {
+            GLint done = 0;
+            glGetProgramiv(program, GL_COMPLETION_STATUS_ARB, &done);
+            if (!done) return false;
+        }
+        Pending p = itr->second;
+        pending.erase(itr);
+        if (!GLProgram::CheckLinked(program, p.name)) return false;
+        SaveBinary(program, p.key);
+        ready[program] = true;
+        return true;
+    }
+
+private:
+    struct Pending {
+        string key, name;
+    };
+
+    string directory;
+    bool checked, binaries;
+    string driver;
+    std::map<GLuint, Pending> pending;
+    std::map<GLuint, bool> ready;
+
+    void Check() {
+        if (checked) return;
+        checked = true;
+        if (GLEW_ARB_parallel_shader_compile)
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        GLint formats = 0;
+        if (GLEW_ARB_get_program_binary)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        binaries = formats > 0;
+        driver = string((const char*)glGetString(GL_RENDERER)) + "/" +
+            (const char*)glGetString(GL_VERSION);
+        if (binaries) {
+#ifdef _WIN32
+            _mkdir(directory.c_str());
+#else
+            mkdir(directory.c_str(), 0755);
+#endif
+        }
+    }
+
+    GLuint Start(GLenum type, const string& source) {
+        GLuint shader = glCreateShader(type);
+        const GLchar* src = source.c_str();
+        glShaderSource(shader, 1, &src, NULL);
+        glCompileShader(shader);
+        return shader;
+    }
+
+    // 64 bit FNV-1a of the sources and the driver identification.
+    string Key(const string& source) const {
+        unsigned long long h = 14695981039346656037ULL;
+        string all = source + driver;
+        for (unsigned int i = 0; i < all.size(); i++) {
+            h ^= (unsigned char)all[i];
+            h *= 1099511628211ULL;
+        }
+        std::ostringstream out;
+        out << std::hex << h;
+        return out.str();
+    }
+
+    string Path(const string& key) const {
+        return directory + "/" + key + ".bin";
+    }
+
+    GLuint LoadBinary(const string& key) {
+        if (!binaries) return 0;
+        std::ifstream in(Path(key).c_str(), std::ios::binary);
+        if (!in.good()) return 0;
+        GLenum format;
+        std::vector<char> data;
+        in.read((char*)&format, sizeof(format));
+        in.seekg(0, std::ios::end);
+        std::streamoff size = (std::streamoff)in.tellg() - (std::streamoff)sizeof(format);
+        if (size <= 0) return 0;
+        data.resize(size);
+        in.seekg(sizeof(format));
+        in.read(&data[0], size);
+        if (!in.good()) return 0;
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, format, &data[0], size);
+        GLint status = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (!status) {
+            // stale binary, e.g. after a driver update; recompile
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    void SaveBinary(GLuint program, const string& key) {
+        if (!binaries) return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+        std::vector<char> data(length);
+        GLenum format;
+        glGetProgramBinary(program, length, NULL, &format, &data[0]);
+        std::ofstream out(Path(key).c_str(), std::ios::binary);
+        if (!out.good()) {
+            logger.warning << "Can not write program cache to '"
+                           << directory << "'" << logger.end;
+            return;
+        }
+        out.write((const char*)&format, sizeof(format));
+        out.write(&data[0], length);
+    }
+};
+
+#endif // _PROGRAM_CACHE_H_
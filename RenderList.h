@@ -0,0 +1,111 @@
+// Flat, state sorted draw list over cached world matrices.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _RENDER_LIST_H_
+#define _RENDER_LIST_H_
+
+#include "GLMatrix.h"
+#include "TransformCache.h"
+
+#include <Scene/RenderNode.h>
+#include <Renderers/IRenderingView.h>
+#include <Meta/OpenGL.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace OpenEngine;
+
+/**
+ * Render node replacing a subtree of transformation and render nodes
+ * with a linear list.
+ *
+ * Each item is a render node drawn with the world matrix of a
+ * TransformCache slot. Items are kept sorted by a state key chosen by
+ * the caller (the mesh, say), so draws sharing state follow each
+ * other; adding or removing an item moves it into place without
+ * sorting the list again. A frame updates the dirty slots of the
+ * cache and walks the list once, loading each matrix with a single
+ * glMultMatrixf instead of descending through the nodes. The
+ * modelview of the list is read once per frame; the item being drawn
+ * finds its own through GetModelview().
+ *
+ * The list owns the render nodes and the transformation nodes of its
+ * cache.
+ */
+class RenderList : public Scene::RenderNode {
+public:
+    ~RenderList() {
+        for (unsigned int i = 0; i < items.size(); i++)
+            delete items[i].node;
+        for (unsigned int i = 0; i < owned.size(); i++)
+            delete owned[i];
+    }
+
+    // Slot of node below parent, -1 for the frame of the list.
+    unsigned int AddTransformation(TransformationNode* node, int parent = -1) {
+        owned.push_back(node);
+        return cache.Add(node, parent);
+    }
+
+    void AddItem(Scene::RenderNode* node, unsigned int slot, unsigned int key) {
+        Item item = { key, slot, node };
+        items.insert(std::upper_bound(items.begin(), items.end(), item), item);
+    }
+
+    // Removes node, the caller owns it again.
+    void RemoveItem(Scene::RenderNode* node) {
+        for (unsigned int i = 0; i < items.size(); i++)
+            if (items[i].node == node) {
+                items.erase(items.begin() + i);
+                return;
+            }
+    }
+
+    // Modelview of the item being drawn, NULL outside of a list.
+    static const float* GetModelview() { return current; }
+
+    TransformCache& GetTransforms() { return cache; }
+    unsigned int GetItemCount() const { return items.size(); }
+
+    void Apply(Renderers::IRenderingView* view) {
+        cache.Update();
+        glMatrixMode(GL_MODELVIEW);
+        float base[16], modelview[16];
+        glGetFloatv(GL_MODELVIEW_MATRIX, base);
+        const float* outer = current;
+        current = modelview;
+        for (unsigned int i = 0; i < items.size(); i++) {
+            const float* world = cache.GetWorld(items[i].slot);
+            GLMatrix::Multiply(base, world, modelview);
+            glPushMatrix();
+            glMultMatrixf(world);
+            items[i].node->Apply(view);
+            glPopMatrix();
+        }
+        current = outer;
+    }
+
+private:
+    struct Item {
+        unsigned int key, slot;
+        Scene::RenderNode* node;
+        bool operator<(const Item& other) const { return key < other.key; }
+    };
+
+    static const float* current;
+
+    TransformCache cache;
+    std::vector<Item> items;
+    std::vector<TransformationNode*> owned;
+};
+
+const float* RenderList::current = NULL;
+
+#endif // _RENDER_LIST_H_
@@ -0,0 +1,183 @@
+// Shared pool of transient render targets.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _RENDER_TARGET_POOL_H_
+#define _RENDER_TARGET_POOL_H_
+
+#include <Core/IListener.h>
+#include <Core/IEngine.h>
+#include <Logging/Logger.h>
+#include <Meta/OpenGL.h>
+
+#include <list>
+
+using namespace OpenEngine;
+using namespace OpenEngine::Core;
+
+// A texture with a frame buffer object rendering into it.
+struct RenderTarget {
+    GLuint texture, fbo;
+    int width, height;
+    GLenum format;
+    GLint filter;
+    unsigned int lastUsed;
+    bool inUse;
+};
+
+/**
+ * Pool of render targets keyed by format, filter and size.
+ *
+ * Passes acquire targets for as long as they need them within a frame
+ * and release them again; a released target is handed to the next
+ * acquire with the same key, so passes whose lifetimes do not overlap
+ * alias the same texture memory. Targets that have not been used for
+ * a number of frames are freed, so memory follows what is enabled
+ * rather than what has been constructed. Depth formats get a depth
+ * attachment and no color buffer.
+ *
+ * The filter is the minification and magnification filter of the
+ * texture; without one, color targets are sampled linearly and depth
+ * targets with GL_NEAREST. A stage that needs whole texels, like a
+ * pixelation, asks for GL_NEAREST.
+ */
+class RenderTargetPool : public IListener<DeinitializeEventArg> {
+public:
+    RenderTargetPool(unsigned int keepFrames = 60)
+        : keepFrames(keepFrames), frame(0), allocated(0), peakAllocated(0)
+        , inUse(0), peakInUse(0) {}
+
+    ~RenderTargetPool() {
+        for (std::list<RenderTarget*>::iterator itr = targets.begin();
+             itr != targets.end(); ++itr)
+            Free(*itr);
+    }
+
+    RenderTarget* Acquire(int width, int height, GLenum format,
+                          GLint filter = 0) {
+        if (filter == 0) filter = IsDepthFormat(format) ? GL_NEAREST : GL_LINEAR;
+        RenderTarget* target = NULL;
+        for (std::list<RenderTarget*>::iterator itr = targets.begin();
+             itr != targets.end(); ++itr) {
+            RenderTarget* t = *itr;
+            if (!t->inUse && t->width == width && t->height == height &&
+                t->format == format && t->filter == filter) {
+                target = t;
+                break;
+            }
+        }
+        if (target == NULL) target = Allocate(width, height, format, filter);
+        target->inUse = true;
+        target->lastUsed = frame;
+        inUse += Size(target);
+        if (inUse > peakInUse) peakInUse = inUse;
+        return target;
+    }
+
+    void Release(RenderTarget* target) {
+        if (target == NULL || !target->inUse) return;
+        target->inUse = false;
+        inUse -= Size(target);
+    }
+
+    // Call once per frame; frees targets that went unused.
+    void EndFrame() {
+        frame++;
+        std::list<RenderTarget*>::iterator itr = targets.begin();
+        while (itr != targets.end()) {
+            RenderTarget* t = *itr;
+            if (!t->inUse && frame - t->lastUsed > keepFrames) {
+                Free(t);
+                itr = targets.erase(itr);
+            }
+            else ++itr;
+        }
+    }
+
+    unsigned long GetAllocatedBytes() const { return allocated; }
+    unsigned long GetPeakAllocatedBytes() const { return peakAllocated; }
+    unsigned long GetPeakInUseBytes() const { return peakInUse; }
+
+    void Handle(DeinitializeEventArg arg) {
+        logger.info << "Render target pool peak: "
+                    << peakAllocated / 1024 << " KB allocated, "
+                    << peakInUse / 1024 << " KB in use at once"
+                    << logger.end;
+    }
+
+    static bool IsDepthFormat(GLenum format) {
+        return format == GL_DEPTH_COMPONENT || format == GL_DEPTH_COMPONENT16 ||
+            format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32;
+    }
+
+private:
+    std::list<RenderTarget*> targets;
+    unsigned int keepFrames, frame;
+    unsigned long allocated, peakAllocated, inUse, peakInUse;
+
+    static unsigned long Size(RenderTarget* t) {
+        unsigned long texel = 4;
+        if (t->format == GL_RGBA16F_ARB) texel = 8;
+        else if (t->format == GL_RGBA32F_ARB) texel = 16;
+        return texel * t->width * t->height;
+    }
+
+    RenderTarget* Allocate(int width, int height, GLenum format, GLint filter) {
+        RenderTarget* t = new RenderTarget();
+        t->width = width;
+        t->height = height;
+        t->format = format;
+        t->filter = filter;
+        t->inUse = false;
+        bool depth = IsDepthFormat(format);
+
+        glGenTextures(1, &t->texture);
+        glBindTexture(GL_TEXTURE_2D, t->texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0,
+                     depth ? GL_DEPTH_COMPONENT : GL_RGBA,
+                     depth ? GL_UNSIGNED_INT : GL_UNSIGNED_BYTE, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        GLint previous;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+        glGenFramebuffers(1, &t->fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, t->fbo);
+        if (depth) {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                   GL_TEXTURE_2D, t->texture, 0);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+        }
+        else
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                   GL_TEXTURE_2D, t->texture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            logger.error << "Incomplete render target " << width << "x"
+                         << height << logger.end;
+        glBindFramebuffer(GL_FRAMEBUFFER, previous);
+        CHECK_FOR_GL_ERROR();
+
+        targets.push_back(t);
+        allocated += Size(t);
+        if (allocated > peakAllocated) peakAllocated = allocated;
+        return t;
+    }
+
+    void Free(RenderTarget* t) {
+        allocated -= Size(t);
+        glDeleteFramebuffers(1, &t->fbo);
+        glDeleteTextures(1, &t->texture);
+        delete t;
+    }
+};
+
+#endif // _RENDER_TARGET_POOL_H_
@@ -0,0 +1,591 @@
+// Low frequency effects run at reduced resolution.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _SCALED_STAGES_H_
+#define _SCALED_STAGES_H_
+
+#include "DynamicResolution.h"
+#include "GLMatrix.h"
+#include "LazyEffect.h"
+#include "ProgramCache.h"
+#include "ScreenPipeline.h"
+
+#include <Core/IEngine.h>
+#include <Core/IListener.h>
+#include <Devices/IKeyboard.h>
+#include <Display/IFrame.h>
+#include <Display/IViewingVolume.h>
+#include <Logging/Logger.h>
+#include <Renderers/OpenGL/IPostProcessingEffect.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+using namespace OpenEngine::Core;
+using namespace OpenEngine::Devices;
+using namespace OpenEngine::Display;
+using namespace OpenEngine::Renderers::OpenGL;
+
+/**
+ * Screen stage that does its work at 1/scale of the viewport size.
+ *
+ * The frame is box filtered down, the subclass renders its effect on
+ * the small image, and the result is brought back with a depth aware
+ * (bilateral) upsample: of the four nearest low resolution texels,
+ * those at a different depth than the full resolution pixel get
+ * little weight, so blurred color does not bleed across silhouettes.
+ * The upsampled value is merged with the full resolution frame by the
+ * subclass' combine snippet. The scale (1, 2 or 4) can be changed at
+ * any time.
+ *
+ * A subclass may leave some of the cases to an effect in the post
+ * processing chain, see IsStaged() and StageSwitch; the stage is only
+ * enabled while its toggle is on and it does the work itself.
+ *
+ * Stages that support it can run in temporal mode: the subclass takes
+ * a quarter of its samples per frame, rotating through the sample set
+ * by Phase(), and the low resolution results are accumulated in a
+ * history buffer. The history is reprojected with the camera motion
+ * between the frames and rejected where the depth found at the
+ * reprojected position does not match (disocclusion), so it takes a
+ * few frames to converge after a change.
+ */
+class ScaledStage : public IScreenStage {
+public:
+    ScaledStage(const string& name, IPostProcessingEffect* toggle,
+                ProgramCache& cache)
+        : name(name), toggle(toggle), cache(cache), scale(1), temporal(false)
+        , downsample(0), upsample(0), accumulate(0), pool(NULL)
+        , current(0), historyValid(false) {
+        history[0] = history[1] = NULL;
+    }
+
+    string GetName() const { return name; }
+
+    bool IsEnabled() {
+        bool enabled = toggle->GetEnabled() && IsStaged();
+        if (!enabled) ReleaseHistory();
+        return enabled;
+    }
+
+    // Whether the user has the effect on, even if the stage sits out.
+    bool IsToggled() { return toggle->GetEnabled(); }
+
+    // Whether the stage renders the effect at the current scale and
+    // mode, rather than the effect's instance in the chain.
+    virtual bool IsStaged() { return true; }
+
+    bool IsReady() {
+        if (upsample == 0) Build();
+        return cache.IsReady(downsample) && cache.IsReady(upsample) &&
+            cache.IsReady(accumulate) && IsLowReady();
+    }
+
+    // the upsample weighs by depth
+    bool NeedsDepth() { return true; }
+    bool NeedsPreviousDepth() { return temporal; }
+
+    void SetScale(int divisor) { scale = std::max(1, std::min(4, divisor)); }
+    int GetScale() const { return scale; }
+
+    virtual bool SupportsTemporal() const { return false; }
+    void SetTemporal(bool enable) {
+        temporal = enable && SupportsTemporal();
+        if (!temporal) ReleaseHistory();
+    }
+    bool IsTemporal() const { return temporal; }
+
+    static const unsigned int TEMPORAL_FRAMES = 4;
+
+    void Render(ScreenContext& ctx) {
+        int w, h;
+        LowSize(ctx, w, h);
+        RenderTarget* low = ctx.pool->Acquire(w, h, GL_RGBA8);
+        Bind(low);
+        glUseProgram(downsample);
+        glUniform1i(glGetUniformLocation(downsample, "color"), 0);
+        glUniform2f(glGetUniformLocation(downsample, "offset"),
+                    0.25f / w, 0.25f / h);
+        glBindTexture(GL_TEXTURE_2D, ctx.color);
+        ScreenPipeline::DrawQuad();
+
+        RenderTarget* result = RenderLow(ctx, low);
+        RenderTarget* shown = temporal ? Accumulate(ctx, result) : result;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, ctx.output);
+        glViewport(ctx.viewport[0], ctx.viewport[1],
+                   ctx.viewport[2], ctx.viewport[3]);
+        glUseProgram(upsample);
+        BindTexture(upsample, "color", 0, ctx.color);
+        BindTexture(upsample, "low", 1, shown->texture);
+        BindTexture(upsample, "depth", 2, ctx.depth);
+        glUniform2f(glGetUniformLocation(upsample, "lowSize"), w, h);
+        SetDepthParams(upsample, ctx);
+        SetCombineUniforms(upsample, ctx);
+        ScreenPipeline::DrawQuad();
+        glUseProgram(0);
+        glActiveTexture(GL_TEXTURE0);
+
+        if (result != low) ctx.pool->Release(result);
+        ctx.pool->Release(low);
+    }
+
+protected:
+    string name;
+    IPostProcessingEffect* toggle;
+    ProgramCache& cache;
+    int scale;
+    bool temporal;
+
+    // Which part of the sample set to take this frame, always 0
+    // outside temporal mode.
+    unsigned int Phase(const ScreenContext& ctx) const {
+        return temporal ? ctx.frame % TEMPORAL_FRAMES : 0;
+    }
+
+    // From this frame's normalized device coordinates to the clip
+    // coordinates of the previous frame.
+    static void Reprojection(const ScreenContext& ctx, float out[16]) {
+        float viewProj[16], inverse[16], previous[16];
+        GLMatrix::Multiply(ctx.projection, ctx.modelview, viewProj);
+        GLMatrix::Multiply(ctx.previousProjection, ctx.previousModelview, previous);
+        if (!GLMatrix::Invert(viewProj, inverse)) GLMatrix::Identity(inverse);
+        GLMatrix::Multiply(previous, inverse, out);
+    }
+
+    // Size of the low resolution frame.
+    virtual void LowSize(const ScreenContext& ctx, int& width, int& height) {
+        width = std::max(1, ctx.width / scale);
+        height = std::max(1, ctx.height / scale);
+    }
+
+    // Render the effect on the low resolution frame, returning the
+    // target holding the result (may be low itself).
+    virtual RenderTarget* RenderLow(ScreenContext& ctx, RenderTarget* low) = 0;
+    // GLSL merging vec4 full and vec4 blurred into vec4 c. The linear
+    // depth z of the pixel and linear() are available.
+    virtual string GetCombineCode() const = 0;
+    virtual string GetCombineUniforms() const { return ""; }
+    virtual void SetCombineUniforms(GLuint program, ScreenContext& ctx) {}
+    virtual bool IsLowReady() { return true; }
+
+    static void Bind(RenderTarget* target) {
+        glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+        glViewport(0, 0, target->width, target->height);
+    }
+
+    static void BindTexture(GLuint program, const char* name,
+                            int unit, GLuint texture) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glUniform1i(glGetUniformLocation(program, name), unit);
+    }
+
+    // Linear eye depth from the projection: z = B / (ndc + A).
+    static void SetDepthParams(GLuint program, ScreenContext& ctx) {
+        glUniform2f(glGetUniformLocation(program, "depthParams"),
+                    ctx.projection[10], ctx.projection[14]);
+    }
+
+    static string DepthFunctions() {
+        return
+            "uniform vec2 depthParams;\n"
+            "float linear(float d) {\n"
+            "  return depthParams.y / (2.0 * d - 1.0 + depthParams.x);\n"
+            "}\n";
+    }
+
+    GLuint Request(const string& fragment, const string& pass) {
+        return cache.Request(GLProgram::ScreenVertexShader(), fragment,
+                             name + "." + pass);
+    }
+
+private:
+    GLuint downsample, upsample, accumulate;
+    RenderTargetPool* pool;
+    RenderTarget* history[2];
+    int current;
+    bool historyValid;
+
+    void ReleaseHistory() {
+        if (history[0] == NULL) return;
+        pool->Release(history[0]);
+        pool->Release(history[1]);
+        history[0] = history[1] = NULL;
+        historyValid = false;
+    }
+
+    // Blends result into the reprojected history, returning the
+    // history target that now holds the accumulated image.
+    RenderTarget* Accumulate(ScreenContext& ctx, RenderTarget* result) {
+        if (history[0] && (history[0]->width != result->width ||
+                           history[0]->height != result->height))
+            ReleaseHistory();
+        if (history[0] == NULL) {
+            pool = ctx.pool;
+            history[0] = pool->Acquire(result->width, result->height, GL_RGBA8);
+            history[1] = pool->Acquire(result->width, result->height, GL_RGBA8);
+        }
+        bool valid = historyValid && ctx.previousDepth != 0;
+        RenderTarget* target = history[current];
+        RenderTarget* previous = history[1 - current];
+
+        float reproject[16];
+        Reprojection(ctx, reproject);
+        Bind(target);
+        glUseProgram(accumulate);
+        BindTexture(accumulate, "current", 0, result->texture);
+        BindTexture(accumulate, "history", 1, previous->texture);
+        BindTexture(accumulate, "depth", 2, ctx.depth);
+        BindTexture(accumulate, "previousDepth", 3,
+                    valid ? ctx.previousDepth : ctx.depth);
+        glUniformMatrix4fv(glGetUniformLocation(accumulate, "reproject"),
+                           1, GL_FALSE, reproject);
+        glUniform1f(glGetUniformLocation(accumulate, "keep"),
+                    valid ? 1.0f - 1.0f / TEMPORAL_FRAMES : 0.0f);
+        SetDepthParams(accumulate, ctx);
+        ScreenPipeline::DrawQuad();
+        glUseProgram(0);
+        glActiveTexture(GL_TEXTURE0);
+
+        current = 1 - current;
+        historyValid = true;
+        return target;
+    }
+
+    void Build() {
+        // four bilinear taps cover a scale x scale block
+        downsample = Request(
+            "uniform sampler2D color;\n"
+            "uniform vec2 offset;\n"
+            "void main() {\n"
+            "  vec2 uv = gl_TexCoord[0].st;\n"
+            "  gl_FragColor = 0.25 * (texture2D(color, uv + vec2(-offset.x, -offset.y)) +\n"
+            "                         texture2D(color, uv + vec2( offset.x, -offset.y)) +\n"
+            "                         texture2D(color, uv + vec2(-offset.x,  offset.y)) +\n"
+            "                         texture2D(color, uv + vec2( offset.x,  offset.y)));\n"
+            "}\n", "downsample");
+
+        // exponential moving average over the reprojected history; the
+        // history is dropped where the surface it saw is not the one
+        // reprojected there, or where it comes from outside the frame
+        accumulate = Request(
+            "uniform sampler2D current;\n"
+            "uniform sampler2D history;\n"
+            "uniform sampler2D depth;\n"
+            "uniform sampler2D previousDepth;\n"
+            "uniform mat4 reproject;\n"
+            "uniform float keep;\n"
+            + DepthFunctions() +
+            "void main() {\n"
+            "  vec2 uv = gl_TexCoord[0].st;\n"
+            "  vec4 c = texture2D(current, uv);\n"
+            "  float d = texture2D(depth, uv).r;\n"
+            "  vec4 p = reproject * vec4(vec3(uv, d) * 2.0 - 1.0, 1.0);\n"
+            "  vec3 prev = p.xyz / p.w * 0.5 + 0.5;\n"
+            "  float k = keep;\n"
+            "  if (any(lessThan(prev.xy, vec2(0.0))) ||\n"
+            "      any(greaterThan(prev.xy, vec2(1.0))))\n"
+            "    k = 0.0;\n"
+            "  float expected = linear(prev.z);\n"
+            "  float found = linear(texture2D(previousDepth, prev.xy).r);\n"
+            "  if (d < 1.0 && abs(found - expected) > 0.05 * expected)\n"
+            "    k = 0.0;\n"
+            "  gl_FragColor = mix(c, texture2D(history, prev.xy), k);\n"
+            "}\n", "accumulate");
+
+        upsample = Request(
+            "uniform sampler2D color;\n"
+            "uniform sampler2D low;\n"
+            "uniform sampler2D depth;\n"
+            "uniform vec2 lowSize;\n"
+            + DepthFunctions() + GetCombineUniforms() +
+            "void main() {\n"
+            "  vec2 uv = gl_TexCoord[0].st;\n"
+            "  float z = linear(texture2D(depth, uv).r);\n"
+            "  vec2 p = uv * lowSize - 0.5;\n"
+            "  vec2 f = fract(p);\n"
+            "  vec2 base = (floor(p) + 0.5) / lowSize;\n"
+            "  vec4 sum = vec4(0.0);\n"
+            "  float wsum = 0.0;\n"
+            "  for (int j = 0; j < 2; j++) {\n"
+            "    for (int i = 0; i < 2; i++) {\n"
+            "      vec2 t = base + vec2(float(i), float(j)) / lowSize;\n"
+            "      float zt = linear(texture2D(depth, t).r);\n"
+            "      float bw = (i == 0 ? 1.0 - f.x : f.x) * (j == 0 ? 1.0 - f.y : f.y);\n"
+            "      float w = bw * (exp(-abs(zt - z) / (0.05 * z)) + 0.00001);\n"
+            "      sum += texture2D(low, t) * w;\n"
+            "      wsum += w;\n"
+            "    }\n"
+            "  }\n"
+            "  vec4 blurred = sum / max(wsum, 0.00001);\n"
+            "  vec4 full = texture2D(color, uv);\n"
+            "  vec4 c = full;\n"
+            + GetCombineCode() +
+            "  gl_FragColor = c;\n"
+            "}\n", "upsample");
+    }
+};
+
+/**
+ * Runs an effect of the effects extension at reduced resolution
+ * (Glow, GaussianBlur, TwoPassBlur, SimpleDoF, DoF and
+ * VolumetricLightScattering).
+ *
+ * At scale 1 the stage sits out and the effect's instance in the post
+ * processing chain runs, at its place in the chain. Reduced, the
+ * effect runs here instead, after the whole chain.
+ *
+ * The effect is constructed on a viewport of 1/scale of the main
+ * viewport, which follows the dynamic resolution step, so it
+ * allocates its buffers at that size; there is one effect per
+ * resolution the stage has run at. Every frame the downsampled frame and the
+ * scene depth are drawn into the effect as its scene, and its output
+ * is caught in a pooled target of the same size and upsampled.
+ *
+ * The effect is used as the post processing chain uses it: PreRender()
+ * redirects drawing into its buffers, and PostRender() draws the
+ * result into the frame buffer that was bound before. An effect that
+ * draws into another frame buffer instead has its result copied from
+ * there.
+ */
+class EffectStage : public ScaledStage {
+public:
+    EffectStage(const string& name, IPostProcessingEffect* toggle,
+                ProgramCache& cache, LazyEffect::Factory factory,
+                IFrame& frame, ScaledViewport& main, IViewingVolume* volume,
+                IEngine& engine)
+        : ScaledStage(name, toggle, cache), factory(factory), frame(frame)
+        , main(main), volume(volume), engine(engine), feed(0) {}
+
+    bool IsStaged() { return scale > 1; }
+
+protected:
+    void LowSize(const ScreenContext& ctx, int& width, int& height) {
+        Vector<4,int> dimension = GetInstance().viewport->GetDimension();
+        width = dimension[2];
+        height = dimension[3];
+    }
+
+    RenderTarget* RenderLow(ScreenContext& ctx, RenderTarget* low) {
+        PostProcessingEffect* effect = GetInstance().effect;
+        RenderTarget* result = ctx.pool->Acquire(low->width, low->height,
+                                                 low->format);
+        glPushAttrib(GL_ENABLE_BIT | GL_DEPTH_BUFFER_BIT |
+                     GL_TEXTURE_BIT | GL_VIEWPORT_BIT);
+        Bind(result);
+        effect->PreRender();
+
+        // the scene as the effect sees it
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_ALWAYS);
+        glDepthMask(GL_TRUE);
+        glUseProgram(feed);
+        BindTexture(feed, "color", 0, low->texture);
+        BindTexture(feed, "depth", 1, ctx.depth);
+        ScreenPipeline::DrawQuad();
+        glUseProgram(0);
+        glActiveTexture(GL_TEXTURE0);
+        glDepthFunc(GL_LESS);
+        glDisable(GL_DEPTH_TEST);
+        glDepthMask(GL_FALSE);
+
+        effect->PostRender();
+        GLint bound;
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &bound);
+        if (bound != (GLint)result->fbo) {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, result->texture);
+            glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0,
+                                result->width, result->height);
+        }
+        glPopAttrib();
+        GLDiagnostics::Check(name.c_str());
+        return result;
+    }
+
+    string GetCombineCode() const { return "  c = blurred;\n"; }
+
+    bool IsLowReady() {
+        if (feed == 0)
+            feed = Request(
+                "uniform sampler2D color;\n"
+                "uniform sampler2D depth;\n"
+                "void main() {\n"
+                "  vec2 uv = gl_TexCoord[0].st;\n"
+                "  gl_FragColor = texture2D(color, uv);\n"
+                "  gl_FragDepth = texture2D(depth, uv).r;\n"
+                "}\n", "feed");
+        return cache.IsReady(feed);
+    }
+
+private:
+    // The effect sized for one resolution.
+    struct Instance {
+        ScaledViewport* viewport;
+        PostProcessingEffect* effect;
+    };
+
+    LazyEffect::Factory factory;
+    IFrame& frame;
+    ScaledViewport& main;
+    IViewingVolume* volume;
+    IEngine& engine;
+    GLuint feed;
+    // by the scale of the instance to the window, the stage scale on
+    // top of the dynamic resolution step; kept, as the effects may be
+    // attached to engine events
+    std::map<float, Instance> instances;
+
+    Instance& GetInstance() {
+        const float combined = main.GetScale() / scale;
+        std::map<float, Instance>::iterator itr = instances.find(combined);
+        if (itr != instances.end()) return itr->second;
+        logger.info << "Loading effect: " << name << " at "
+                    << (int)(combined * 100 + 0.5f) << "% resolution"
+                    << logger.end;
+        Instance& instance = instances[combined];
+        instance.viewport = new ScaledViewport(frame);
+        instance.viewport->SetViewingVolume(volume);
+        instance.viewport->SetScale(combined);
+        instance.effect = factory(instance.viewport, engine);
+        // the engine is running already, see LazyEffect
+        instance.effect->Handle(InitializeEventArg());
+        instance.effect->Enable(true);
+        return instance;
+    }
+};
+
+// Temporal mode of the MotionBlur effect: blur along the screen space
+// motion of the camera since the last frame, reconstructed from the
+// depth buffer and the previous matrices, taking 4 of the 16 samples
+// along the motion per frame and letting the accumulation average the
+// rest in. Moving objects under a still camera are not blurred. The
+// stage only runs in temporal mode; per frame the effect itself runs
+// in the chain, see StageSwitch.
+class MotionBlurStage : public ScaledStage {
+public:
+    MotionBlurStage(const string& name, IPostProcessingEffect* toggle,
+                    ProgramCache& cache, float shutter)
+        : ScaledStage(name, toggle, cache), shutter(shutter), smear(0) {}
+    bool SupportsTemporal() const { return true; }
+    bool IsStaged() { return temporal; }
+protected:
+    RenderTarget* RenderLow(ScreenContext& ctx, RenderTarget* low) {
+        RenderTarget* target = ctx.pool->Acquire(low->width, low->height,
+                                                 low->format);
+        float reproject[16];
+        Reprojection(ctx, reproject);
+        Bind(target);
+        glUseProgram(smear);
+        BindTexture(smear, "color", 0, low->texture);
+        BindTexture(smear, "depth", 1, ctx.depth);
+        glUniformMatrix4fv(glGetUniformLocation(smear, "reproject"),
+                           1, GL_FALSE, reproject);
+        glUniform1f(glGetUniformLocation(smear, "shutter"), shutter);
+        glUniform1f(glGetUniformLocation(smear, "phase"), (float)Phase(ctx));
+        glUniform1f(glGetUniformLocation(smear, "stride"),
+                    temporal ? (float)TEMPORAL_FRAMES : 1.0f);
+        ScreenPipeline::DrawQuad();
+        glUseProgram(0);
+        glActiveTexture(GL_TEXTURE0);
+        return target;
+    }
+    string GetCombineCode() const { return "  c = blurred;\n"; }
+    bool IsLowReady() {
+        // the loop always runs 16 times, temporal mode spreads 4 of
+        // the samples over the whole line by a stride of 4
+        if (smear == 0)
+            smear = Request(
+                "uniform sampler2D color;\n"
+                "uniform sampler2D depth;\n"
+                "uniform mat4 reproject;\n"
+                "uniform float shutter;\n"
+                "uniform float phase;\n"
+                "uniform float stride;\n"
+                "void main() {\n"
+                "  vec2 uv = gl_TexCoord[0].st;\n"
+                "  float d = texture2D(depth, uv).r;\n"
+                "  vec4 p = reproject * vec4(vec3(uv, d) * 2.0 - 1.0, 1.0);\n"
+                "  vec2 velocity = (uv - (p.xy / p.w * 0.5 + 0.5)) * shutter;\n"
+                "  float count = 16.0 / stride;\n"
+                "  vec4 sum = vec4(0.0);\n"
+                "  for (int i = 0; i < 16; i++) {\n"
+                "    if (float(i) >= count) break;\n"
+                "    float t = (float(i) * stride + phase + 0.5) / 16.0 - 0.5;\n"
+                "    sum += texture2D(color, uv + velocity * t);\n"
+                "  }\n"
+                "  gl_FragColor = sum / count;\n"
+                "}\n", "smear");
+        return cache.IsReady(smear);
+    }
+private:
+    float shutter;
+    GLuint smear;
+};
+
+/**
+ * Runs the instance of an effect in the post processing chain while
+ * the stage's toggle is on and the stage leaves the effect to the
+ * chain. Attach to the process event, so the chain and the stage
+ * agree before the frame.
+ */
+class StageSwitch : public IListener<ProcessEventArg> {
+public:
+    StageSwitch(IPostProcessingEffect* chained, ScaledStage& stage)
+        : chained(chained), stage(stage) {}
+
+    void Handle(ProcessEventArg arg) {
+        bool run = stage.IsToggled() && !stage.IsStaged();
+        if (chained->GetEnabled() != run) chained->Enable(run);
+    }
+
+private:
+    IPostProcessingEffect* chained;
+    ScaledStage& stage;
+};
+
+/**
+ * Cycles the resolution of the enabled scaled stages through full,
+ * half and quarter resolution when F8 is pressed, and switches
+ * temporal mode of those supporting it when F7 is pressed.
+ */
+class ScaleHandler : public IListener<KeyboardEventArg> {
+public:
+    void Add(ScaledStage* stage) { stages.push_back(stage); }
+
+    void Handle(KeyboardEventArg arg) {
+        if (arg.type != EVENT_PRESS) return;
+        if (arg.sym == KEY_F8) {
+            for (unsigned int i = 0; i < stages.size(); i++) {
+                if (!stages[i]->IsToggled()) continue;
+                int scale = stages[i]->GetScale() == 4 ? 1 : stages[i]->GetScale() * 2;
+                stages[i]->SetScale(scale);
+                logger.info << stages[i]->GetName() << " at 1/" << scale
+                            << " resolution" << logger.end;
+            }
+        }
+        else if (arg.sym == KEY_F7) {
+            for (unsigned int i = 0; i < stages.size(); i++) {
+                if (!stages[i]->IsToggled() || !stages[i]->SupportsTemporal())
+                    continue;
+                stages[i]->SetTemporal(!stages[i]->IsTemporal());
+                logger.info << stages[i]->GetName()
+                            << (stages[i]->IsTemporal() ? " temporal" : " per frame")
+                            << logger.end;
+            }
+        }
+    }
+
+private:
+    std::vector<ScaledStage*> stages;
+};
+
+#endif // _SCALED_STAGES_H_
@@ -0,0 +1,247 @@
+// Screen space stages run after the post processing chain.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _SCREEN_PIPELINE_H_
+#define _SCREEN_PIPELINE_H_
+
+#include "GLDiagnostics.h"
+#include "RenderTargetPool.h"
+
+#include <Meta/OpenGL.h>
+
+#include <algorithm>
+#include <vector>
+#include <string>
+
+using namespace OpenEngine;
+using std::string;
+
+// What a stage gets to work with when it renders.
+struct ScreenContext {
+    GLuint color;           // output of the previous pass
+    GLuint depth;           // scene depth, 0 unless a stage needs it
+    int width, height;      // size of the viewport in pixels
+    GLint output;           // frame buffer the stage renders to
+    GLint viewport[4];      // and its viewport
+    float modelview[16];    // camera matrices of the scene
+    float projection[16];
+    float previousModelview[16];  // and of the frame before
+    float previousProjection[16];
+    GLuint previousDepth;   // scene depth of the frame before, if kept
+    unsigned int frame;     // counts rendered frames
+    RenderTargetPool* pool; // for intermediate targets of the stage
+};
+
+/**
+ * A full screen stage, rendering itself in Render().
+ */
+class IScreenStage {
+public:
+    virtual ~IScreenStage() {}
+    virtual string GetName() const = 0;
+    virtual bool IsEnabled() = 0;
+    // False while the stage's programs are still being built.
+    virtual bool IsReady() { return true; }
+    // True if the stage reads the scene depth, respectively the depth
+    // of the previous frame. Depth is only captured for the enabled
+    // stages that ask for it.
+    virtual bool NeedsDepth() { return false; }
+    virtual bool NeedsPreviousDepth() { return false; }
+    virtual void Render(ScreenContext& context) {}
+};
+
+/**
+ * Ordered list of screen stages drawn on top of the finished frame.
+ *
+ * Every enabled stage is a pass of its own. A stage whose programs
+ * are not ready yet is skipped, which leaves the frame as it is.
+ *
+ * Passes ping-pong between transient targets from the render target
+ * pool; the frame is copied once and the last pass writes straight
+ * into the frame buffer that was bound when Render() was called.
+ *
+ * CaptureScene() must be called while the scene frame buffer is still
+ * bound, i.e. before the post processing chain resolves it; it keeps
+ * the camera matrices for the stages, and the scene depth if an
+ * enabled stage reads it. The matrices of the previous frame are
+ * passed on as well, and its depth is held one frame longer while an
+ * enabled stage asks for it. Nothing is captured or copied while no
+ * stage is enabled.
+ */
+class ScreenPipeline {
+public:
+    ScreenPipeline(RenderTargetPool& pool)
+        : pool(pool), depth(NULL), previousDepth(NULL)
+        , frame(0), havePrevious(false) {}
+
+    RenderTargetPool& GetPool() { return pool; }
+
+    void Add(IScreenStage* stage) { stages.push_back(stage); }
+
+    void CaptureScene() {
+        CollectEnabled();
+        if (enabled.empty()) return;
+
+        glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+        glGetFloatv(GL_PROJECTION_MATRIX, projection);
+        if (!NeedsDepth()) return;
+        GLint vp[4];
+        glGetIntegerv(GL_VIEWPORT, vp);
+        depth = pool.Acquire(vp[2], vp[3], GL_DEPTH_COMPONENT24);
+        glBindTexture(GL_TEXTURE_2D, depth->texture);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, vp[0], vp[1],
+                            vp[2], vp[3]);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        GLDiagnostics::Check("scene capture");
+    }
+
+    // Run the enabled stages on the current frame buffer.
+    void Render() {
+        CollectEnabled();
+        std::vector<IScreenStage*> passes;
+        for (unsigned int i = 0; i < enabled.size(); i++)
+            if (enabled[i]->IsReady()) passes.push_back(enabled[i]);
+        if (passes.empty()) {
+            havePrevious = false;
+            EndFrame();
+            return;
+        }
+
+        GLint vp[4], output;
+        glGetIntegerv(GL_VIEWPORT, vp);
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &output);
+        const int width = vp[2], height = vp[3];
+
+        glPushAttrib(GL_ENABLE_BIT | GL_DEPTH_BUFFER_BIT |
+                     GL_TEXTURE_BIT | GL_VIEWPORT_BIT);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_LIGHTING);
+        glDepthMask(GL_FALSE);
+        glActiveTexture(GL_TEXTURE0);
+        glEnable(GL_TEXTURE_2D);
+
+        RenderTarget* source = pool.Acquire(width, height, GL_RGBA8);
+        glBindTexture(GL_TEXTURE_2D, source->texture);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, vp[0], vp[1],
+                            width, height);
+
+        ScreenContext context;
+        context.depth = depth ? depth->texture : 0;
+        context.previousDepth = previousDepth ? previousDepth->texture : 0;
+        context.frame = frame;
+        context.width = width;
+        context.height = height;
+        context.pool = &pool;
+        if (!havePrevious) {
+            std::copy(modelview, modelview + 16, previousModelview);
+            std::copy(projection, projection + 16, previousProjection);
+        }
+        for (int i = 0; i < 16; i++) {
+            context.modelview[i] = modelview[i];
+            context.projection[i] = projection[i];
+            context.previousModelview[i] = previousModelview[i];
+            context.previousProjection[i] = previousProjection[i];
+        }
+        for (unsigned int i = 0; i < passes.size(); i++) {
+            RenderTarget* target = NULL;
+            if (i + 1 < passes.size()) {
+                target = pool.Acquire(width, height, GL_RGBA8);
+                context.output = target->fbo;
+                context.viewport[0] = context.viewport[1] = 0;
+                context.viewport[2] = width;
+                context.viewport[3] = height;
+            }
+            else {
+                context.output = output;
+                for (int v = 0; v < 4; v++) context.viewport[v] = vp[v];
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, context.output);
+            glViewport(context.viewport[0], context.viewport[1],
+                       context.viewport[2], context.viewport[3]);
+
+            context.color = source->texture;
+            glBindTexture(GL_TEXTURE_2D, source->texture);
+            passes[i]->Render(context);
+            pool.Release(source);
+            source = target;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, output);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glPopAttrib();
+
+        std::copy(modelview, modelview + 16, previousModelview);
+        std::copy(projection, projection + 16, previousProjection);
+        havePrevious = true;
+        frame++;
+        EndFrame();
+        GLDiagnostics::Check("screen pipeline");
+    }
+
+    // Screen aligned quad with texture coordinates in [0,1].
+    static void DrawQuad() {
+        glMatrixMode(GL_PROJECTION);
+        glPushMatrix();
+        glLoadIdentity();
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        glLoadIdentity();
+        glBegin(GL_QUADS);
+        glTexCoord2f(0, 0); glVertex2f(-1, -1);
+        glTexCoord2f(1, 0); glVertex2f( 1, -1);
+        glTexCoord2f(1, 1); glVertex2f( 1,  1);
+        glTexCoord2f(0, 1); glVertex2f(-1,  1);
+        glEnd();
+        glPopMatrix();
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+    }
+
+private:
+    std::vector<IScreenStage*> stages;
+    std::vector<IScreenStage*> enabled;
+    RenderTargetPool& pool;
+    RenderTarget *depth, *previousDepth;
+    float modelview[16], projection[16];
+    float previousModelview[16], previousProjection[16];
+    unsigned int frame;
+    bool havePrevious;
+
+    void EndFrame() {
+        pool.Release(previousDepth);
+        previousDepth = NULL;
+        if (NeedsPreviousDepth()) previousDepth = depth;
+        else pool.Release(depth);
+        depth = NULL;
+        pool.EndFrame();
+    }
+
+    // Asked every frame, temporal stages change their mind without
+    // being disabled.
+    bool NeedsDepth() {
+        for (unsigned int i = 0; i < enabled.size(); i++)
+            if (enabled[i]->NeedsDepth() || enabled[i]->NeedsPreviousDepth())
+                return true;
+        return false;
+    }
+
+    bool NeedsPreviousDepth() {
+        for (unsigned int i = 0; i < enabled.size(); i++)
+            if (enabled[i]->NeedsPreviousDepth()) return true;
+        return false;
+    }
+
+    void CollectEnabled() {
+        enabled.clear();
+        for (unsigned int i = 0; i < stages.size(); i++)
+            if (stages[i]->IsEnabled()) enabled.push_back(stages[i]);
+    }
+};
+
+#endif // _SCREEN_PIPELINE_H_
@@ -0,0 +1,476 @@
+// Shadow mapping with a cached static layer and a dynamic layer.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _SHADOW_STAGE_H_
+#define _SHADOW_STAGE_H_
+
+#include "Bounds.h"
+#include "GLDiagnostics.h"
+#include "GLMatrix.h"
+#include "InstancedMeshNode.h"
+#include "ProgramCache.h"
+#include "ScreenPipeline.h"
+#include "TransformCache.h"
+
+#include <Display/IViewingVolume.h>
+#include <Display/Viewport.h>
+#include <Math/Quaternion.h>
+#include <Math/Vector.h>
+#include <Renderers/OpenGL/IPostProcessingEffect.h>
+#include <Scene/RenderNode.h>
+#include <Scene/TransformationNode.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace OpenEngine::Math;
+using namespace OpenEngine::Renderers::OpenGL;
+
+// Something drawn into the shadow map.
+class IShadowCaster {
+public:
+    virtual ~IShadowCaster() {}
+    virtual BoundingSphere GetWorldBounds() = 0;
+    // Changes whenever the shadow of the caster may have changed.
+    virtual unsigned int GetVersion() = 0;
+    // Draw with the light's view in the modelview matrix.
+    virtual void DrawDepth() = 0;
+};
+
+// Render node placed by a transform cache slot. The cache is brought
+// up to date here too, in case the camera culled the node's list.
+class TransformedCaster : public IShadowCaster {
+public:
+    TransformedCaster(Scene::RenderNode* node, const BoundingSphere& local,
+                      TransformCache& transforms, unsigned int slot)
+        : node(node), local(local), transforms(transforms), slot(slot) {}
+
+    BoundingSphere GetWorldBounds() {
+        transforms.Update();
+        float c[4] = { local.center[0], local.center[1], local.center[2], 1.0f };
+        float w[4];
+        GLMatrix::Transform(transforms.GetWorld(slot), c, w);
+        BoundingSphere s = { { w[0], w[1], w[2] }, local.radius };
+        return s;
+    }
+
+    unsigned int GetVersion() {
+        transforms.Update();
+        return transforms.GetVersion(slot);
+    }
+
+    void DrawDepth() {
+        glPushMatrix();
+        glMultMatrixf(transforms.GetWorld(slot));
+        node->Apply(NULL);
+        glPopMatrix();
+    }
+
+private:
+    Scene::RenderNode* node;
+    BoundingSphere local;
+    TransformCache& transforms;
+    unsigned int slot;
+};
+
+// Instanced mesh node placed in the world frame.
+class InstancedCaster : public IShadowCaster {
+public:
+    InstancedCaster(InstancedMeshNode& node) : node(node) {}
+    BoundingSphere GetWorldBounds() { return node.GetBounds(); }
+    unsigned int GetVersion() { return node.GetVersion(); }
+    void DrawDepth() { node.Apply(NULL); }
+
+private:
+    InstancedMeshNode& node;
+};
+
+/**
+ * Shadows of a point light as a screen stage, an alternative to the
+ * Shadows effect for scenes where most casters stand still.
+ *
+ * Casters are split in two depth maps seen from the light. The static
+ * layer is kept from frame to frame and redrawn only where a static
+ * caster changed (the union of its old and new light space rectangle,
+ * scissored), or completely when the light moved or a caster left the
+ * fitted light frustum. The dynamic layer is cleared and redrawn every
+ * frame, but only inside the rectangles covered by dynamic casters now
+ * and in the previous frame. The screen pass reconstructs the world
+ * position of each pixel from the scene depth and compares it with the
+ * nearer of the two layers, so the cost of the depth passes follows
+ * what moved.
+ *
+ * The light is the position of a scene node, read every frame, and
+ * the camera matrices are those of the viewport's viewing volume.
+ *
+ * The maps are held from the pool while the stage is enabled and given
+ * back when it is disabled.
+ */
+class ShadowStage : public IScreenStage {
+public:
+    // Depth texels redrawn since the last TakeStats().
+    struct Stats {
+        unsigned int frames, staticUpdates;
+        unsigned long staticTexels, dynamicTexels;
+    };
+
+    ShadowStage(const string& name, IPostProcessingEffect* toggle,
+                ProgramCache& cache, Display::Viewport& viewport,
+                int size = 1024)
+        : name(name), toggle(toggle), cache(cache), viewport(viewport)
+        , size(size), program(0), lightNode(NULL), pool(NULL)
+        , staticMap(NULL), dynamicMap(NULL), fitted(false) {
+        light[0] = light[1] = light[2] = 0.0f;
+        Clear(lastDynamic);
+        stats.frames = stats.staticUpdates = 0;
+        stats.staticTexels = stats.dynamicTexels = 0;
+    }
+
+    ~ShadowStage() {
+        for (unsigned int i = 0; i < casters.size(); i++)
+            delete casters[i].caster;
+    }
+
+    // The node placing the light, e.g. the parent of its light node.
+    void SetLight(Scene::TransformationNode* node) {
+        lightNode = node;
+    }
+
+    // Takes over caster.
+    void AddCaster(IShadowCaster* caster, bool dynamic) {
+        Caster c;
+        c.caster = caster;
+        c.dynamic = dynamic;
+        c.version = caster->GetVersion();
+        Clear(c.rect);
+        casters.push_back(c);
+        fitted = false;
+    }
+
+    string GetName() const { return name; }
+
+    bool IsEnabled() {
+        bool enabled = toggle->GetEnabled();
+        if (!enabled && staticMap) ReleaseMaps();
+        return enabled;
+    }
+
+    bool IsReady() {
+        if (program == 0)
+            program = cache.Request(GLProgram::ScreenVertexShader(),
+                                    FragmentShader(), name);
+        return cache.IsReady(program);
+    }
+
+    // the screen pass projects every pixel into the light
+    bool NeedsDepth() { return true; }
+
+    Stats TakeStats() {
+        Stats s = stats;
+        stats.frames = stats.staticUpdates = 0;
+        stats.staticTexels = stats.dynamicTexels = 0;
+        return s;
+    }
+
+    void Render(ScreenContext& ctx) {
+        if (staticMap == NULL) {
+            pool = ctx.pool;
+            staticMap = pool->Acquire(size, size, GL_DEPTH_COMPONENT24);
+            dynamicMap = pool->Acquire(size, size, GL_DEPTH_COMPONENT24);
+            fitted = false;
+        }
+        stats.frames++;
+        if (lightNode) {
+            Vector<3,float> position;
+            Quaternion<float> rotation;
+            lightNode->GetAccumulatedTransformations(&position, &rotation);
+            MoveLight(position);
+        }
+        bool refit = Fit();
+        UpdateStatic(refit);
+        UpdateDynamic(refit);
+
+        // pixel in window coordinates to light texture coordinates
+        float viewProj[16], inverse[16], lightViewProj[16], bias[16];
+        float temp[16], screenToLight[16];
+        float view[16], projection[16];
+        Display::IViewingVolume* volume = viewport.GetViewingVolume();
+        if (volume) {
+            volume->GetViewMatrix().ToArray(view);
+            volume->GetProjectionMatrix().ToArray(projection);
+        }
+        else {
+            std::copy(ctx.modelview, ctx.modelview + 16, view);
+            std::copy(ctx.projection, ctx.projection + 16, projection);
+        }
+        GLMatrix::Multiply(projection, view, viewProj);
+        if (!GLMatrix::Invert(viewProj, inverse)) return;
+        GLMatrix::Multiply(lightProj, lightView, lightViewProj);
+        GLMatrix::Identity(bias);
+        bias[0] = bias[5] = bias[10] = 0.5f;
+        bias[12] = bias[13] = bias[14] = 0.5f;
+        GLMatrix::Multiply(bias, lightViewProj, temp);
+        GLMatrix::Multiply(temp, inverse, screenToLight);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, ctx.output);
+        glViewport(ctx.viewport[0], ctx.viewport[1],
+                   ctx.viewport[2], ctx.viewport[3]);
+        glUseProgram(program);
+        BindTexture("color", 0, ctx.color);
+        BindTexture("depth", 1, ctx.depth);
+        BindTexture("staticMap", 2, staticMap->texture);
+        BindTexture("dynamicMap", 3, dynamicMap->texture);
+        glUniformMatrix4fv(glGetUniformLocation(program, "screenToLight"),
+                           1, GL_FALSE, screenToLight);
+        glUniform1f(glGetUniformLocation(program, "texel"), 1.0f / size);
+        ScreenPipeline::DrawQuad();
+        glUseProgram(0);
+        glActiveTexture(GL_TEXTURE0);
+        GLDiagnostics::Check("shadows");
+    }
+
+private:
+    // Texel rectangle [x0,x1) x [y0,y1) of the maps.
+    struct Rect {
+        int x0, y0, x1, y1;
+    };
+
+    struct Caster {
+        IShadowCaster* caster;
+        bool dynamic;
+        unsigned int version;   // drawn into the static layer
+        Rect rect;              // where it was drawn last
+    };
+
+    string name;
+    IPostProcessingEffect* toggle;
+    ProgramCache& cache;
+    Display::Viewport& viewport;
+    int size;
+    GLuint program;
+    Scene::TransformationNode* lightNode;
+    RenderTargetPool* pool;
+    RenderTarget *staticMap, *dynamicMap;
+    std::vector<Caster> casters;
+    float light[3];
+    BoundingSphere fit;
+    bool fitted;
+    float lightView[16], lightProj[16];
+    Rect lastDynamic;
+    Stats stats;
+
+    static void Clear(Rect& r) { r.x0 = r.y0 = r.x1 = r.y1 = 0; }
+    static bool IsEmpty(const Rect& r) { return r.x0 >= r.x1 || r.y0 >= r.y1; }
+
+    static void Merge(Rect& r, const Rect& other) {
+        if (IsEmpty(other)) return;
+        if (IsEmpty(r)) {
+            r = other;
+            return;
+        }
+        r.x0 = std::min(r.x0, other.x0); r.y0 = std::min(r.y0, other.y0);
+        r.x1 = std::max(r.x1, other.x1); r.y1 = std::max(r.y1, other.y1);
+    }
+
+    static bool Overlaps(const Rect& a, const Rect& b) {
+        return a.x0 < b.x1 && b.x0 < a.x1 && a.y0 < b.y1 && b.y0 < a.y1;
+    }
+
+    Rect Full() const {
+        Rect r = { 0, 0, size, size };
+        return r;
+    }
+
+    void MoveLight(const Vector<3,float>& position) {
+        if (position[0] == light[0] && position[1] == light[1] &&
+            position[2] == light[2]) return;
+        light[0] = position[0]; light[1] = position[1]; light[2] = position[2];
+        fitted = false;
+    }
+
+    void ReleaseMaps() {
+        pool->Release(staticMap);
+        pool->Release(dynamicMap);
+        staticMap = dynamicMap = NULL;
+    }
+
+    void BindTexture(const char* uniform, int unit, GLuint texture) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glUniform1i(glGetUniformLocation(program, uniform), unit);
+    }
+
+    // Fits the light frustum around all casters, with some slack so
+    // moving casters do not force a refit every frame. True if the
+    // light matrices changed.
+    bool Fit() {
+        BoundingBox all;
+        all.Clear();
+        bool inside = fitted;
+        for (unsigned int i = 0; i < casters.size(); i++) {
+            BoundingSphere s = casters[i].caster->GetWorldBounds();
+            all.Add(s);
+            float d[3] = { s.center[0] - fit.center[0], s.center[1] - fit.center[1],
+                           s.center[2] - fit.center[2] };
+            if (std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) + s.radius > fit.radius)
+                inside = false;
+        }
+        if (inside || all.IsEmpty()) return false;
+
+        fit = all.GetSphere();
+        fit.radius *= 1.25f;
+        fitted = true;
+        float dir[3] = { fit.center[0] - light[0], fit.center[1] - light[1],
+                         fit.center[2] - light[2] };
+        float distance = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+        float up[3] = { 0.0f, 1.0f, 0.0f };
+        if (std::fabs(dir[1]) > 0.99f * distance) {
+            up[1] = 0.0f;
+            up[2] = 1.0f;
+        }
+        GLMatrix::LookAt(light, fit.center, up, lightView);
+        if (distance > fit.radius * 1.01f)
+            GLMatrix::Perspective(2.0f * std::asin(fit.radius / distance), 1.0f,
+                                  distance - fit.radius, distance + fit.radius,
+                                  lightProj);
+        else // light among the casters, the frustum can not hold them all
+            GLMatrix::Perspective(2.8f, 1.0f, 0.01f * fit.radius,
+                                  distance + fit.radius, lightProj);
+        return true;
+    }
+
+    // Conservative texel rectangle of a sphere seen from the light.
+    Rect Project(const BoundingSphere& s) const {
+        float c[4] = { s.center[0], s.center[1], s.center[2], 1.0f };
+        float e[4];
+        GLMatrix::Transform(lightView, c, e);
+        float z = -e[2];
+        float nearPlane = lightProj[14] / (lightProj[10] - 1.0f);
+        if (z - s.radius <= nearPlane) return Full();
+        float zs[2] = { z - s.radius, z + s.radius };
+        float lo[2] = { 1e30f, 1e30f }, hi[2] = { -1e30f, -1e30f };
+        const float scale[2] = { lightProj[0], lightProj[5] };
+        for (int a = 0; a < 2; a++)
+            for (int k = 0; k < 2; k++) {
+                float l = scale[a] * (e[a] - s.radius) / zs[k];
+                float h = scale[a] * (e[a] + s.radius) / zs[k];
+                lo[a] = std::min(lo[a], std::min(l, h));
+                hi[a] = std::max(hi[a], std::max(l, h));
+            }
+        Rect r;
+        r.x0 = std::max(0, (int)std::floor((lo[0] * 0.5f + 0.5f) * size) - 1);
+        r.y0 = std::max(0, (int)std::floor((lo[1] * 0.5f + 0.5f) * size) - 1);
+        r.x1 = std::min(size, (int)std::ceil((hi[0] * 0.5f + 0.5f) * size) + 1);
+        r.y1 = std::min(size, (int)std::ceil((hi[1] * 0.5f + 0.5f) * size) + 1);
+        if (IsEmpty(r)) Clear(r);
+        return r;
+    }
+
+    void UpdateStatic(bool full) {
+        Rect dirty;
+        Clear(dirty);
+        for (unsigned int i = 0; i < casters.size(); i++) {
+            Caster& c = casters[i];
+            if (c.dynamic) continue;
+            unsigned int version = c.caster->GetVersion();
+            if (!full && version == c.version) continue;
+            Rect now = Project(c.caster->GetWorldBounds());
+            Merge(dirty, c.rect);
+            Merge(dirty, now);
+            c.rect = now;
+            c.version = version;
+        }
+        if (full) dirty = Full();
+        if (IsEmpty(dirty)) return;
+        stats.staticUpdates++;
+        stats.staticTexels += (unsigned long)(dirty.x1 - dirty.x0) * (dirty.y1 - dirty.y0);
+        DrawLayer(staticMap, dirty, false);
+    }
+
+    void UpdateDynamic(bool full) {
+        Rect now;
+        Clear(now);
+        for (unsigned int i = 0; i < casters.size(); i++) {
+            Caster& c = casters[i];
+            if (!c.dynamic) continue;
+            c.rect = Project(c.caster->GetWorldBounds());
+            Merge(now, c.rect);
+        }
+        Rect dirty = now;
+        Merge(dirty, lastDynamic);
+        if (full) dirty = Full();
+        lastDynamic = now;
+        if (IsEmpty(dirty)) return;
+        stats.dynamicTexels += (unsigned long)(dirty.x1 - dirty.x0) * (dirty.y1 - dirty.y0);
+        DrawLayer(dynamicMap, dirty, true);
+    }
+
+    // Clears rect of the layer and draws the casters touching it.
+    void DrawLayer(RenderTarget* target, const Rect& rect, bool dynamic) {
+        glPushAttrib(GL_ENABLE_BIT | GL_DEPTH_BUFFER_BIT | GL_SCISSOR_BIT |
+                     GL_POLYGON_BIT | GL_VIEWPORT_BIT);
+        glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+        glViewport(0, 0, size, size);
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(rect.x0, rect.y0, rect.x1 - rect.x0, rect.y1 - rect.y0);
+        glDepthMask(GL_TRUE);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_LESS);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+
+        glMatrixMode(GL_PROJECTION);
+        glPushMatrix();
+        glLoadMatrixf(lightProj);
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        glLoadMatrixf(lightView);
+        for (unsigned int i = 0; i < casters.size(); i++)
+            if (casters[i].dynamic == dynamic && Overlaps(casters[i].rect, rect))
+                casters[i].caster->DrawDepth();
+        glPopMatrix();
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+        glPopAttrib();
+    }
+
+    static string FragmentShader() {
+        return
+            "uniform sampler2D color;\n"
+            "uniform sampler2D depth;\n"
+            "uniform sampler2D staticMap;\n"
+            "uniform sampler2D dynamicMap;\n"
+            "uniform mat4 screenToLight;\n"
+            "uniform float texel;\n"
+            "float occluder(vec2 uv) {\n"
+            "  return min(texture2D(staticMap, uv).r, texture2D(dynamicMap, uv).r);\n"
+            "}\n"
+            "void main() {\n"
+            "  vec2 uv = gl_TexCoord[0].st;\n"
+            "  vec4 c = texture2D(color, uv);\n"
+            "  float d = texture2D(depth, uv).r;\n"
+            "  vec4 p = screenToLight * vec4(vec3(uv, d) * 2.0 - 1.0, 1.0);\n"
+            "  p.xyz /= p.w;\n"
+            "  float lit = 1.0;\n"
+            "  if (d < 1.0 && p.w > 0.0 && all(greaterThan(p.xyz, vec3(0.0))) &&\n"
+            "      all(lessThan(p.xyz, vec3(1.0)))) {\n"
+            "    float z = p.z - 0.001;\n"
+            "    lit = 0.25 * (step(z, occluder(p.xy + vec2(-0.5, -0.5) * texel)) +\n"
+            "                  step(z, occluder(p.xy + vec2( 0.5, -0.5) * texel)) +\n"
+            "                  step(z, occluder(p.xy + vec2(-0.5,  0.5) * texel)) +\n"
+            "                  step(z, occluder(p.xy + vec2( 0.5,  0.5) * texel)));\n"
+            "  }\n"
+            "  gl_FragColor = vec4(c.rgb * (0.5 + 0.5 * lit), c.a);\n"
+            "}\n";
+    }
+};
+
+#endif // _SHADOW_STAGE_H_
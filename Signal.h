@@ -0,0 +1,80 @@
+// Wake-up signal between threads.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _SIGNAL_H_
+#define _SIGNAL_H_
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+/**
+ * Lets a thread sleep until another one has work for it.
+ *
+ * Behaves like an auto reset event: Set() wakes a thread blocked in
+ * Wait(), or, if none is, lets the next Wait() return at once. Several
+ * Set() before a Wait() count as one, so the waiting side has to
+ * recheck its condition after waking, and a Set() between its check
+ * and its Wait() is never lost.
+ */
+class Signal {
+public:
+    Signal() : set(false) {
+#ifdef _WIN32
+        event = CreateEvent(NULL, FALSE, FALSE, NULL);
+#else
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&cond, NULL);
+#endif
+    }
+
+    ~Signal() {
+#ifdef _WIN32
+        CloseHandle(event);
+#else
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+#endif
+    }
+
+    void Set() {
+#ifdef _WIN32
+        SetEvent(event);
+#else
+        pthread_mutex_lock(&mutex);
+        set = true;
+        pthread_cond_signal(&cond);
+        pthread_mutex_unlock(&mutex);
+#endif
+    }
+
+    void Wait() {
+#ifdef _WIN32
+        WaitForSingleObject(event, INFINITE);
+#else
+        pthread_mutex_lock(&mutex);
+        while (!set) pthread_cond_wait(&cond, &mutex);
+        set = false;
+        pthread_mutex_unlock(&mutex);
+#endif
+    }
+
+private:
+    bool set;
+#ifdef _WIN32
+    HANDLE event;
+#else
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif
+};
+
+#endif // _SIGNAL_H_
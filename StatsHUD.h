@@ -0,0 +1,181 @@
+// Culling statistics drawn over the finished frame.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _STATS_HUD_H_
+#define _STATS_HUD_H_
+
+#include "CullNode.h"
+
+#include <Core/IListener.h>
+#include <Devices/IKeyboard.h>
+#include <Display/IFrame.h>
+#include <Renderers/IRenderer.h>
+#include <Meta/OpenGL.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace OpenEngine;
+using namespace OpenEngine::Core;
+using namespace OpenEngine::Devices;
+using namespace OpenEngine::Display;
+using namespace OpenEngine::Renderers;
+using std::string;
+
+/**
+ * Shows what the culling hierarchy visits and draws, in the upper
+ * left corner of the window.
+ *
+ * The counts are averaged per pass over the last REFRESH frames; a
+ * frame has a pass for the camera and one per shadow map drawn. The
+ * text uses a built in 3x5 pixel font, drawn as quads after every
+ * other post render listener, so it is not in captures or golden
+ * images. F10 shows and hides it.
+ */
+class StatsHUD : public IListener<RenderingEventArg>
+               , public IListener<KeyboardEventArg> {
+public:
+    StatsHUD(IFrame& frame, CullNode& culling, bool visible = true)
+        : frame(frame), culling(culling), visible(visible), frames(0) {
+        last = culling.GetStats();
+    }
+
+    void Handle(RenderingEventArg arg) {
+        if (++frames >= REFRESH) Update();
+        if (visible && !lines.empty()) Draw();
+    }
+
+    void Handle(KeyboardEventArg arg) {
+        if (arg.type == EVENT_PRESS && arg.sym == KEY_F10) visible = !visible;
+    }
+
+private:
+    static const unsigned int REFRESH = 30;
+    static const int PIXEL = 2;             // screen pixels per font pixel
+    static const int MARGIN = 8;
+
+    IFrame& frame;
+    CullNode& culling;
+    bool visible;
+    unsigned int frames;
+    CullNode::Stats last;
+    std::vector<string> lines;
+
+    void Update() {
+        CullNode::Stats now = culling.GetStats();
+        unsigned int passes = now.passes - last.passes;
+        lines.clear();
+        char line[64];
+        snprintf(line, sizeof(line), "cull: %u subtrees", now.entries);
+        lines.push_back(line);
+        if (passes) {
+            snprintf(line, sizeof(line), "%.1f visited %.1f drawn per pass",
+                     (double)(now.visited - last.visited) / passes,
+                     (double)(now.drawn - last.drawn) / passes);
+            lines.push_back(line);
+        }
+        last = now;
+        frames = 0;
+    }
+
+    void Draw() {
+        const int width = frame.GetWidth(), height = frame.GetHeight();
+        glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT | GL_VIEWPORT_BIT |
+                     GL_TRANSFORM_BIT | GL_COLOR_BUFFER_BIT);
+        glUseProgram(0);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_LIGHTING);
+        glDisable(GL_TEXTURE_2D);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glViewport(0, 0, width, height);
+        glMatrixMode(GL_PROJECTION);
+        glPushMatrix();
+        glLoadIdentity();
+        glOrtho(0, width, 0, height, -1, 1);
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        glLoadIdentity();
+
+        const int advance = 4 * PIXEL, leading = 7 * PIXEL;
+        const int count = lines.size();
+        int longest = 0;
+        for (int i = 0; i < count; i++)
+            longest = std::max<int>(longest, lines[i].size());
+        const int top = height - MARGIN;
+        glBegin(GL_QUADS);
+        glColor4f(0.0f, 0.0f, 0.0f, 0.5f);
+        Quad(MARGIN - PIXEL * 2, top - count * leading,
+             MARGIN + longest * advance + PIXEL, top + PIXEL * 2);
+        glColor4f(1.0f, 1.0f, 1.0f, 1.0f);
+        for (int i = 0; i < count; i++) {
+            int y = top - PIXEL * 5 - i * leading;
+            for (int c = 0; c < (int)lines[i].size(); c++)
+                Glyph(lines[i][c], MARGIN + c * advance, y);
+        }
+        glEnd();
+
+        glPopMatrix();
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+        glPopAttrib();
+    }
+
+    static void Quad(int x0, int y0, int x1, int y1) {
+        glVertex2i(x0, y0);
+        glVertex2i(x1, y0);
+        glVertex2i(x1, y1);
+        glVertex2i(x0, y1);
+    }
+
+    // Draws c with its lower left corner at x, y; inside glBegin.
+    static void Glyph(char c, int x, int y) {
+        const char* rows = Pixels(toupper(c));
+        if (rows == NULL) return;
+        for (int row = 0; row < 5; row++)
+            for (int col = 0; col < 3; col++)
+                if (rows[row * 3 + col] == '1')
+                    Quad(x + col * PIXEL, y + (4 - row) * PIXEL,
+                         x + (col + 1) * PIXEL, y + (5 - row) * PIXEL);
+    }
+
+    // Rows of the glyph from the top, NULL for blanks and unknowns.
+    static const char* Pixels(int c) {
+        static const char* digits[10] = {
+            "111101101101111", "010110010010111", "111001111100111",
+            "111001111001111", "101101111001001", "111100111001111",
+            "111100111101111", "111001001001001", "111101111101111",
+            "111101111001111" };
+        static const char* letters[26] = {
+            "010101111101101", "110101110101110", "011100100100011",
+            "110101101101110", "111100110100111", "111100110100100",
+            "011100101101011", "101101111101101", "111010010010111",
+            "001001001101010", "101101110101101", "100100100100111",
+            "101111111101101", "110101101101101", "010101101101010",
+            "110101110100100", "010101101110011", "110101110101101",
+            "011100010001110", "111010010010010", "101101101101111",
+            "101101101101010", "101101111111101", "101101010101101",
+            "101101010010010", "111001010100111" };
+        if (c >= '0' && c <= '9') return digits[c - '0'];
+        if (c >= 'A' && c <= 'Z') return letters[c - 'A'];
+        switch (c) {
+        case '.': return "000000000000010";
+        case ':': return "000010000010000";
+        case '/': return "001001010100100";
+        case '-': return "000000111000000";
+        case '%': return "101001010100101";
+        default:  return NULL;
+        }
+    }
+};
+
+#endif // _STATS_HUD_H_
@@ -0,0 +1,299 @@
+// Texture uploads spread over frames through a pixel buffer ring.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _STREAMING_TEXTURE_LOADER_H_
+#define _STREAMING_TEXTURE_LOADER_H_
+
+#include "Atomic.h"
+#include "GLDiagnostics.h"
+#include "ImageDecoder.h"
+#include "ThreadPool.h"
+
+#include <Core/IEngine.h>
+#include <Core/IListener.h>
+#include <Logging/Logger.h>
+#include <Renderers/IRenderer.h>
+#include <Meta/OpenGL.h>
+#include <Utils/Timer.h>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace OpenEngine;
+using namespace OpenEngine::Core;
+using namespace OpenEngine::Renderers;
+using std::string;
+
+/**
+ * A texture arriving level by level. GetTexture() is 0 until the
+ * coarsest level is on the GPU; from then on the texture can be
+ * bound and sharpens as finer levels follow.
+ */
+class StreamedTexture {
+public:
+    enum State { DECODING, DECODED, FAILED };
+
+    StreamedTexture(const string& path)
+        : path(path), state(DECODING), texture(0), level(0), row(0), base(0) {}
+
+    const string& GetPath() const { return path; }
+    GLuint GetTexture() const {
+        if (Atomic::Load(&state) != DECODED) return 0;
+        return base < (int)levels.size() ? texture : 0;
+    }
+    // Finest level on the GPU, the level count while none is.
+    int GetResidentLevel() const { return base; }
+    bool IsComplete() const { return texture && base == 0; }
+
+private:
+    friend class StreamingTextureLoader;
+
+    string path;
+    mutable volatile int state;     // set by the decode job
+    std::vector<ImageLevel> levels;
+    GLuint texture;
+    int level, row, base;   // level and row uploaded next
+};
+
+/**
+ * Replaces synchronous texture uploads inside the frame with a
+ * budgeted stream.
+ *
+ * Files are decoded and mipmapped on a thread pool. Once per frame,
+ * before the scene, the decoded textures are uploaded in bands of
+ * rows, coarsest level first, until the byte or the time budget of
+ * the frame is spent (one band always goes, so nothing starves).
+ * GL_TEXTURE_BASE_LEVEL follows the finest complete level, so the
+ * texture is usable from its 1x1 level on.
+ *
+ * Bands are staged through a ring of pixel unpack buffer slots. With
+ * ARB_buffer_storage the ring is mapped persistently once and every
+ * slot is guarded by a fence; when the slot to be written is still
+ * being read by the GPU the frame's uploads stop there. Without it a
+ * single buffer is orphaned and mapped per band, and without pixel
+ * buffer objects the bands are sent from client memory.
+ */
+class StreamingTextureLoader : public IListener<RenderingEventArg>
+                             , public IListener<DeinitializeEventArg> {
+public:
+    StreamingTextureLoader(unsigned int budgetBytes = 1 << 20,
+                           unsigned int budgetMicros = 2000,
+                           unsigned int threads = 2)
+        : budgetBytes(budgetBytes), budgetMicros(budgetMicros), pool(threads)
+        , mode(UNKNOWN), buffer(0), mapped(NULL), next(0)
+        , uploaded(0), frames(0), limited(0), stalls(0) {
+        for (unsigned int i = 0; i < RING; i++) fences[i] = 0;
+    }
+
+    ~StreamingTextureLoader() {
+        pool.Finish();
+        for (unsigned int i = 0; i < textures.size(); i++)
+            delete textures[i];
+    }
+
+    StreamedTexture* Load(const string& path) {
+        StreamedTexture* texture = new StreamedTexture(path);
+        textures.push_back(texture);
+        pool.Add(new DecodeJob(*texture));
+        return texture;
+    }
+
+    void SetBudget(unsigned int bytes, unsigned int micros) {
+        budgetBytes = bytes;
+        budgetMicros = micros;
+    }
+
+    void Handle(RenderingEventArg arg) {
+        if (mode == UNKNOWN) Initialize();
+        unsigned long long start = Utils::Timer::GetTime().AsInt();
+        unsigned int bytes = 0;
+        bool any = false, stop = false;
+        for (unsigned int i = 0; i < textures.size() && !stop; i++) {
+            StreamedTexture& t = *textures[i];
+            if (t.base == 0 && t.texture) continue;
+            if (Atomic::Load(&t.state) != StreamedTexture::DECODED) continue;
+            while (t.base > 0 || t.texture == 0) {
+                if (any && (bytes >= budgetBytes ||
+                            Utils::Timer::GetTime().AsInt() - start >= budgetMicros)) {
+                    limited++;
+                    stop = true;
+                    break;
+                }
+                unsigned int sent = UploadBand(t);
+                if (sent == 0) {
+                    stalls++;
+                    stop = true;
+                    break;
+                }
+                bytes += sent;
+                any = true;
+            }
+        }
+        if (any) {
+            uploaded += bytes;
+            frames++;
+        }
+    }
+
+    void Handle(DeinitializeEventArg arg) {
+        pool.Finish();
+        for (unsigned int i = 0; i < RING; i++)
+            if (fences[i]) glDeleteSync(fences[i]);
+        if (buffer) {
+            if (mapped) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+            glDeleteBuffers(1, &buffer);
+        }
+        for (unsigned int i = 0; i < textures.size(); i++)
+            if (textures[i]->texture) glDeleteTextures(1, &textures[i]->texture);
+        if (frames)
+            logger.info << "Streamed " << uploaded / 1024 << " KB of textures in "
+                        << frames << " frames, " << limited
+                        << " frames over budget, " << stalls
+                        << " ring stalls" << logger.end;
+    }
+
+private:
+    enum Mode { UNKNOWN, PERSISTENT, ORPHAN, CLIENT };
+    static const unsigned int RING = 4;
+    static const unsigned int SLOT = 1 << 20;
+
+    class DecodeJob : public IJob {
+    public:
+        DecodeJob(StreamedTexture& texture) : texture(texture) {}
+        void Run() {
+            bool ok = ImageDecoder::Decode(texture.path, texture.levels);
+            if (!ok)
+                logger.error << "Can not decode texture '" << texture.path
+                             << "'" << logger.end;
+            else {
+                texture.level = texture.base = texture.levels.size();
+                texture.level--;
+            }
+            Atomic::Store(&texture.state, ok ? StreamedTexture::DECODED
+                                             : StreamedTexture::FAILED);
+        }
+    private:
+        StreamedTexture& texture;
+    };
+
+    unsigned int budgetBytes, budgetMicros;
+    ThreadPool pool;
+    std::vector<StreamedTexture*> textures;
+    Mode mode;
+    GLuint buffer;
+    unsigned char* mapped;
+    GLsync fences[RING];
+    unsigned int next;
+    unsigned long long uploaded;
+    unsigned int frames, limited, stalls;
+
+    void Initialize() {
+        mode = CLIENT;
+        if (GLEW_ARB_buffer_storage && GLEW_ARB_sync) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+                GL_MAP_COHERENT_BIT;
+            glGenBuffers(1, &buffer);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, RING * SLOT, NULL, flags);
+            mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+                                                      RING * SLOT, flags);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            if (mapped) mode = PERSISTENT;
+            else {
+                glDeleteBuffers(1, &buffer);
+                buffer = 0;
+            }
+        }
+        if (mode == CLIENT && (GLEW_VERSION_2_1 || GLEW_ARB_pixel_buffer_object)) {
+            glGenBuffers(1, &buffer);
+            mode = ORPHAN;
+        }
+    }
+
+    // Allocates every level, none of them visible yet.
+    static void Create(StreamedTexture& t) {
+        glGenTextures(1, &t.texture);
+        glBindTexture(GL_TEXTURE_2D, t.texture);
+        for (unsigned int l = 0; l < t.levels.size(); l++)
+            glTexImage2D(GL_TEXTURE_2D, l, GL_RGBA8, t.levels[l].width,
+                         t.levels[l].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, t.levels.size() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, t.levels.size() - 1);
+    }
+
+    // Sends the next band of rows of t, returns the bytes sent or 0
+    // if the ring slot is still in use.
+    unsigned int UploadBand(StreamedTexture& t) {
+        if (t.texture == 0) Create(t);
+        ImageLevel& level = t.levels[t.level];
+        const unsigned int rowBytes = 4 * level.width;
+        const int rows = std::min<int>(level.height - t.row,
+                                       std::max(1u, SLOT / rowBytes));
+        const unsigned int size = rows * rowBytes;
+        const unsigned char* source = &level.pixels[rowBytes * t.row];
+        const GLvoid* pixels = source;
+
+        glBindTexture(GL_TEXTURE_2D, t.texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if (mode == PERSISTENT && size <= SLOT) {
+            if (fences[next]) {
+                if (glClientWaitSync(fences[next], 0, 0) == GL_TIMEOUT_EXPIRED)
+                    return 0;
+                glDeleteSync(fences[next]);
+                fences[next] = 0;
+            }
+            std::memcpy(mapped + next * SLOT, source, size);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+            pixels = (const GLvoid*)(size_t)(next * SLOT);
+        }
+        else if (mode == ORPHAN && size <= SLOT) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, SLOT, NULL, GL_STREAM_DRAW);
+            void* target = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+            if (target) {
+                std::memcpy(target, source, size);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                pixels = NULL;
+            }
+            else glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, t.level, 0, t.row, level.width, rows,
+                        GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        if (mode == PERSISTENT && size <= SLOT) {
+            fences[next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            next = (next + 1) % RING;
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        t.row += rows;
+        if (t.row == level.height) {
+            // the level is complete and becomes the finest one shown
+            std::vector<unsigned char>().swap(level.pixels);
+            t.base = t.level;
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, t.base);
+            t.level--;
+            t.row = 0;
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        GLDiagnostics::Check("texture streaming");
+        return size;
+    }
+};
+
+#endif // _STREAMING_TEXTURE_LOADER_H_
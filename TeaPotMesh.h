@@ -0,0 +1,237 @@
+// Tessellated teapot geometry shared between teapot nodes.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _TEA_POT_MESH_H_
+#define _TEA_POT_MESH_H_
+
+#include "MeshBuffer.h"
+#include "BezierPatch.h"
+
+#include <map>
+#include <utility>
+
+//from: http://www.google.com/codesearch/p?hl=en#DeBRMSuGYX0/Mesa-5.0/widgets-mesa/demos/tea.c&q=glutSolidTeapot&l=733
+
+static const long patchdata[][16] =
+{
+    /* rim */
+  {102, 103, 104, 105, 4, 5, 6, 7, 8, 9, 10, 11,
+    12, 13, 14, 15},
+    /* body */
+  {12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23,
+    24, 25, 26, 27},
+  {24, 25, 26, 27, 29, 30, 31, 32, 33, 34, 35, 36,
+    37, 38, 39, 40},
+    /* lid */
+  {96, 96, 96, 96, 97, 98, 99, 100, 101, 101, 101,
+    101, 0, 1, 2, 3,},
+  {0, 1, 2, 3, 106, 107, 108, 109, 110, 111, 112,
+    113, 114, 115, 116, 117},
+    /* bottom */
+  {118, 118, 118, 118, 124, 122, 119, 121, 123, 126,
+    125, 120, 40, 39, 38, 37},
+    /* handle */
+  {41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52,
+    53, 54, 55, 56},
+  {53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63, 64,
+    28, 65, 66, 67},
+    /* spout */
+  {68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78, 79,
+    80, 81, 82, 83},
+  {80, 81, 82, 83, 84, 85, 86, 87, 88, 89, 90, 91,
+    92, 93, 94, 95}
+};
+/* *INDENT-OFF* */
+
+static const float cpdata[][3] =
+{
+    {0.2, 0, 2.7}, {0.2, -0.112, 2.7}, {0.112, -0.2, 2.7}, {0,
+    -0.2, 2.7}, {1.3375, 0, 2.53125}, {1.3375, -0.749, 2.53125},
+    {0.749, -1.3375, 2.53125}, {0, -1.3375, 2.53125}, {1.4375,
+    0, 2.53125}, {1.4375, -0.805, 2.53125}, {0.805, -1.4375,
+    2.53125}, {0, -1.4375, 2.53125}, {1.5, 0, 2.4}, {1.5, -0.84,
+    2.4}, {0.84, -1.5, 2.4}, {0, -1.5, 2.4}, {1.75, 0, 1.875},
+    {1.75, -0.98, 1.875}, {0.98, -1.75, 1.875}, {0, -1.75,
+    1.875}, {2, 0, 1.35}, {2, -1.12, 1.35}, {1.12, -2, 1.35},
+    {0, -2, 1.35}, {2, 0, 0.9}, {2, -1.12, 0.9}, {1.12, -2,
+    0.9}, {0, -2, 0.9}, {-2, 0, 0.9}, {2, 0, 0.45}, {2, -1.12,
+    0.45}, {1.12, -2, 0.45}, {0, -2, 0.45}, {1.5, 0, 0.225},
+    {1.5, -0.84, 0.225}, {0.84, -1.5, 0.225}, {0, -1.5, 0.225},
+    {1.5, 0, 0.15}, {1.5, -0.84, 0.15}, {0.84, -1.5, 0.15}, {0,
+    -1.5, 0.15}, {-1.6, 0, 2.025}, {-1.6, -0.3, 2.025}, {-1.5,
+    -0.3, 2.25}, {-1.5, 0, 2.25}, {-2.3, 0, 2.025}, {-2.3, -0.3,
+    2.025}, {-2.5, -0.3, 2.25}, {-2.5, 0, 2.25}, {-2.7, 0,
+    2.025}, {-2.7, -0.3, 2.025}, {-3, -0.3, 2.25}, {-3, 0,
+    2.25}, {-2.7, 0, 1.8}, {-2.7, -0.3, 1.8}, {-3, -0.3, 1.8},
+    {-3, 0, 1.8}, {-2.7, 0, 1.575}, {-2.7, -0.3, 1.575}, {-3,
+    -0.3, 1.35}, {-3, 0, 1.35}, {-2.5, 0, 1.125}, {-2.5, -0.3,
+    1.125}, {-2.65, -0.3, 0.9375}, {-2.65, 0, 0.9375}, {-2,
+    -0.3, 0.9}, {-1.9, -0.3, 0.6}, {-1.9, 0, 0.6}, {1.7, 0,
+    1.425}, {1.7, -0.66, 1.425}, {1.7, -0.66, 0.6}, {1.7, 0,
+    0.6}, {2.6, 0, 1.425}, {2.6, -0.66, 1.425}, {3.1, -0.66,
+    0.825}, {3.1, 0, 0.825}, {2.3, 0, 2.1}, {2.3, -0.25, 2.1},
+    {2.4, -0.25, 2.025}, {2.4, 0, 2.025}, {2.7, 0, 2.4}, {2.7,
+    -0.25, 2.4}, {3.3, -0.25, 2.4}, {3.3, 0, 2.4}, {2.8, 0,
+    2.475}, {2.8, -0.25, 2.475}, {3.525, -0.25, 2.49375},
+    {3.525, 0, 2.49375}, {2.9, 0, 2.475}, {2.9, -0.15, 2.475},
+    {3.45, -0.15, 2.5125}, {3.45, 0, 2.5125}, {2.8, 0, 2.4},
+    {2.8, -0.15, 2.4}, {3.2, -0.15, 2.4}, {3.2, 0, 2.4}, {0, 0,
+    3.15}, {0.8, 0, 3.15}, {0.8, -0.45, 3.15}, {0.45, -0.8,
+    3.15}, {0, -0.8, 3.15}, {0, 0, 2.85}, {1.4, 0, 2.4}, {1.4,
+    -0.784, 2.4}, {0.784, -1.4, 2.4}, {0, -1.4, 2.4}, {0.4, 0,
+    2.55}, {0.4, -0.224, 2.55}, {0.224, -0.4, 2.55}, {0, -0.4,
+    2.55}, {1.3, 0, 2.55}, {1.3, -0.728, 2.55}, {0.728, -1.3,
+    2.55}, {0, -1.3, 2.55}, {1.3, 0, 2.4}, {1.3, -0.728, 2.4},
+    {0.728, -1.3, 2.4}, {0, -1.3, 2.4}, {0, 0, 0}, {1.425,
+    -0.798, 0}, {1.5, 0, 0.075}, {1.425, 0, 0}, {0.798, -1.425,
+    0}, {0, -1.5, 0.075}, {0, -1.425, 0}, {1.5, -0.84, 0.075},
+    {0.84, -1.5, 0.075}
+};
+
+// Number of patches after mirroring the patch table.
+static const int TEAPOT_PATCHES = 32;
+// Bounding sphere radius around the origin at scale 1.
+static const float TEAPOT_RADIUS = 1.8f;
+
+/**
+ * Tessellates the Bezier teapot into a MeshBuffer.
+ *
+ * The result matches what the GL evaluator path produced: the same
+ * patch mirroring, the same (u,v) grid, auto normals from the
+ * partial derivatives and the same model transformation, baked into
+ * the vertices. Meshes are cached per (grid, scale) and reference
+ * counted, so every node with the same parameters shares one set of
+ * buffer objects.
+ */
+class TeaPotMesh {
+public:
+    static MeshBuffer* Acquire(int grid, float scale) {
+        Key key(grid, scale);
+        Cache& cache = GetCache();
+        Cache::iterator itr = cache.find(key);
+        if (itr == cache.end()) {
+            Entry entry;
+            std::vector<MeshVertex> vertices;
+            std::vector<GLuint> indices;
+            Tessellate(grid, scale, vertices, indices);
+            entry.mesh = new MeshBuffer(vertices, indices);
+            entry.refs = 0;
+            itr = cache.insert(std::make_pair(key, entry)).first;
+        }
+        itr->second.refs++;
+        return itr->second.mesh;
+    }
+
+    static void Release(MeshBuffer* mesh) {
+        Cache& cache = GetCache();
+        for (Cache::iterator itr = cache.begin(); itr != cache.end(); ++itr) {
+            if (itr->second.mesh != mesh) continue;
+            if (--itr->second.refs == 0) {
+                delete itr->second.mesh;
+                cache.erase(itr);
+            }
+            return;
+        }
+    }
+
+    // Expand the patch table into the 32 mirrored control nets.
+    static void BuildPatches(float patches[TEAPOT_PATCHES][4][4][3]) {
+        int n = 0;
+        for (int i = 0; i < 10; i++) {
+            float (*p)[4][3] = patches[n++];
+            float (*q)[4][3] = patches[n++];
+            float (*r)[4][3] = i < 6 ? patches[n++] : NULL;
+            float (*s)[4][3] = i < 6 ? patches[n++] : NULL;
+            for (int j = 0; j < 4; j++) {
+                for (int k = 0; k < 4; k++) {
+                    const float* a = cpdata[patchdata[i][j * 4 + k]];
+                    const float* b = cpdata[patchdata[i][j * 4 + (3 - k)]];
+                    for (int l = 0; l < 3; l++) {
+                        p[j][k][l] = a[l];
+                        q[j][k][l] = l == 1 ? -b[l] : b[l];
+                        if (r) {
+                            r[j][k][l] = l == 0 ? -b[l] : b[l];
+                            s[j][k][l] = l < 2 ? -a[l] : a[l];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Triangle list of the teapot at grid segments per patch side.
+    static void Tessellate(int grid, float scale,
+                           std::vector<MeshVertex>& vertices,
+                           std::vector<GLuint>& indices) {
+        float patches[TEAPOT_PATCHES][4][4][3];
+        BuildPatches(patches);
+
+        const int side = grid + 1;
+        vertices.assign(TEAPOT_PATCHES * side * side, MeshVertex());
+        indices.clear();
+        indices.reserve(TEAPOT_PATCHES * grid * grid * 6);
+
+        std::vector<BezierSample> samples(vertices.size());
+        BezierPatchBatch(patches, TEAPOT_PATCHES).EvaluateGrid(grid, &samples[0]);
+
+        const float k = 0.5f * scale;
+        const float step = 1.0f / grid;
+        for (int n = 0; n < TEAPOT_PATCHES; n++) {
+            GLuint first = n * side * side;
+            for (int i = 0; i <= grid; i++) {
+                for (int j = 0; j <= grid; j++) {
+                    const BezierSample& s = samples[first + i * side + j];
+                    const float* p = s.position;
+                    const float* nm = s.normal;
+
+                    // bake the old fixed function transformation:
+                    // rotate 90 about y, 90 about x, scale, translate
+                    MeshVertex& vx = vertices[first + i * side + j];
+                    vx.position[0] =  k * p[1];
+                    vx.position[1] = -k * (p[2] - 1.5f);
+                    vx.position[2] = -k * p[0];
+                    vx.normal[0] =  nm[1];
+                    vx.normal[1] = -nm[2];
+                    vx.normal[2] = -nm[0];
+                    vx.texcoord[0] = i * step;
+                    vx.texcoord[1] = j * step;
+                }
+            }
+            // same winding as the quad strips of glEvalMesh2, which
+            // visit (u,v), (u,v+1), (u+1,v+1), (u+1,v)
+            for (int i = 0; i < grid; i++) {
+                for (int j = 0; j < grid; j++) {
+                    GLuint a0 = first + i * side + j,  a1 = a0 + 1;
+                    GLuint b0 = a0 + side,             b1 = b0 + 1;
+                    indices.push_back(a0);
+                    indices.push_back(a1);
+                    indices.push_back(b1);
+                    indices.push_back(a0);
+                    indices.push_back(b1);
+                    indices.push_back(b0);
+                }
+            }
+        }
+    }
+
+private:
+    typedef std::pair<int, float> Key;
+    struct Entry {
+        MeshBuffer* mesh;
+        unsigned int refs;
+    };
+    typedef std::map<Key, Entry> Cache;
+
+    static Cache& GetCache() {
+        static Cache cache;
+        return cache;
+    }
+};
+
+#endif // _TEA_POT_MESH_H_
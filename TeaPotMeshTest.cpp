@@ -0,0 +1,70 @@
+// Checks of the teapot tessellation.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#include "TeaPotMesh.h"
+#include "TestCheck.h"
+
+static float Dot(const float a[3], const float b[3]) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void TestSize(int grid) {
+    std::vector<MeshVertex> vertices;
+    std::vector<GLuint> indices;
+    TeaPotMesh::Tessellate(grid, 1.0f, vertices, indices);
+    const unsigned int side = grid + 1;
+    CHECK(vertices.size() == TEAPOT_PATCHES * side * side);
+    CHECK(indices.size() == (unsigned int)TEAPOT_PATCHES * grid * grid * 6);
+    bool inRange = true;
+    for (unsigned int i = 0; i < indices.size(); i++)
+        inRange = inRange && indices[i] < vertices.size();
+    CHECK(inRange);
+    // the model transformation is baked in, so the bounding radius of
+    // the nodes holds for the vertices
+    bool inside = true;
+    for (unsigned int i = 0; i < vertices.size(); i++)
+        inside = inside && Dot(vertices[i].position, vertices[i].position)
+            <= TEAPOT_RADIUS * TEAPOT_RADIUS;
+    CHECK(inside);
+}
+
+// glEvalMesh2 draws quad strips through (u,v), (u,v+1), (u+1,v+1),
+// (u+1,v), so its front faces turn along dP/dv x dP/du, against the
+// auto normal. Every triangle with an area has to do the same.
+static void TestWinding(int grid) {
+    std::vector<MeshVertex> vertices;
+    std::vector<GLuint> indices;
+    TeaPotMesh::Tessellate(grid, 1.0f, vertices, indices);
+    unsigned int checked = 0, against = 0;
+    for (unsigned int t = 0; t < indices.size(); t += 3) {
+        const MeshVertex& a = vertices[indices[t]];
+        const MeshVertex& b = vertices[indices[t + 1]];
+        const MeshVertex& c = vertices[indices[t + 2]];
+        float e1[3], e2[3], face[3], normal[3];
+        for (int l = 0; l < 3; l++) {
+            e1[l] = b.position[l] - a.position[l];
+            e2[l] = c.position[l] - a.position[l];
+            normal[l] = a.normal[l] + b.normal[l] + c.normal[l];
+        }
+        BezierPatch::Cross(e1, e2, face);
+        if (BezierPatch::Length(face) < 1e-7f) continue;
+        checked++;
+        if (Dot(face, normal) < 0.0f) against++;
+    }
+    CHECK(checked > indices.size() / 3 * 9 / 10);
+    CHECK(against == checked);
+}
+
+int main(int argc, char** argv) {
+    TestSize(1);
+    TestSize(8);
+    TestWinding(4);
+    TestWinding(12);
+    return TestFailures();
+}
@@ -1,167 +1,159 @@
 #ifndef _TEA_POT_NODE_
 #define _TEA_POT_NODE_
 
+#include <Core/IListener.h>
+#include <Display/IViewingVolume.h>
+#include <Display/Viewport.h>
 #include <Scene/RenderNode.h>
+#include <Renderers/IRenderer.h>
 #include <Renderers/IRenderingView.h>
 #include <Meta/OpenGL.h>
 
+#include "TeaPotMesh.h"
+#include "Bounds.h"
+#include "RenderList.h"
+
 using namespace OpenEngine;
 
-//from: http://www.google.com/codesearch/p?hl=en#DeBRMSuGYX0/Mesa-5.0/widgets-mesa/demos/tea.c&q=glutSolidTeapot&l=733
-
-long patchdata[][16] =
-{
-    /* rim */
-  {102, 103, 104, 105, 4, 5, 6, 7, 8, 9, 10, 11,
-    12, 13, 14, 15},
-    /* body */
-  {12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23,
-    24, 25, 26, 27},
-  {24, 25, 26, 27, 29, 30, 31, 32, 33, 34, 35, 36,
-    37, 38, 39, 40},
-    /* lid */
-  {96, 96, 96, 96, 97, 98, 99, 100, 101, 101, 101,
-    101, 0, 1, 2, 3,},
-  {0, 1, 2, 3, 106, 107, 108, 109, 110, 111, 112,
-    113, 114, 115, 116, 117},
-    /* bottom */
-  {118, 118, 118, 118, 124, 122, 119, 121, 123, 126,
-    125, 120, 40, 39, 38, 37},
-    /* handle */
-  {41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52,
-    53, 54, 55, 56},
-  {53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63, 64,
-    28, 65, 66, 67},
-    /* spout */
-  {68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78, 79,
-    80, 81, 82, 83},
-  {80, 81, 82, 83, 84, 85, 86, 87, 88, 89, 90, 91,
-    92, 93, 94, 95}
-};
-/* *INDENT-OFF* */
-
-float cpdata[][3] =
-{
-    {0.2, 0, 2.7}, {0.2, -0.112, 2.7}, {0.112, -0.2, 2.7}, {0,
-    -0.2, 2.7}, {1.3375, 0, 2.53125}, {1.3375, -0.749, 2.53125},
-    {0.749, -1.3375, 2.53125}, {0, -1.3375, 2.53125}, {1.4375,
-    0, 2.53125}, {1.4375, -0.805, 2.53125}, {0.805, -1.4375,
-    2.53125}, {0, -1.4375, 2.53125}, {1.5, 0, 2.4}, {1.5, -0.84,
-    2.4}, {0.84, -1.5, 2.4}, {0, -1.5, 2.4}, {1.75, 0, 1.875},
-    {1.75, -0.98, 1.875}, {0.98, -1.75, 1.875}, {0, -1.75,
-    1.875}, {2, 0, 1.35}, {2, -1.12, 1.35}, {1.12, -2, 1.35},
-    {0, -2, 1.35}, {2, 0, 0.9}, {2, -1.12, 0.9}, {1.12, -2,
-    0.9}, {0, -2, 0.9}, {-2, 0, 0.9}, {2, 0, 0.45}, {2, -1.12,
-    0.45}, {1.12, -2, 0.45}, {0, -2, 0.45}, {1.5, 0, 0.225},
-    {1.5, -0.84, 0.225}, {0.84, -1.5, 0.225}, {0, -1.5, 0.225},
-    {1.5, 0, 0.15}, {1.5, -0.84, 0.15}, {0.84, -1.5, 0.15}, {0,
-    -1.5, 0.15}, {-1.6, 0, 2.025}, {-1.6, -0.3, 2.025}, {-1.5,
-    -0.3, 2.25}, {-1.5, 0, 2.25}, {-2.3, 0, 2.025}, {-2.3, -0.3,
-    2.025}, {-2.5, -0.3, 2.25}, {-2.5, 0, 2.25}, {-2.7, 0,
-    2.025}, {-2.7, -0.3, 2.025}, {-3, -0.3, 2.25}, {-3, 0,
-    2.25}, {-2.7, 0, 1.8}, {-2.7, -0.3, 1.8}, {-3, -0.3, 1.8},
-    {-3, 0, 1.8}, {-2.7, 0, 1.575}, {-2.7, -0.3, 1.575}, {-3,
-    -0.3, 1.35}, {-3, 0, 1.35}, {-2.5, 0, 1.125}, {-2.5, -0.3,
-    1.125}, {-2.65, -0.3, 0.9375}, {-2.65, 0, 0.9375}, {-2,
-    -0.3, 0.9}, {-1.9, -0.3, 0.6}, {-1.9, 0, 0.6}, {1.7, 0,
-    1.425}, {1.7, -0.66, 1.425}, {1.7, -0.66, 0.6}, {1.7, 0,
-    0.6}, {2.6, 0, 1.425}, {2.6, -0.66, 1.425}, {3.1, -0.66,
-    0.825}, {3.1, 0, 0.825}, {2.3, 0, 2.1}, {2.3, -0.25, 2.1},
-    {2.4, -0.25, 2.025}, {2.4, 0, 2.025}, {2.7, 0, 2.4}, {2.7,
-    -0.25, 2.4}, {3.3, -0.25, 2.4}, {3.3, 0, 2.4}, {2.8, 0,
-    2.475}, {2.8, -0.25, 2.475}, {3.525, -0.25, 2.49375},
-    {3.525, 0, 2.49375}, {2.9, 0, 2.475}, {2.9, -0.15, 2.475},
-    {3.45, -0.15, 2.5125}, {3.45, 0, 2.5125}, {2.8, 0, 2.4},
-    {2.8, -0.15, 2.4}, {3.2, -0.15, 2.4}, {3.2, 0, 2.4}, {0, 0,
-    3.15}, {0.8, 0, 3.15}, {0.8, -0.45, 3.15}, {0.45, -0.8,
-    3.15}, {0, -0.8, 3.15}, {0, 0, 2.85}, {1.4, 0, 2.4}, {1.4,
-    -0.784, 2.4}, {0.784, -1.4, 2.4}, {0, -1.4, 2.4}, {0.4, 0,
-    2.55}, {0.4, -0.224, 2.55}, {0.224, -0.4, 2.55}, {0, -0.4,
-    2.55}, {1.3, 0, 2.55}, {1.3, -0.728, 2.55}, {0.728, -1.3,
-    2.55}, {0, -1.3, 2.55}, {1.3, 0, 2.4}, {1.3, -0.728, 2.4},
-    {0.728, -1.3, 2.4}, {0, -1.3, 2.4}, {0, 0, 0}, {1.425,
-    -0.798, 0}, {1.5, 0, 0.075}, {1.425, 0, 0}, {0.798, -1.425,
-    0}, {0, -1.5, 0.075}, {0, -1.425, 0}, {1.5, -0.84, 0.075},
-    {0.84, -1.5, 0.075}
-};
+// Tessellation levels used for screen space level of detail.
+static const int TEAPOT_LOD_GRIDS[] = {2, 4, 7, 14, 28};
+static const int TEAPOT_LOD_LEVELS = 5;
 
-static float tex[2][2][2] =
-{
-  { {0, 0},
-    {1, 0}},
-  { {0, 1},
-    {1, 1}}
-};
+/**
+ * Projection and viewport height the teapots pick their level with,
+ * taken from the viewport's viewing volume once per frame instead of
+ * being read back from GL by every node. Attach to the renderer's
+ * PreProcessEvent; without it the nodes read GL themselves.
+ */
+class TeaPotLodFrame : public Core::IListener<Renderers::RenderingEventArg> {
+public:
+    TeaPotLodFrame(Display::Viewport& viewport)
+        : viewport(viewport), valid(false), scaleY(1.0f)
+        , perspective(true), height(0) {
+        current = this;
+    }
 
-static void teapot(GLint grid, GLdouble scale, GLenum type) {
-  float p[4][4][3], q[4][4][3], r[4][4][3], s[4][4][3];
-  long i, j, k, l;
-
-  glPushAttrib(GL_ENABLE_BIT | GL_EVAL_BIT);
-  glEnable(GL_AUTO_NORMAL);
-  glEnable(GL_NORMALIZE);
-  glEnable(GL_MAP2_VERTEX_3);
-  glEnable(GL_MAP2_TEXTURE_COORD_2);
-  glPushMatrix();
-  /* glRotatef(270.0, 1.0, 0.0, 0.0); */
-  /* Rotate it upwards in the standard MesaWorkstation
-     coordinate system.  */
-  glRotatef(90.0, 0.0, 1.0, 0.0);
-  glRotatef(90.0, 1.0, 0.0, 0.0);
-  glScalef(0.5 * scale, 0.5 * scale, 0.5 * scale);
-  glTranslatef(0.0, 0.0, -1.5);
-  for (i = 0; i < 10; i++) {
-    for (j = 0; j < 4; j++) {
-      for (k = 0; k < 4; k++) {
-        for (l = 0; l < 3; l++) {
-          p[j][k][l] = cpdata[patchdata[i][j * 4 + k]][l];
-          q[j][k][l] = cpdata[patchdata[i][j * 4 + (3 - k)]][l];
-          if (l == 1)
-            q[j][k][l] *= -1.0;
-          if (i < 6) {
-            r[j][k][l] =
-              cpdata[patchdata[i][j * 4 + (3 - k)]][l];
-            if (l == 0)
-              r[j][k][l] *= -1.0;
-            s[j][k][l] = cpdata[patchdata[i][j * 4 + k]][l];
-            if (l == 0)
-              s[j][k][l] *= -1.0;
-            if (l == 1)
-              s[j][k][l] *= -1.0;
-          }
-        }
-      }
+    ~TeaPotLodFrame() {
+        if (current == this) current = NULL;
     }
-    glMap2f(GL_MAP2_TEXTURE_COORD_2, 0, 1, 2, 2, 0, 1, 4, 2,
-      &tex[0][0][0]);
-    glMap2f(GL_MAP2_VERTEX_3, 0, 1, 3, 4, 0, 1, 12, 4,
-      &p[0][0][0]);
-    glMapGrid2f(grid, 0.0, 1.0, grid, 0.0, 1.0);
-    glEvalMesh2(type, 0, grid, 0, grid);
-    glMap2f(GL_MAP2_VERTEX_3, 0, 1, 3, 4, 0, 1, 12, 4,
-      &q[0][0][0]);
-    glEvalMesh2(type, 0, grid, 0, grid);
-    if (i < 6) {
-      glMap2f(GL_MAP2_VERTEX_3, 0, 1, 3, 4, 0, 1, 12, 4,
-        &r[0][0][0]);
-      glEvalMesh2(type, 0, grid, 0, grid);
-      glMap2f(GL_MAP2_VERTEX_3, 0, 1, 3, 4, 0, 1, 12, 4,
-        &s[0][0][0]);
-      glEvalMesh2(type, 0, grid, 0, grid);
+
+    void Handle(Renderers::RenderingEventArg arg) {
+        Display::IViewingVolume* volume = viewport.GetViewingVolume();
+        valid = volume != NULL;
+        if (!valid) return;
+        float proj[16];
+        volume->GetProjectionMatrix().ToArray(proj);
+        scaleY = proj[5];
+        perspective = proj[11] != 0.0f;
+        height = viewport.GetDimension()[3];
+    }
+
+    // The frame of the current listener, NULL if there is none yet.
+    static const TeaPotLodFrame* Get() {
+        return current != NULL && current->valid ? current : NULL;
     }
-  }
-  glPopMatrix();
-  glPopAttrib();
-}
 
-class TeaPotNode : public Scene::RenderNode {
+    float GetScaleY() const { return scaleY; }
+    bool IsPerspective() const { return perspective; }
+    int GetHeight() const { return height; }
+
+private:
+    static TeaPotLodFrame* current;
+
+    Display::Viewport& viewport;
+    bool valid;
+    float scaleY;
+    bool perspective;
+    int height;
+};
+
+TeaPotLodFrame* TeaPotLodFrame::current = NULL;
+
+/**
+ * Teapot render node.
+ *
+ * With a fixed grid the node always draws that tessellation. With
+ * grid 0 (the default) the grid is picked per frame from the
+ * projected size of the bounding sphere, so that a patch edge covers
+ * roughly pixelsPerSegment pixels on screen. The modelview comes from
+ * the RenderList drawing the node and the projection from the
+ * TeaPotLodFrame, so a frame of many teapots does not read GL state
+ * back per node; either one is read from GL only when missing.
+ */
+class TeaPotNode : public Scene::RenderNode, public IBounded {
  public:
- TeaPotNode(double scale) : scale(scale) {}
+ TeaPotNode(double scale, int grid = 0)
+     : scale(scale), grid(grid), pixelsPerSegment(8.0f) {
+        for (int i = 0; i < TEAPOT_LOD_LEVELS; i++) meshes[i] = NULL;
+        if (grid > 0) meshes[0] = TeaPotMesh::Acquire(grid, scale);
+    }
+    ~TeaPotNode() {
+        for (int i = 0; i < TEAPOT_LOD_LEVELS; i++)
+            if (meshes[i]) TeaPotMesh::Release(meshes[i]);
+    }
     void Apply(Renderers::IRenderingView* view) {
-        teapot(14, scale, GL_FILL);
+        int level = grid > 0 ? 0 : SelectLevel();
+        if (meshes[level] == NULL)
+            meshes[level] = TeaPotMesh::Acquire(TEAPOT_LOD_GRIDS[level], scale);
+        glPushAttrib(GL_ENABLE_BIT);
+        glEnable(GL_NORMALIZE);
+        meshes[level]->Draw();
+        glPopAttrib();
+    }
+    void SetPixelsPerSegment(float pixels) { pixelsPerSegment = pixels; }
+    BoundingSphere GetBounds() const {
+        BoundingSphere s = { {0.0f, 0.0f, 0.0f}, TEAPOT_RADIUS * (float)scale };
+        return s;
     }
  private:
     double scale;
+    int grid;
+    float pixelsPerSegment;
+    MeshBuffer* meshes[TEAPOT_LOD_LEVELS];
+
+    int SelectLevel() {
+        float fetched[16];
+        const float* mv = RenderList::GetModelview();
+        if (mv == NULL) {
+            glGetFloatv(GL_MODELVIEW_MATRIX, fetched);
+            mv = fetched;
+        }
+        float scaleY;
+        bool perspective;
+        int height;
+        const TeaPotLodFrame* frame = TeaPotLodFrame::Get();
+        if (frame != NULL) {
+            scaleY = frame->GetScaleY();
+            perspective = frame->IsPerspective();
+            height = frame->GetHeight();
+        }
+        else {
+            float proj[16];
+            GLint vp[4];
+            glGetFloatv(GL_PROJECTION_MATRIX, proj);
+            glGetIntegerv(GL_VIEWPORT, vp);
+            scaleY = proj[5];
+            perspective = proj[11] != 0.0f;
+            height = vp[3];
+        }
+
+        // eye space depth of the origin and the largest axis scale
+        float z = -mv[14];
+        float s = 0.0f;
+        for (int c = 0; c < 3; c++)
+            s = std::max(s, mv[c*4]*mv[c*4] + mv[c*4+1]*mv[c*4+1] + mv[c*4+2]*mv[c*4+2]);
+        float radius = TEAPOT_RADIUS * scale * std::sqrt(s);
+        if (z <= radius) return TEAPOT_LOD_LEVELS - 1;
+
+        // projected diameter in pixels, orthographic if w is constant
+        float pixels = radius * scaleY * height;
+        if (perspective) pixels /= z;
+        // about four patches span the silhouette
+        float needed = pixels / (4.0f * pixelsPerSegment);
+        for (int i = 0; i < TEAPOT_LOD_LEVELS - 1; i++)
+            if (TEAPOT_LOD_GRIDS[i] >= needed) return i;
+        return TEAPOT_LOD_LEVELS - 1;
+    }
 };
 
 #endif //_TEA_POT_NODE_
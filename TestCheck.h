@@ -0,0 +1,37 @@
+// Minimal checks for the test programs.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _TEST_CHECK_H_
+#define _TEST_CHECK_H_
+
+#include <cstdio>
+
+/**
+ * CHECK(condition) reports a failed condition with its line and goes
+ * on; a test program returns TestFailures() from main, so ctest sees
+ * a non-zero exit when anything failed.
+ */
+static int testFailures = 0;
+
+#define CHECK(condition)                                              \
+    do {                                                              \
+        if (!(condition)) {                                           \
+            fprintf(stderr, "%s:%d: check failed: %s\n",              \
+                    __FILE__, __LINE__, #condition);                  \
+            testFailures++;                                           \
+        }                                                             \
+    } while (0)
+
+static int TestFailures() {
+    if (testFailures) fprintf(stderr, "%d checks failed\n", testFailures);
+    else printf("all checks passed\n");
+    return testFailures ? 1 : 0;
+}
+
+#endif // _TEST_CHECK_H_
@@ -0,0 +1,117 @@
+// Fixed set of worker threads running queued jobs.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include "Signal.h"
+
+#include <Core/Thread.h>
+#include <Core/Mutex.h>
+
+#include <deque>
+#include <vector>
+
+using namespace OpenEngine::Core;
+
+// Work item for the pool, deleted after it ran.
+class IJob {
+public:
+    virtual ~IJob() {}
+    virtual void Run() = 0;
+};
+
+/**
+ * Runs jobs in the order they were added on a fixed number of
+ * threads, started with the pool. Idle threads sleep on a signal set
+ * by Add(); a thread that takes a job while more are queued wakes the
+ * next one. Finish() runs the queue dry and joins the threads; jobs
+ * added after that run on the calling thread.
+ */
+class ThreadPool {
+public:
+    ThreadPool(unsigned int threads) : finishing(false) {
+        if (threads == 0) threads = 1;
+        for (unsigned int i = 0; i < threads; i++) {
+            workers.push_back(new Worker(*this));
+            workers.back()->Start();
+        }
+    }
+
+    ~ThreadPool() { Finish(); }
+
+    // Takes ownership of the job.
+    void Add(IJob* job) {
+        if (workers.empty()) {
+            job->Run();
+            delete job;
+            return;
+        }
+        lock.Lock();
+        queue.push_back(job);
+        lock.Unlock();
+        work.Set();
+    }
+
+    void Finish() {
+        lock.Lock();
+        finishing = true;
+        lock.Unlock();
+        work.Set();
+        for (unsigned int i = 0; i < workers.size(); i++) {
+            workers[i]->Wait();
+            delete workers[i];
+        }
+        workers.clear();
+    }
+
+    unsigned int GetThreadCount() const { return workers.size(); }
+
+private:
+    class Worker : public Thread {
+    public:
+        Worker(ThreadPool& pool) : pool(pool) {}
+        void Run() { pool.Work(); }
+    private:
+        ThreadPool& pool;
+    };
+
+    std::vector<Worker*> workers;
+    std::deque<IJob*> queue;
+    Mutex lock;
+    Signal work;
+    bool finishing;
+
+    void Work() {
+        for (;;) {
+            lock.Lock();
+            IJob* job = NULL;
+            if (!queue.empty()) {
+                job = queue.front();
+                queue.pop_front();
+            }
+            bool more = !queue.empty();
+            bool done = finishing;
+            lock.Unlock();
+            if (job) {
+                // one Set() wakes one thread, pass it on
+                if (more) work.Set();
+                job->Run();
+                delete job;
+            }
+            else if (done) {
+                work.Set();
+                break;
+            }
+            else work.Wait();
+        }
+    }
+};
+
+#endif // _THREAD_POOL_H_
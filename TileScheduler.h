@@ -0,0 +1,166 @@
+// Work stealing tile scheduler for the CPU effect backend.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _TILE_SCHEDULER_H_
+#define _TILE_SCHEDULER_H_
+
+#include <Core/Thread.h>
+#include <Core/Mutex.h>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace OpenEngine::Core;
+
+// Work on the pixels [x0,x1) x [y0,y1).
+class ITileKernel {
+public:
+    virtual ~ITileKernel() {}
+    virtual void Run(int x0, int y0, int x1, int y1) = 0;
+};
+
+/**
+ * Splits an image into square tiles and runs a kernel on them from a
+ * number of threads.
+ *
+ * Every thread starts with a contiguous band of tiles in its own
+ * queue and takes them from the back; a thread that runs dry steals
+ * from the front of the other queues, so uneven tiles (borders, early
+ * outs) do not leave cores idle. The calling thread works as one of
+ * the threads. Run() is not reentrant.
+ */
+class TileScheduler {
+public:
+    TileScheduler(unsigned int threads = 0)
+        : threads(threads ? threads : HardwareThreads()), steals(0) {}
+
+    unsigned int GetThreadCount() const { return threads; }
+    void SetThreadCount(unsigned int count) { threads = count ? count : 1; }
+    // Tiles taken from another thread's queue in the last Run().
+    unsigned int GetSteals() const { return steals; }
+
+    void Run(ITileKernel& kernel, int width, int height, int tileSize = 64) {
+        std::vector<Tile> tiles;
+        for (int y = 0; y < height; y += tileSize)
+            for (int x = 0; x < width; x += tileSize) {
+                Tile t = { x, y, std::min(width, x + tileSize),
+                           std::min(height, y + tileSize) };
+                tiles.push_back(t);
+            }
+        steals = 0;
+        unsigned int count = std::min<unsigned int>(threads, tiles.size());
+        if (count <= 1) {
+            for (unsigned int i = 0; i < tiles.size(); i++)
+                kernel.Run(tiles[i].x0, tiles[i].y0, tiles[i].x1, tiles[i].y1);
+            return;
+        }
+
+        queues.resize(count);
+        for (unsigned int q = 0; q < count; q++) {
+            queues[q] = new Queue();
+            unsigned int begin = tiles.size() * q / count;
+            unsigned int end = tiles.size() * (q + 1) / count;
+            queues[q]->tiles.assign(tiles.begin() + begin, tiles.begin() + end);
+        }
+        std::vector<Worker*> workers;
+        for (unsigned int q = 1; q < count; q++) {
+            workers.push_back(new Worker(*this, kernel, q));
+            workers.back()->Start();
+        }
+        Work(0, kernel);
+        for (unsigned int i = 0; i < workers.size(); i++) {
+            workers[i]->Wait();
+            delete workers[i];
+        }
+        for (unsigned int q = 0; q < count; q++) {
+            steals += queues[q]->steals;
+            delete queues[q];
+        }
+        queues.clear();
+    }
+
+    static unsigned int HardwareThreads() {
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        long count = info.dwNumberOfProcessors;
+#else
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        return count > 0 ? count : 1;
+    }
+
+private:
+    struct Tile {
+        int x0, y0, x1, y1;
+    };
+
+    struct Queue {
+        Queue() : steals(0) {}
+        Mutex lock;
+        std::deque<Tile> tiles;
+        unsigned int steals;
+    };
+
+    class Worker : public Thread {
+    public:
+        Worker(TileScheduler& scheduler, ITileKernel& kernel, unsigned int index)
+            : scheduler(scheduler), kernel(kernel), index(index) {}
+        void Run() { scheduler.Work(index, kernel); }
+    private:
+        TileScheduler& scheduler;
+        ITileKernel& kernel;
+        unsigned int index;
+    };
+
+    unsigned int threads, steals;
+    std::vector<Queue*> queues;
+
+    void Work(unsigned int self, ITileKernel& kernel) {
+        Tile t;
+        while (Next(self, t))
+            kernel.Run(t.x0, t.y0, t.x1, t.y1);
+    }
+
+    bool Next(unsigned int self, Tile& tile) {
+        Queue* own = queues[self];
+        own->lock.Lock();
+        bool found = !own->tiles.empty();
+        if (found) {
+            tile = own->tiles.back();
+            own->tiles.pop_back();
+        }
+        own->lock.Unlock();
+        if (found) return true;
+
+        for (unsigned int k = 1; k < queues.size(); k++) {
+            Queue* victim = queues[(self + k) % queues.size()];
+            victim->lock.Lock();
+            found = !victim->tiles.empty();
+            if (found) {
+                tile = victim->tiles.front();
+                victim->tiles.pop_front();
+            }
+            victim->lock.Unlock();
+            if (found) {
+                own->steals++;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+#endif // _TILE_SCHEDULER_H_
@@ -0,0 +1,299 @@
+// Frame tracing into per-thread buffers, dumped as Chrome JSON.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _TRACER_H_
+#define _TRACER_H_
+
+#include "Atomic.h"
+
+#include <Core/IEngine.h>
+#include <Core/IListener.h>
+#include <Core/Mutex.h>
+#include <Devices/IKeyboard.h>
+#include <Logging/Logger.h>
+#include <Utils/Timer.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <typeinfo>
+#include <vector>
+#ifdef __GNUC__
+#include <cstdlib>
+#include <cxxabi.h>
+#endif
+#ifdef _WIN32
+#define TRACER_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACER_THREAD_LOCAL __thread
+#endif
+
+using namespace OpenEngine;
+using namespace OpenEngine::Core;
+using namespace OpenEngine::Devices;
+using std::string;
+
+/**
+ * Records where the time of a frame goes, on every thread.
+ *
+ * A TraceZone on the stack records its name, start and duration into
+ * a buffer of the calling thread, taken on its first zone; no locks
+ * after that. The buffers are rings keeping the last CAPACITY zones of
+ * each thread. Zone names are not copied and must stay alive.
+ *
+ * Dump() writes the buffers in the Chrome trace event format, for
+ * chrome://tracing or ui.perfetto.dev, with an instant event at the
+ * start of every frame. The tracer dumps when F9 is pressed; main
+ * dumps once more at shutdown. Zones cost nothing but a compare when
+ * no tracer exists.
+ */
+class Tracer : public IListener<ProcessEventArg>
+             , public IListener<KeyboardEventArg> {
+public:
+    Tracer(const string& path) : path(path), frame(0) {
+        start = Utils::Timer::GetTime().AsInt();
+        current = this;
+        NameThread("main");
+    }
+
+    ~Tracer() {
+        if (current == this) current = NULL;
+        for (unsigned int i = 0; i < buffers.size(); i++)
+            delete buffers[i];
+    }
+
+    static bool IsEnabled() { return current != NULL; }
+
+    static unsigned long long Now() { return Utils::Timer::GetTime().AsInt(); }
+
+    // Records a finished zone of the calling thread.
+    static void Record(const char* name, unsigned long long begin,
+                       unsigned long long end) {
+        Tracer* t = current;
+        if (t == NULL) return;
+        Buffer* buffer = local;
+        if (buffer == NULL || buffer->owner != t) buffer = local = t->Register("");
+        const unsigned int n = buffer->written;
+        Zone& zone = buffer->zones[n % CAPACITY];
+        zone.name = name;
+        zone.start = begin;
+        zone.duration = end - begin;
+        buffer->written = n + 1;
+        Atomic::Store(&buffer->count, (int)buffer->written);
+    }
+
+    // Names the calling thread in the dump.
+    static void NameThread(const string& name) {
+        Tracer* t = current;
+        if (t == NULL) return;
+        if (local == NULL || local->owner != t) local = t->Register(name);
+        else {
+            t->lock.Lock();
+            local->name = name;
+            t->lock.Unlock();
+        }
+    }
+
+    // Marks the start of a frame; attach first to the process event.
+    void Handle(ProcessEventArg arg) {
+        frames.push_back(Now());
+        if (frames.size() > CAPACITY) frames.erase(frames.begin(),
+                                                   frames.begin() + CAPACITY / 2);
+        frame++;
+    }
+
+    void Handle(KeyboardEventArg arg) {
+        if (arg.type == EVENT_PRESS && arg.sym == KEY_F9) Dump();
+    }
+
+    bool Dump() {
+        FILE* out = fopen(path.c_str(), "w");
+        if (out == NULL) {
+            logger.error << "Can not write trace '" << path << "'" << logger.end;
+            return false;
+        }
+        fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        bool first = true;
+        unsigned int zones = 0;
+        lock.Lock();
+        for (unsigned int i = 0; i < buffers.size(); i++) {
+            Buffer& b = *buffers[i];
+            fprintf(out, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,"
+                    "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", i, Escape(b.name).c_str());
+            first = false;
+            zones += DumpBuffer(out, b, i);
+        }
+        lock.Unlock();
+        for (unsigned int i = 0; i < frames.size(); i++)
+            fprintf(out, ",\n{\"ph\":\"i\",\"s\":\"g\",\"name\":\"frame\","
+                    "\"pid\":1,\"tid\":0,\"ts\":%llu}", frames[i] - start);
+        fprintf(out, "\n]}\n");
+        fclose(out);
+        logger.info << "Saved " << zones << " zones of " << frame
+                    << " frames to '" << path << "'" << logger.end;
+        return true;
+    }
+
+    // "event/Type" for a listener, the type without namespaces.
+    template <class T> static string ListenerName(const string& event,
+                                                  T& listener) {
+        const char* raw = typeid(listener).name();
+        string name = raw;
+#ifdef __GNUC__
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(raw, NULL, NULL, &status);
+        if (status == 0) name = demangled;
+        free(demangled);
+#endif
+        string::size_type space = name.rfind(' ');  // "class X" on MSVC
+        if (space != string::npos) name = name.substr(space + 1);
+        string::size_type colon = name.rfind("::", name.find('<'));
+        if (colon != string::npos) name = name.substr(colon + 2);
+        return event + "/" + name;
+    }
+
+private:
+    static const unsigned int CAPACITY = 1 << 15;
+
+    struct Zone {
+        const char* name;
+        unsigned long long start, duration;
+    };
+
+    struct Buffer {
+        Tracer* owner;
+        string name;
+        unsigned int written;   // by the owning thread
+        volatile int count;     // written, as published to Dump()
+        Zone zones[CAPACITY];
+    };
+
+    static Tracer* current;
+    static TRACER_THREAD_LOCAL Buffer* local;
+
+    string path;
+    unsigned long long start;
+    unsigned int frame;
+    std::vector<unsigned long long> frames;
+    std::vector<Buffer*> buffers;
+    Mutex lock;
+
+    Buffer* Register(const string& name) {
+        Buffer* buffer = new Buffer();
+        buffer->owner = this;
+        buffer->written = 0;
+        buffer->count = 0;
+        lock.Lock();
+        buffer->name = name.empty() ? "thread " + Number(buffers.size()) : name;
+        buffers.push_back(buffer);
+        lock.Unlock();
+        return buffer;
+    }
+
+    // Copies the zones first; the ones the thread may have overwritten
+    // meanwhile are left out.
+    unsigned int DumpBuffer(FILE* out, Buffer& b, unsigned int tid) {
+        const unsigned int count = Atomic::Load(&b.count);
+        const unsigned int first = count > CAPACITY ? count - CAPACITY : 0;
+        std::vector<Zone> zones;
+        for (unsigned int n = first; n < count; n++)
+            zones.push_back(b.zones[n % CAPACITY]);
+        const unsigned int now = Atomic::Load(&b.count);
+        // the zone being written may already take the slot of now - CAPACITY
+        const unsigned int valid = now + 1 > CAPACITY ? now + 1 - CAPACITY : 0;
+        unsigned int dumped = 0;
+        for (unsigned int n = std::max(first, valid); n < count; n++) {
+            const Zone& z = zones[n - first];
+            fprintf(out, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%u,"
+                    "\"ts\":%llu,\"dur\":%llu}", Escape(z.name).c_str(), tid,
+                    z.start - start, z.duration);
+            dumped++;
+        }
+        return dumped;
+    }
+
+    static string Escape(const string& text) {
+        string escaped;
+        for (unsigned int i = 0; i < text.size(); i++) {
+            if (text[i] == '"' || text[i] == '\\') escaped += '\\';
+            escaped += text[i];
+        }
+        return escaped;
+    }
+
+    static string Number(unsigned int n) {
+        char text[16];
+        sprintf(text, "%u", n);
+        return text;
+    }
+};
+
+Tracer* Tracer::current = NULL;
+TRACER_THREAD_LOCAL Tracer::Buffer* Tracer::local = NULL;
+
+// Records the scope it lives in as a zone.
+class TraceZone {
+public:
+    TraceZone(const char* name)
+        : name(name), begin(Tracer::IsEnabled() ? Tracer::Now() : 0) {}
+    ~TraceZone() {
+        if (begin) Tracer::Record(name, begin, Tracer::Now());
+    }
+private:
+    const char* name;
+    unsigned long long begin;
+};
+
+/**
+ * Decorates a listener with a zone around its Handle(). See Traced().
+ */
+template <class T> class TracedListener : public IListener<T> {
+public:
+    TracedListener(IListener<T>& listener, const string& name)
+        : listener(listener), name(name) {}
+
+    void Handle(T arg) {
+        TraceZone zone(name.c_str());
+        listener.Handle(arg);
+    }
+
+private:
+    IListener<T>& listener;
+    string name;
+};
+
+// Attaches listeners to an event, decorated when tracing.
+template <class T> class TracedEvent {
+public:
+    TracedEvent(IEvent<T>& event, const string& label)
+        : event(event), label(label) {}
+
+    template <class L> void Attach(L& listener) {
+        IListener<T>& l = listener;
+        if (Tracer::IsEnabled())
+            event.Attach(*(new TracedListener<T>(l, Tracer::ListenerName(label, listener))));
+        else event.Attach(l);
+    }
+
+private:
+    IEvent<T>& event;
+    string label;
+};
+
+/**
+ * Traced(engine.ProcessEvent(), "process").Attach(*handler) attaches
+ * the handler in a zone named "process/Handler" if a tracer exists,
+ * and as it is otherwise.
+ */
+template <class T> TracedEvent<T> Traced(IEvent<T>& event, const string& label) {
+    return TracedEvent<T>(event, label);
+}
+
+#endif // _TRACER_H_
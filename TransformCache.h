@@ -0,0 +1,132 @@
+// World matrices of transformation nodes, recomputed only when dirty.
+// -------------------------------------------------------------------
+// Copyright (C) 2008 OpenEngine.dk (See AUTHORS)
+//
+// This program is free software; It is covered by the GNU General
+// Public License version 2 or any later version.
+// See the GNU General Public License for more details (see LICENSE).
+//--------------------------------------------------------------------
+
+#ifndef _TRANSFORM_CACHE_H_
+#define _TRANSFORM_CACHE_H_
+
+#include "GLMatrix.h"
+
+#include <Scene/TransformationNode.h>
+#include <Math/Vector.h>
+#include <Math/Quaternion.h>
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+using namespace OpenEngine;
+using namespace OpenEngine::Math;
+using namespace OpenEngine::Scene;
+
+/**
+ * Flat table of transformation nodes with their world matrices.
+ *
+ * Every node gets a slot holding its parent slot, a dirty flag and
+ * the cached column major world matrix (position and rotation of the
+ * node applied after the parent, scaling is not supported). Slots are
+ * added parents first, so one linear pass recomputes the dirty slots
+ * and passes the flag on to their children. Nothing is read from the
+ * nodes while no slot is dirty.
+ *
+ * The nodes do not report changes themselves: whoever calls
+ * SetPosition, SetRotation or Rotate on a cached node must call
+ * Invalidate for it (KeyframeTracks does so when given the cache).
+ */
+class TransformCache {
+public:
+    TransformCache() : anyDirty(false), recomputed(0) {}
+
+    // Parent must be an earlier slot, or -1 for the root frame.
+    unsigned int Add(TransformationNode* node, int parent = -1) {
+        unsigned int slot = nodes.size();
+        nodes.push_back(node);
+        parents.push_back(parent);
+        dirty.push_back(1);
+        versions.push_back(0);
+        world.resize(world.size() + 16, 0.0f);
+        slots[node] = slot;
+        anyDirty = true;
+        return slot;
+    }
+
+    void Invalidate(unsigned int slot) {
+        dirty[slot] = 1;
+        anyDirty = true;
+    }
+
+    void Invalidate(TransformationNode* node) {
+        std::map<TransformationNode*, unsigned int>::iterator i = slots.find(node);
+        if (i != slots.end()) Invalidate(i->second);
+    }
+
+    bool IsDirty() const { return anyDirty; }
+
+    // Brings the world matrices of dirty slots and their descendants
+    // up to date.
+    void Update() {
+        if (!anyDirty) return;
+        for (unsigned int i = 0; i < nodes.size(); i++) {
+            int p = parents[i];
+            if (p >= 0 && dirty[p]) dirty[i] = 1;
+            if (!dirty[i]) continue;
+            float local[16];
+            Local(*nodes[i], local);
+            if (p < 0) std::copy(local, local + 16, &world[16 * i]);
+            else GLMatrix::Multiply(&world[16 * p], local, &world[16 * i]);
+            versions[i]++;
+            recomputed++;
+        }
+        std::fill(dirty.begin(), dirty.end(), 0);
+        anyDirty = false;
+    }
+
+    const float* GetWorld(unsigned int slot) const { return &world[16 * slot]; }
+    // Bumped every time the world matrix of the slot is recomputed.
+    unsigned int GetVersion(unsigned int slot) const { return versions[slot]; }
+    unsigned int GetSlotCount() const { return nodes.size(); }
+
+    // Matrices recomputed since the last call.
+    unsigned int TakeRecomputed() {
+        unsigned int n = recomputed;
+        recomputed = 0;
+        return n;
+    }
+
+private:
+    std::vector<TransformationNode*> nodes;
+    std::vector<int> parents;
+    std::vector<unsigned char> dirty;
+    std::vector<unsigned int> versions;
+    std::vector<float> world;
+    std::map<TransformationNode*, unsigned int> slots;
+    bool anyDirty;
+    unsigned int recomputed;
+
+    // Translation times rotation of the node.
+    static void Local(TransformationNode& node, float m[16]) {
+        Vector<3,float> p = node.GetPosition();
+        Quaternion<float> q = node.GetRotation();
+        float w = q.GetReal();
+        Vector<3,float> v = q.GetImaginary();
+        float x = v[0], y = v[1], z = v[2];
+        m[0] = 1 - 2 * (y * y + z * z);
+        m[1] = 2 * (x * y + w * z);
+        m[2] = 2 * (x * z - w * y);
+        m[4] = 2 * (x * y - w * z);
+        m[5] = 1 - 2 * (x * x + z * z);
+        m[6] = 2 * (y * z + w * x);
+        m[8] = 2 * (x * z + w * y);
+        m[9] = 2 * (y * z - w * x);
+        m[10] = 1 - 2 * (x * x + y * y);
+        m[3] = m[7] = m[11] = 0.0f;
+        m[12] = p[0]; m[13] = p[1]; m[14] = p[2]; m[15] = 1.0f;
+    }
+};
+
+#endif // _TRANSFORM_CACHE_H_
@@ -49,7 +49,6 @@
 
 // Utilities and logger
 #include <Logging/Logger.h>
-#include <Logging/StreamLogger.h>
 #include <Scene/DotVisitor.h>
 
 // OERacer utility files
@@ -57,13 +56,36 @@
 #include <Utils/RenderStateHandler.h>
 #include <Utils/MoveHandler.h>
 
-#include <Animation/MetaMorpher.h>
-#include <Animation/TransformationNodeMorpher.h>
-using namespace OpenEngine::Animation;
-
 #include <Meta/OpenGL.h>
 
+#include <cerrno>
+#include <cstdlib>
+#include <map>
+
 #include "TeaPotNode.h"
+#include "HeadlessFrame.h"
+#include "FrameLimiter.h"
+#include "EffectProfiler.h"
+#include "ScreenPipeline.h"
+#include "ScaledStages.h"
+#include "LazyEffect.h"
+#include "CPUBenchmark.h"
+#include "FixedStepEngine.h"
+#include "Benchmark.h"
+#include "FrameCapture.h"
+#include "KeyframeTracks.h"
+#include "InstancedMeshNode.h"
+#include "CullNode.h"
+#include "StatsHUD.h"
+#include "RenderList.h"
+#include "ShadowStage.h"
+#include "PipelinedEngine.h"
+#include "MeshNode.h"
+#include "StreamingTextureLoader.h"
+#include "AsyncLogger.h"
+#include "GLDiagnostics.h"
+#include "Tracer.h"
+#include "DynamicResolution.h"
 #include <EffectHandler.h>
 
 // Post processing extension
@@ -108,39 +130,170 @@ using namespace OpenEngine::Renderers;
 using namespace OpenEngine::Resources;
 using namespace OpenEngine::Utils;
 
+// Whether the post processing chain redirects the scene this frame.
+// The chain only has work when one of its effects is enabled; else
+// the scene is drawn straight into the frame buffer. Decided once per
+// frame, before the scene, so both halves of the chain agree even if
+// an effect is toggled in between.
+class ChainGate {
+private:
+    vector<IPostProcessingEffect*> chain;
+    bool active, decided;
+
+public:
+    ChainGate() : active(false), decided(false) {}
+
+    void Add(IPostProcessingEffect* effect) { chain.push_back(effect); }
+
+    bool Decide() {
+        bool any = false;
+        for (unsigned int i = 0; i < chain.size(); i++)
+            if (chain[i]->GetEnabled()) any = true;
+        if (!decided || any != active)
+            logger.info << (any ? "Effect chain redirects the scene"
+                                : "Effect chain bypassed") << logger.end;
+        active = any;
+        decided = true;
+        return active;
+    }
+
+    bool IsActive() const { return active; }
+};
+
 class Preprocessing : public RenderingView {
 private:
 	PostProcessingEffect* effect;
+    ChainGate& gate;
+    EffectProfiler* profiler;
+    DynamicResolution* resolution;
+    const vector<IPostProcessingEffect*>& effects;
+    const vector<string>& names;
 
 public:
-	Preprocessing( Viewport& viewport, PostProcessingEffect* effect )
-        : IRenderingView(viewport), RenderingView(viewport), effect(effect) {}
+	Preprocessing( Viewport& viewport, PostProcessingEffect* effect,
+                   ChainGate& gate, EffectProfiler* profiler,
+                   DynamicResolution* resolution,
+                   const vector<IPostProcessingEffect*>& effects,
+                   const vector<string>& names )
+        : IRenderingView(viewport), RenderingView(viewport), effect(effect)
+        , gate(gate), profiler(profiler), resolution(resolution)
+        , effects(effects), names(names) {}
 	
 	void Handle(RenderingEventArg arg) {
-		effect->PreRender();
-        CHECK_FOR_GL_ERROR();
+        string active = ActiveEffects(effects, names);
+        profiler->NextFrame();
+        profiler->Begin("frame");
+        profiler->Begin("pre/" + active);
+        GLDiagnostics::Begin("pre/" + active);
+        bool chain = gate.Decide();
+        if (resolution) resolution->BeginFrame(chain);
+        if (chain)
+            effect->PreRender();
+        GLDiagnostics::End();
+        profiler->End("pre/" + active);
+        GLDiagnostics::Check("pre processing");
+        profiler->Begin("scene/" + active);
 	}
 };
 
 class Postprocessing : public RenderingView {
 private:
 	PostProcessingEffect* effect;
+    ChainGate& gate;
+    ScreenPipeline* pipeline;
+    EffectProfiler* profiler;
+    DynamicResolution* resolution;
+    const vector<IPostProcessingEffect*>& effects;
+    const vector<string>& names;
 
 public:
-	Postprocessing( Viewport& viewport, PostProcessingEffect* effect )
-        : IRenderingView(viewport), RenderingView(viewport), effect(effect) {}
+	Postprocessing( Viewport& viewport, PostProcessingEffect* effect,
+                    ChainGate& gate, ScreenPipeline* pipeline,
+                    EffectProfiler* profiler, DynamicResolution* resolution,
+                    const vector<IPostProcessingEffect*>& effects,
+                    const vector<string>& names )
+        : IRenderingView(viewport), RenderingView(viewport), effect(effect)
+        , gate(gate), pipeline(pipeline), profiler(profiler)
+        , resolution(resolution), effects(effects), names(names) {}
 	
 	void Handle(RenderingEventArg arg) {
-		effect->PostRender();
-        CHECK_FOR_GL_ERROR();
+        string active = ActiveEffects(effects, names);
+        profiler->End("scene/" + active);
+        GLDiagnostics::Check("scene");
+        profiler->Begin("post/" + active);
+        pipeline->CaptureScene();
+        GLDiagnostics::Begin("post/" + active);
+        if (gate.IsActive())
+            effect->PostRender();
+        GLDiagnostics::End();
+        profiler->End("post/" + active);
+        GLDiagnostics::Check("post processing");
+        profiler->Begin("screen/" + active);
+        GLDiagnostics::Begin("screen/" + active);
+        pipeline->Render();
+        GLDiagnostics::End();
+        profiler->End("screen/" + active);
+        if (resolution) resolution->EndFrame(gate.IsActive());
+        profiler->End("frame");
 	}
 };
 
+// Turns the instances of the stress mode about their y axis, a slice
+// of every node per frame, so only that slice is uploaded again.
+class InstanceSpinner : public IListener<ProcessEventArg> {
+private:
+    struct Spun {
+        InstancedMeshNode* node;
+        std::vector<float> positions;
+        unsigned int slice, cursor;
+    };
+    std::vector<Spun> spun;
+    unsigned int slices;
+    unsigned long long time;
+
+public:
+    InstanceSpinner(unsigned int slices) : slices(slices), time(0) {}
+
+    void Add(InstancedMeshNode* node) {
+        Spun s;
+        s.node = node;
+        for (unsigned int i = 0; i < node->GetInstanceCount(); i++)
+            s.positions.insert(s.positions.end(),
+                               node->GetInstance(i).transform + 12,
+                               node->GetInstance(i).transform + 15);
+        s.slice = std::max(1u, node->GetInstanceCount() / slices);
+        s.cursor = 0;
+        spun.push_back(s);
+    }
+
+    static void Transform(float angle, const float* position, float m[16]) {
+        float c = std::cos(angle), s = std::sin(angle);
+        float r[16] = { c, 0, -s, 0,  0, 1, 0, 0,  s, 0, c, 0,
+                        position[0], position[1], position[2], 1 };
+        std::copy(r, r + 16, m);
+    }
+
+    void Handle(ProcessEventArg arg) {
+        time += arg.approx;
+        float m[16];
+        for (unsigned int j = 0; j < spun.size(); j++) {
+            Spun& s = spun[j];
+            unsigned int n = s.node->GetInstanceCount();
+            for (unsigned int k = 0; k < s.slice && n > 0; k++) {
+                float angle = (float)(time / 1000000.0) + (s.cursor + j) * 0.1f;
+                Transform(angle, &s.positions[3 * s.cursor], m);
+                s.node->SetTransform(s.cursor, m);
+                s.cursor = (s.cursor + 1) % n;
+            }
+        }
+    }
+};
+
 // Configuration structure to pass around to the setup methods
 struct Config {
     IEngine&              engine;
     IFrame*               frame;
-    Viewport*             viewport;
+    ScaledViewport*       viewport;
     IViewingVolume*       viewingvolume;
     Camera*               camera;
     Frustum*              frustum;
@@ -149,6 +302,48 @@ struct Config {
     IKeyboard*            keyboard;
     ISceneNode*           scene;
     TextureLoader*        textureLoader;
+    StreamingTextureLoader* streaming;
+    EffectProfiler*       profiler;
+    ScreenPipeline*       pipeline;
+    vector<IPostProcessingEffect*> effects;
+    vector<string>        effectNames;
+    Benchmark*            benchmarkRun;
+    CullNode*             culling;
+    ShadowStage*          shadows;
+    MeshBuffer*           instanceMesh;
+    PipelinedEngine*      pipelined;
+    Tracer*               tracer;
+    // command line options
+    std::map<string, int> scales;
+    vector<string>        temporal;
+    unsigned int          fixedStep;
+    bool                  benchmark;
+    string                golden;
+    bool                  updateGolden;
+    double                goldenTolerance;
+    double                goldenP99;
+    bool                  cachedShadows;
+    string                capture;
+    string                captureFormat;
+    unsigned int          instances;
+    vector<string>        models;
+    string                texture;
+    unsigned int          uploadBudget;
+    GLDiagnostics::Mode   glDebug;
+    unsigned int          glDebugInterval;
+    string                trace;
+    double                targetFps;
+    unsigned int          width;
+    unsigned int          height;
+    bool                  headless;
+    unsigned int          frames;
+    string                profile;
+    string                shaderCache;
+    bool                  cpuBench;
+    unsigned int          cpuThreads;
+    string                cpuBatchEffects;
+    string                cpuBatchList;
+    string                cpuBatchOutput;
     Config(IEngine& engine)
         : engine(engine)
         , frame(NULL)
@@ -161,10 +356,43 @@ struct Config {
         , keyboard(NULL)
         , scene(NULL)
         , textureLoader(NULL)
+        , streaming(NULL)
+        , profiler(NULL)
+        , pipeline(NULL)
+        , benchmarkRun(NULL)
+        , culling(NULL)
+        , shadows(NULL)
+        , instanceMesh(NULL)
+        , pipelined(NULL)
+        , tracer(NULL)
+        , fixedStep(0)
+        , benchmark(false)
+        , golden("projects/PostProcessingDemo/data/golden")
+        , updateGolden(false)
+        , goldenTolerance(2.0 / 255.0)
+        , goldenP99(16.0 / 255.0)
+        , cachedShadows(false)
+        , instances(0)
+        , uploadBudget(1024)
+        , glDebug(GLDiagnostics::AUTO)
+        , glDebugInterval(60)
+        , targetFps(0)
+        , width(800)
+        , height(600)
+        , headless(false)
+        , frames(0)
+        , shaderCache("shadercache")
+        , cpuBench(false)
+        , cpuThreads(0)
     {}
 };
 
 // Forward declaration of the setup methods
+unsigned int FixedStepArgument(int argc, char** argv);
+bool PipelinedArgument(int argc, char** argv);
+string LogFileArgument(int argc, char** argv);
+bool ParseArguments(Config&, int argc, char** argv);
+void PrintUsage(const char* program);
 void SetupResources(Config&);
 void SetupDevices(Config&);
 void SetupDisplay(Config&);
@@ -175,12 +403,56 @@ void SetupSound(Config&);
 
 int main(int argc, char** argv) {
 
-    // Setup logging facilities.
-    Logger::AddLogger(new StreamLogger(&std::cout));
+    // Setup logging facilities. Messages are written out on a thread
+    // of their own, and drained on every way out of main.
+    AsyncLogger* log = new AsyncLogger(LogFileArgument(argc, argv));
+    Logger::AddLogger(log);
+    struct LogFlush {
+        AsyncLogger* log;
+        ~LogFlush() { log->Stop(); }
+    } flush = { log };
+    if (!log->IsOpen())
+        logger.error << "Can not open the log file, logging to stdout"
+                     << logger.end;
 
-    // Create an engine and config object
-    Engine* engine = new Engine();
+    // Create an engine and config object. Benchmarks and fixed step
+    // runs advance a virtual clock instead of the wall clock, and the
+    // pipelined engine simulates on a thread of its own.
+    unsigned int step = FixedStepArgument(argc, argv);
+    PipelinedEngine* pipelined = NULL;
+    IEngine* engine;
+    if (PipelinedArgument(argc, argv))
+        engine = pipelined = new PipelinedEngine(step);
+    else if (step) engine = new FixedStepEngine(step);
+    else           engine = new Engine();
     Config config(*engine);
+    config.fixedStep = step;
+    config.pipelined = pipelined;
+    if (!ParseArguments(config, argc, argv)) {
+        delete engine;
+        return EXIT_FAILURE;
+    }
+
+    // CPU backend modes run without a GL context and exit
+    if (config.cpuBench || !config.cpuBatchEffects.empty()) {
+        unsigned int threads = config.cpuThreads ? config.cpuThreads
+            : TileScheduler::HardwareThreads();
+        bool done = true;
+        if (config.cpuBench)
+            RunCPUBenchmark(config.width, config.height, threads);
+        else
+            done = RunCPUBatch(config.cpuBatchEffects, config.cpuBatchList,
+                               config.cpuBatchOutput, threads);
+        delete engine;
+        return done ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Listeners attached from here on are traced, and the frames are
+    // marked before anything else is processed.
+    if (!config.trace.empty()) {
+        config.tracer = new Tracer(config.trace);
+        engine->ProcessEvent().Attach(*config.tracer);
+    }
 
     // Setup the engine
     SetupResources(config);
@@ -194,17 +466,308 @@ int main(int argc, char** argv) {
 
     // Start up the engine.
     engine->Start();
+    if (config.tracer) config.tracer->Dump();
 
     // release event system
     // post condition: scene and modules are not processed
     delete engine;
 
+    if (config.culling) {
+        CullNode::Stats cull = config.culling->GetStats();
+        if (cull.passes)
+            logger.info << "Culling: " << cull.entries << " subtrees, "
+                        << (double)cull.visited / cull.passes << " visited and "
+                        << (double)cull.drawn / cull.passes
+                        << " drawn per pass" << logger.end;
+    }
+
+    if (config.shadows) {
+        ShadowStage::Stats shadow = config.shadows->TakeStats();
+        if (shadow.frames)
+            logger.info << "Shadows: " << shadow.staticUpdates
+                        << " static layer updates in " << shadow.frames
+                        << " frames, " << shadow.staticTexels / shadow.frames
+                        << " static and " << shadow.dynamicTexels / shadow.frames
+                        << " dynamic texels redrawn per frame" << logger.end;
+    }
+
+    // the instanced nodes use the stress mesh until they are deleted
     delete config.scene;
+    if (config.instanceMesh) TeaPotMesh::Release(config.instanceMesh);
 
     // Return when the engine stops.
+    if (config.benchmarkRun && !config.benchmarkRun->Passed())
+        return EXIT_FAILURE;
     return EXIT_SUCCESS;
 }
 
+// Limits of the numeric options.
+static const double MAX_FIXED_STEP_MS = 1000.0;
+static const long MAX_FRAMES = 100000000;
+static const long MAX_RESOLUTION = 16384;
+static const long MAX_INSTANCES = 1000000;
+static const long MAX_UPLOAD_BUDGET_KB = 1 << 20;
+static const long MAX_CPU_THREADS = 256;
+static const double MAX_TARGET_FPS = 1000.0;
+
+// Names of the scaled stages made in SetupRendering.
+static const char* SCALED_EFFECTS[] = {
+    "motionBlur", "simpleDoF", "dof", "volumetricLightScattering",
+    "twoPassBlur", "gaussianBlur", "glow" };
+static const unsigned int SCALED_EFFECT_COUNT =
+    sizeof(SCALED_EFFECTS) / sizeof(SCALED_EFFECTS[0]);
+
+bool IsScaledEffect(const string& name) {
+    for (unsigned int i = 0; i < SCALED_EFFECT_COUNT; i++)
+        if (name == SCALED_EFFECTS[i]) return true;
+    return false;
+}
+
+// Whole number in [low, high], false for anything else, including
+// signs out of range, trailing text and overflow.
+bool ReadCount(const char* text, long low, long high, unsigned int& value) {
+    char* end;
+    errno = 0;
+    long n = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || errno == ERANGE || n < low || n > high)
+        return false;
+    value = (unsigned int)n;
+    return true;
+}
+
+bool ReadReal(const char* text, double low, double high, double& value) {
+    char* end;
+    errno = 0;
+    double x = strtod(text, &end);
+    if (end == text || *end != '\0' || errno == ERANGE || !(x >= low && x <= high))
+        return false;
+    value = x;
+    return true;
+}
+
+// ReadCount and ReadReal for the value of option, logging bad ones.
+bool ParseCount(const string& option, const char* text, long low, long high,
+                unsigned int& value) {
+    if (ReadCount(text, low, high, value)) return true;
+    logger.error << "Invalid value for " << option << ": " << text
+                 << " (expected " << low << " to " << high << ")" << logger.end;
+    return false;
+}
+
+bool ParseReal(const string& option, const char* text, double low, double high,
+               double& value) {
+    if (ReadReal(text, low, high, value)) return true;
+    logger.error << "Invalid value for " << option << ": " << text
+                 << " (expected " << low << " to " << high << ")" << logger.end;
+    return false;
+}
+
+// Time step in microseconds from --fixed-step ms, 60 Hz for
+// --benchmark, 0 for the wall clock. The engine is needed before the
+// rest of the arguments are parsed, which reject an invalid step.
+unsigned int FixedStepArgument(int argc, char** argv) {
+    unsigned int step = 0;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        double ms;
+        if (arg == "--fixed-step" && i + 1 < argc) {
+            if (ReadReal(argv[++i], 0.001, MAX_FIXED_STEP_MS, ms))
+                step = (unsigned int)(ms * 1000.0);
+        }
+        else if (arg == "--benchmark" && step == 0)
+            step = 16667;
+    }
+    return step;
+}
+
+bool PipelinedArgument(int argc, char** argv) {
+    for (int i = 1; i < argc; i++)
+        if (string(argv[i]) == "--pipelined") return true;
+    return false;
+}
+
+// Log file from --log-file path, empty for stdout. Logging is set up
+// before anything else.
+string LogFileArgument(int argc, char** argv) {
+    for (int i = 1; i + 1 < argc; i++)
+        if (string(argv[i]) == "--log-file") return argv[i + 1];
+    return "";
+}
+
+bool ParseArguments(Config& config, int argc, char** argv) {
+    bool valid = true;
+    for (int i = 1; i < argc && valid; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--headless")
+            config.headless = true;
+        else if (arg == "--frames" && hasValue)
+            valid = ParseCount(arg, argv[++i], 0, MAX_FRAMES, config.frames);
+        else if (arg == "--width" && hasValue)
+            valid = ParseCount(arg, argv[++i], 1, MAX_RESOLUTION, config.width);
+        else if (arg == "--height" && hasValue)
+            valid = ParseCount(arg, argv[++i], 1, MAX_RESOLUTION, config.height);
+        else if (arg == "--profile" && hasValue)
+            config.profile = argv[++i];
+        else if (arg == "--shader-cache" && hasValue)
+            config.shaderCache = argv[++i];
+        else if (arg == "--scale" && hasValue) {
+            // name=divisor, e.g. glow=4
+            string value = argv[++i];
+            string::size_type eq = value.find('=');
+            unsigned int divisor = 0;
+            if (eq != string::npos) ReadCount(value.c_str() + eq + 1, 1, 4, divisor);
+            valid = (divisor == 1 || divisor == 2 || divisor == 4) &&
+                IsScaledEffect(value.substr(0, eq));
+            if (valid) config.scales[value.substr(0, eq)] = divisor;
+            else {
+                string names;
+                for (unsigned int j = 0; j < SCALED_EFFECT_COUNT; j++)
+                    names += string(j ? ", " : "") + SCALED_EFFECTS[j];
+                logger.error << "Invalid scale: " << value
+                             << " (expected name=1, 2 or 4 for one of "
+                             << names << ")" << logger.end;
+            }
+        }
+        else if (arg == "--temporal" && hasValue) {
+            // may be repeated; the other effects come from the effects
+            // extension and can not spread their samples over frames
+            string value = argv[++i];
+            valid = value == "motionBlur" || value == "all";
+            if (valid) config.temporal.push_back(value);
+            else logger.error << "Invalid temporal effect: " << value
+                              << " (only motionBlur has a temporal mode)"
+                              << logger.end;
+        }
+        else if (arg == "--fixed-step" && hasValue) {
+            // read by FixedStepArgument, only checked here
+            double ms;
+            valid = ParseReal(arg, argv[++i], 0.001, MAX_FIXED_STEP_MS, ms);
+        }
+        else if (arg == "--pipelined")
+            ; // read by PipelinedArgument
+        else if (arg == "--log-file" && hasValue)
+            ++i; // read by LogFileArgument
+        else if (arg == "--trace" && hasValue)
+            config.trace = argv[++i];
+        else if (arg == "--target-fps" && hasValue)
+            // scale the render resolution to hold this frame rate
+            valid = ParseReal(arg, argv[++i], 0.0, MAX_TARGET_FPS, config.targetFps);
+        else if (arg == "--gl-debug" && hasValue) {
+            string value = argv[++i];
+            valid = GLDiagnostics::ParseMode(value, config.glDebug,
+                                             config.glDebugInterval);
+            if (!valid)
+                logger.error << "Invalid GL debug mode: " << value
+                             << " (expected auto, off, callback or"
+                             << " sampled[=frames])" << logger.end;
+        }
+        else if (arg == "--benchmark")
+            config.benchmark = true;
+        else if (arg == "--golden" && hasValue)
+            config.golden = argv[++i];
+        else if (arg == "--update-golden")
+            config.updateGolden = true;
+        else if (arg == "--golden-tolerance" && hasValue) {
+            valid = ParseReal(arg, argv[++i], 0.0, 255.0, config.goldenTolerance);
+            config.goldenTolerance /= 255.0;
+        }
+        else if (arg == "--golden-p99" && hasValue) {
+            valid = ParseReal(arg, argv[++i], 0.0, 255.0, config.goldenP99);
+            config.goldenP99 /= 255.0;
+        }
+        else if (arg == "--capture" && hasValue)
+            config.capture = argv[++i];
+        else if (arg == "--capture-format" && hasValue)
+            config.captureFormat = argv[++i];
+        else if (arg == "--cached-shadows")
+            config.cachedShadows = true;
+        else if (arg == "--instances" && hasValue)
+            valid = ParseCount(arg, argv[++i], 0, MAX_INSTANCES, config.instances);
+        else if (arg == "--model" && hasValue)
+            config.models.push_back(argv[++i]);
+        else if (arg == "--texture" && hasValue)
+            config.texture = argv[++i];
+        else if (arg == "--upload-budget" && hasValue)
+            // kilobytes of texture data uploaded per frame
+            valid = ParseCount(arg, argv[++i], 1, MAX_UPLOAD_BUDGET_KB,
+                               config.uploadBudget);
+        else if (arg == "--cpu-bench")
+            config.cpuBench = true;
+        else if (arg == "--cpu-threads" && hasValue)
+            valid = ParseCount(arg, argv[++i], 0, MAX_CPU_THREADS, config.cpuThreads);
+        else if (arg == "--cpu-batch" && i + 3 < argc) {
+            config.cpuBatchEffects = argv[++i];
+            config.cpuBatchList = argv[++i];
+            config.cpuBatchOutput = argv[++i];
+        }
+        else {
+            logger.error << "Unknown argument: " << arg << logger.end;
+            valid = false;
+        }
+    }
+    // the capture format follows the file extension unless given
+    if (valid && (!config.capture.empty() || !config.captureFormat.empty())) {
+        string::size_type dot = config.capture.rfind('.');
+        if (config.captureFormat.empty() && dot != string::npos)
+            config.captureFormat = config.capture.substr(dot + 1);
+        FrameCapture::Format format;
+        valid = FrameCapture::ParseFormat(config.captureFormat, format);
+        if (!valid)
+            logger.error << "Unknown capture format: '" << config.captureFormat
+                         << "' (expected raw, ppm or y4m, by --capture-format"
+                         << " or the extension of the --capture path)"
+                         << logger.end;
+    }
+    if (!valid) {
+        PrintUsage(argv[0]);
+        return false;
+    }
+    // a headless run must terminate on its own; the benchmark stops
+    // when its script is done
+    if (config.headless && config.frames == 0 && !config.benchmark)
+        config.frames = 100;
+    return true;
+}
+
+void PrintUsage(const char* program) {
+    logger.error << "Usage: " << program
+                 << " [--headless] [--frames n]"
+                 << " [--width w] [--height h]"
+                 << " [--profile basename]"
+                 << " [--shader-cache dir]"
+                 << " [--scale effect=1|2|4]"
+                 << " [--temporal motionBlur|all]"
+                 << " [--fixed-step ms] [--pipelined]"
+                 << " [--log-file path] [--trace file.json]"
+                 << " [--target-fps fps]"
+                 << " [--gl-debug auto|off|callback|sampled[=n]]"
+                 << " [--capture path] [--capture-format raw|ppm|y4m]"
+                 << " [--cached-shadows]"
+                 << " [--instances n] [--model file.obj]"
+                 << " [--texture file.tga|ppm] [--upload-budget kb]"
+                 << logger.end
+                 << "       " << program
+                 << " --benchmark [--headless] [--golden dir]"
+                 << " [--update-golden] [--golden-tolerance n]"
+                 << " [--golden-p99 n]"
+                 << " [--profile basename]" << logger.end
+                 << "       " << program
+                 << " --cpu-bench [--width w] [--height h]"
+                 << " [--cpu-threads n]" << logger.end
+                 << "       " << program
+                 << " --cpu-batch effect[,effect] frames.txt outdir"
+                 << " [--cpu-threads n]" << logger.end;
+    // the CPU backend has effects of its own under the same names
+    std::vector<string> names = CPUEffects::GetNames();
+    string list;
+    for (unsigned int i = 0; i < names.size(); i++)
+        list += (i ? ", " : "") + names[i];
+    logger.error << "The --cpu-bench and --cpu-batch effects are CPU-only"
+                 << " approximations, not the effects the demo renders: "
+                 << list << logger.end;
+}
+
 void SetupResources(Config& config) {
     // set the resources directory
     // @todo we should check that this path exists
@@ -225,7 +788,13 @@ void SetupDisplay(Config& config) {
         throw Exception("Setup display dependencies are not satisfied.");
 
     //config.frame         = new SDLFrame(1440, 900, 32, FRAME_FULLSCREEN);
-    config.frame         = new SDLFrame(800, 600, 32);
+    if (config.headless) {
+        config.frame     = new HeadlessFrame(config.width, config.height, 32);
+        // SDL is still used for (empty) input, keep it off the display
+        putenv((char*)"SDL_VIDEODRIVER=dummy");
+    }
+    else
+        config.frame     = new SDLFrame(config.width, config.height, 32);
     config.viewingvolume = new ViewingVolume();
     config.camera        = new Camera( *config.viewingvolume );
     //config.frustum       = new Frustum(*config.camera, 20, 3000);
@@ -233,12 +802,17 @@ void SetupDisplay(Config& config) {
     config.camera->SetPosition(Vector<3,float>(0,0,10));
     config.camera->LookAt(Vector<3,float>(0,0,0));
 
-    config.viewport      = new Viewport(*config.frame);
+    config.viewport      = new ScaledViewport(*config.frame);
     config.viewport->SetViewingVolume(config.camera);
 
-    config.engine.InitializeEvent().Attach(*config.frame);
-    config.engine.ProcessEvent().Attach(*config.frame);
-    config.engine.DeinitializeEvent().Attach(*config.frame);
+    Traced(config.engine.InitializeEvent(), "initialize").Attach(*config.frame);
+    Traced(config.engine.ProcessEvent(), "process").Attach(*config.frame);
+    Traced(config.engine.DeinitializeEvent(), "deinitialize").Attach(*config.frame);
+
+    if (config.frames > 0) {
+        FrameLimiter* limiter = new FrameLimiter(config.engine, config.frames);
+        Traced(config.engine.ProcessEvent(), "process").Attach(*limiter);
+    }
 }
 
 void SetupDevices(Config& config) {
@@ -254,18 +828,22 @@ void SetupDevices(Config& config) {
     QuitHandler* quit_h = new QuitHandler(config.engine);
     config.keyboard->KeyEvent().Attach(*quit_h);
 
+    // F9 saves the trace so far
+    if (config.tracer)
+        config.keyboard->KeyEvent().Attach(*config.tracer);
+
     // Bind to the engine for processing time
-    config.engine.InitializeEvent().Attach(*input);
-    config.engine.ProcessEvent().Attach(*input);
-    config.engine.DeinitializeEvent().Attach(*input);
+    Traced(config.engine.InitializeEvent(), "initialize").Attach(*input);
+    Traced(config.engine.ProcessEvent(), "process").Attach(*input);
+    Traced(config.engine.DeinitializeEvent(), "deinitialize").Attach(*input);
 
     MoveHandler* move_h = 
         new MoveHandler(*config.camera, *input->GetMouse());
     move_h->SetObjectMove(false);
     config.keyboard->KeyEvent().Attach(*move_h);
-    config.engine.InitializeEvent().Attach(*move_h);
-    config.engine.ProcessEvent().Attach(*move_h);
-    config.engine.DeinitializeEvent().Attach(*move_h);
+    Traced(config.engine.InitializeEvent(), "initialize").Attach(*move_h);
+    Traced(config.engine.ProcessEvent(), "process").Attach(*move_h);
+    Traced(config.engine.DeinitializeEvent(), "deinitialize").Attach(*move_h);
     
 }
 
@@ -282,18 +860,33 @@ void SetupRendering(Config& config) {
     Renderer* renderer = new Renderer(config.viewport);
     renderer->SetBackgroundColor(Vector<4,float>(0,0,0,1));
     //renderer->SetSceneRoot(new SceneNode());
-    config.engine.InitializeEvent().Attach(*renderer);
-    config.engine.ProcessEvent().Attach(*renderer);
-    config.engine.DeinitializeEvent().Attach(*renderer);
-    renderer->ProcessEvent().Attach(*rv);
+    Traced(config.engine.InitializeEvent(), "initialize").Attach(*renderer);
+    Traced(config.engine.ProcessEvent(), "process").Attach(*renderer);
+    Traced(config.engine.DeinitializeEvent(), "deinitialize").Attach(*renderer);
+    Traced(renderer->ProcessEvent(), "render").Attach(*rv);
     config.renderer = renderer;
 
+    // GL errors are reported by the driver or sampled, see --gl-debug
+    GLDiagnostics* diagnostics =
+        new GLDiagnostics(config.glDebug, config.glDebugInterval);
+    Traced(renderer->PreProcessEvent(), "pre render").Attach(*diagnostics);
+    Traced(config.engine.DeinitializeEvent(), "deinitialize").Attach(*diagnostics);
+
     // Add rendering initialization tasks
     config.textureLoader = new TextureLoader(*renderer);
-    renderer->PreProcessEvent().Attach(*config.textureLoader);
+    Traced(renderer->PreProcessEvent(), "pre render").Attach(*config.textureLoader);
+    // textures given on the command line are streamed in over frames
+    if (!config.texture.empty()) {
+        config.streaming = new StreamingTextureLoader(config.uploadBudget * 1024);
+        Traced(renderer->PreProcessEvent(), "pre render").Attach(*config.streaming);
+        Traced(config.engine.DeinitializeEvent(), "deinitialize").Attach(*config.streaming);
+    }
 
-    renderer->PreProcessEvent()
+    Traced(renderer->PreProcessEvent(), "pre render")
       .Attach( *(new LightRenderer(*config.camera)) );
+    // teapots pick their level of detail with the frame's projection
+    Traced(renderer->PreProcessEvent(), "pre render")
+      .Attach( *(new TeaPotLodFrame(*config.viewport)) );
 
 
     // add post processing effects
@@ -301,62 +894,98 @@ void SetupRendering(Config& config) {
     Viewport* viewport = config.viewport;
 
 	Wobble* wobble;
-    Glow* glow;
-    SimpleBlur* simpleBlur;
-    TwoPassBlur* twoPassBlur;
-    GaussianBlur* gaussianBlur;
-    SimpleMotionBlur* simpleMotionBlur;
-    MotionBlur* motionBlur;
-    SimpleDoF* simpleDoF;
-    EdgeDetection* edgeDetection;
-    Toon* toon;
-    GrayScale* grayscale;
-    Saturate* saturate;
-    Pixelate* pixelate;
-    VolumetricLightScattering* volumetricLightScattering;
-    Shadows* shadows;
+    IPostProcessingEffect* glow;
+    IPostProcessingEffect* simpleBlur;
+    IPostProcessingEffect* twoPassBlur;
+    IPostProcessingEffect* gaussianBlur;
+    IPostProcessingEffect* simpleMotionBlur;
+    IPostProcessingEffect* motionBlur;
+    IPostProcessingEffect* simpleDoF;
+    IPostProcessingEffect* edgeDetection;
+    IPostProcessingEffect* toon;
+    IPostProcessingEffect* grayscale;
+    IPostProcessingEffect* saturate;
+    IPostProcessingEffect* pixelate;
+    IPostProcessingEffect* volumetricLightScattering;
+    IPostProcessingEffect* shadows;
     //ShowImage* showImage;
 
-    vector<IPostProcessingEffect*> fullscreeneffects;
-    vector<std::string> fullscreeneffectsNames;
+    vector<IPostProcessingEffect*>& fullscreeneffects = config.effects;
+    vector<std::string>& fullscreeneffectsNames = config.effectNames;
+
+    // Everything but the chain root is only a descriptor until
+    // EffectHandler enables it the first time. The stand-ins of the
+    // low frequency effects are only switches, see the stages below.
 	wobble                    = new Wobble(viewport,engine);
-    glow                      = new Glow(viewport,engine);
-    simpleBlur                = new SimpleBlur(viewport,engine);
-    twoPassBlur               = new TwoPassBlur(viewport,engine);
-    gaussianBlur              = new GaussianBlur(viewport,engine);
-    simpleMotionBlur          = new SimpleMotionBlur(viewport,engine);
-    motionBlur                = new MotionBlur(viewport,engine);
-    simpleDoF                 = new SimpleDoF(viewport,engine);
-    edgeDetection             = new EdgeDetection(viewport,engine);
-    toon                      = new Toon(viewport,engine);
-    grayscale                 = new GrayScale(viewport,engine);
-    saturate                  = new Saturate(viewport,engine);
-    pixelate                  = new Pixelate(viewport,engine);
-    volumetricLightScattering = new VolumetricLightScattering(viewport,engine);
-    shadows                   = new Shadows(viewport,engine);
+    glow                      = new LazyEffect("glow", NULL, viewport, engine);
+    simpleBlur                = new LazyEffect("simpleBlur", &Construct<SimpleBlur>, viewport, engine);
+    twoPassBlur               = new LazyEffect("twoPassBlur", NULL, viewport, engine);
+    gaussianBlur              = new LazyEffect("gaussianBlur", NULL, viewport, engine);
+    simpleMotionBlur          = new LazyEffect("simpleMotionBlur", &Construct<SimpleMotionBlur>, viewport, engine);
+    motionBlur                = new LazyEffect("motionBlur", NULL, viewport, engine);
+    simpleDoF                 = new LazyEffect("simpleDoF", NULL, viewport, engine);
+    edgeDetection             = new LazyEffect("edgeDetection", &Construct<EdgeDetection>, viewport, engine);
+    toon                      = new LazyEffect("toon", &Construct<Toon>, viewport, engine);
+    grayscale                 = new LazyEffect("grayscale", &Construct<GrayScale>, viewport, engine);
+    saturate                  = new LazyEffect("saturate", &Construct<Saturate>, viewport, engine);
+    pixelate                  = new LazyEffect("pixelate", &Construct<Pixelate>, viewport, engine);
+    volumetricLightScattering = new LazyEffect("volumetricLightScattering", NULL, viewport, engine);
+    shadows                   = new LazyEffect("shadows", config.cachedShadows ? NULL : &Construct<Shadows>, viewport, engine);
     //this->showImage                 = new ShowImage(viewport,engine, texture);
 	//missing: showImage, sunmodule 
 
-    SimpleExample* simpleExample = new SimpleExample(viewport,engine);
-    DoF* dof = new DoF(viewport, engine);
+    IPostProcessingEffect* simpleExample =
+        new LazyEffect("simpleExample", &Construct<SimpleExample>, viewport, engine);
+    IPostProcessingEffect* dof =
+        new LazyEffect("dof", NULL, viewport, engine);
+
+    // The effects that can run as screen stages also have an instance
+    // in the chain, at their original place. It runs while the stage
+    // leaves the effect to the chain: at full resolution, respectively
+    // per frame for motion blur. See StageSwitch.
+    IPostProcessingEffect* glowChained =
+        new LazyEffect("glow", &Construct<Glow>, viewport, engine);
+    IPostProcessingEffect* twoPassBlurChained =
+        new LazyEffect("twoPassBlur", &Construct<TwoPassBlur>, viewport, engine);
+    IPostProcessingEffect* gaussianBlurChained =
+        new LazyEffect("gaussianBlur", &Construct<GaussianBlur>, viewport, engine);
+    IPostProcessingEffect* motionBlurChained =
+        new LazyEffect("motionBlur", &Construct<MotionBlur>, viewport, engine);
+    IPostProcessingEffect* simpleDoFChained =
+        new LazyEffect("simpleDoF", &Construct<SimpleDoF>, viewport, engine);
+    IPostProcessingEffect* volumetricLightScatteringChained =
+        new LazyEffect("volumetricLightScattering",
+                       &Construct<VolumetricLightScattering>, viewport, engine);
+    IPostProcessingEffect* dofChained =
+        new LazyEffect("dof", &Construct<DoF>, viewport, engine);
 
     // muligvis skal rækkefølgen laves om...
-    wobble->Add(edgeDetection);
-    wobble->Add(toon);
-    wobble->Add(glow);
-    wobble->Add(simpleBlur);
-    wobble->Add(twoPassBlur);
-    wobble->Add(gaussianBlur);
-    wobble->Add(simpleMotionBlur);
-    wobble->Add(motionBlur);
-    wobble->Add(simpleDoF);
-    wobble->Add(grayscale);
-    wobble->Add(saturate);
-    wobble->Add(volumetricLightScattering);
-    wobble->Add(shadows);
-    wobble->Add(pixelate);
-    wobble->Add(simpleExample);
-    wobble->Add(dof);
+    vector<IPostProcessingEffect*> chain;
+    chain.push_back(edgeDetection);
+    chain.push_back(toon);
+    chain.push_back(glowChained);
+    chain.push_back(simpleBlur);
+    chain.push_back(twoPassBlurChained);
+    chain.push_back(gaussianBlurChained);
+    chain.push_back(simpleMotionBlur);
+    chain.push_back(motionBlurChained);
+    chain.push_back(simpleDoFChained);
+    chain.push_back(grayscale);
+    chain.push_back(saturate);
+    chain.push_back(volumetricLightScatteringChained);
+    if (!config.cachedShadows) chain.push_back(shadows);
+    chain.push_back(pixelate);
+    chain.push_back(simpleExample);
+    chain.push_back(dofChained);
+
+    // the chain is skipped altogether while none of its effects is
+    // enabled
+    ChainGate* gate = new ChainGate();
+    gate->Add(wobble);
+    for (unsigned int i = 0; i < chain.size(); i++) {
+        wobble->Add(chain[i]);
+        gate->Add(chain[i]);
+    }
 
     wobble->Enable(false);
     glow->Enable(false);
@@ -414,18 +1043,136 @@ void SetupRendering(Config& config) {
     fullscreeneffectsNames.push_back("dof");
 
     PostProcessingEffect* ppe = wobble;
-        
-    IRenderingView* rv2 = new Preprocessing(*viewport, ppe);
-    IRenderingView* rv3 = new Postprocessing(*viewport, ppe);
-    renderer->PreProcessEvent().Attach(*rv2);
-    renderer->PostProcessEvent().Attach(*rv3);
+
+    // time every pass of the chain per enabled effect set
+    config.profiler = new EffectProfiler();
+    config.profiler->SetDumpName(config.profile);
+    Traced(config.engine.DeinitializeEvent(), "deinitialize").Attach(*config.profiler);
+
+    // screen stages run after the chain, on the finished frame
+    RenderTargetPool* pool = new RenderTargetPool();
+    Traced(config.engine.DeinitializeEvent(), "deinitialize").Attach(*pool);
+    ProgramCache* programs = new ProgramCache(config.shaderCache);
+    config.pipeline = new ScreenPipeline(*pool);
+
+    // below the target frame rate the scene and the screen stages are
+    // rendered smaller and scaled up to the window; benchmarks stay at
+    // full resolution, so the frames compared with the goldens do not
+    // depend on timing and fill the whole viewport
+    DynamicResolution* resolution = NULL;
+    if (config.targetFps > 0 && config.benchmark)
+        logger.warning << "--target-fps is ignored while benchmarking"
+                       << logger.end;
+    else if (config.targetFps > 0)
+        resolution = new DynamicResolution(*config.viewport, *config.profiler,
+                                           *pool, *programs,
+                                           1000.0 / config.targetFps);
+    IRenderingView* rv2 = new Preprocessing(*viewport, ppe, *gate,
+                                            config.profiler, resolution,
+                                            fullscreeneffects,
+                                            fullscreeneffectsNames);
+
+    // with --cached-shadows the shadows are drawn by a screen stage
+    // instead of the Shadows effect; it darkens the lit scene before
+    // anything blurs it, and its depth maps are only redrawn where
+    // casters moved
+    if (config.cachedShadows) {
+        config.shadows = new ShadowStage("shadows", shadows, *programs,
+                                         *viewport);
+        config.pipeline->Add(config.shadows);
+    }
+
+    // low frequency effects run in the chain at full resolution unless
+    // --scale or F8 reduces them; then they run after the chain at the
+    // reduced size and are brought back with a depth aware upsample.
+    // Temporal motion blur needs the full resolution to keep its
+    // streaks sharp.
+    IFrame& frame = *config.frame;
+    ScaledViewport& sceneViewport = *config.viewport;
+    IViewingVolume* volume = config.camera;
+    vector<ScaledStage*> scaled;
+    vector<IPostProcessingEffect*> chained;
+    scaled.push_back(new MotionBlurStage("motionBlur", motionBlur, *programs, 0.5f));
+    chained.push_back(motionBlurChained);
+    scaled.push_back(new EffectStage("simpleDoF", simpleDoF, *programs,
+                                     &Construct<SimpleDoF>,
+                                     frame, sceneViewport, volume, engine));
+    chained.push_back(simpleDoFChained);
+    scaled.push_back(new EffectStage("dof", dof, *programs,
+                                     &Construct<DoF>,
+                                     frame, sceneViewport, volume, engine));
+    chained.push_back(dofChained);
+    scaled.push_back(new EffectStage("volumetricLightScattering",
+                                     volumetricLightScattering, *programs,
+                                     &Construct<VolumetricLightScattering>,
+                                     frame, sceneViewport, volume, engine));
+    chained.push_back(volumetricLightScatteringChained);
+    scaled.push_back(new EffectStage("twoPassBlur", twoPassBlur, *programs,
+                                     &Construct<TwoPassBlur>,
+                                     frame, sceneViewport, volume, engine));
+    chained.push_back(twoPassBlurChained);
+    scaled.push_back(new EffectStage("gaussianBlur", gaussianBlur, *programs,
+                                     &Construct<GaussianBlur>,
+                                     frame, sceneViewport, volume, engine));
+    chained.push_back(gaussianBlurChained);
+    scaled.push_back(new EffectStage("glow", glow, *programs,
+                                     &Construct<Glow>,
+                                     frame, sceneViewport, volume, engine));
+    chained.push_back(glowChained);
+    ScaleHandler* scaleHandler = new ScaleHandler();
+    for (unsigned int i = 0; i < scaled.size(); i++) {
+        std::map<string, int>::iterator scale = config.scales.find(scaled[i]->GetName());
+        if (scale != config.scales.end()) scaled[i]->SetScale(scale->second);
+        for (unsigned int j = 0; j < config.temporal.size(); j++)
+            if (config.temporal[j] == "all" ||
+                config.temporal[j] == scaled[i]->GetName())
+                scaled[i]->SetTemporal(true);
+        config.pipeline->Add(scaled[i]);
+        scaleHandler->Add(scaled[i]);
+        StageSwitch* stageSwitch = new StageSwitch(chained[i], *scaled[i]);
+        Traced(config.engine.ProcessEvent(), "process").Attach(*stageSwitch);
+    }
+    config.keyboard->KeyEvent().Attach(*scaleHandler);
+
+    IRenderingView* rv3 = new Postprocessing(*viewport, ppe, *gate,
+                                             config.pipeline, config.profiler,
+                                             resolution, fullscreeneffects,
+                                             fullscreeneffectsNames);
+    Traced(renderer->PreProcessEvent(), "pre render").Attach(*rv2);
+    Traced(renderer->PostProcessEvent(), "post render").Attach(*rv3);
+
+    if (!config.capture.empty()) {
+        // the format is checked and resolved by ParseArguments
+        FrameCapture::Format f;
+        FrameCapture::ParseFormat(config.captureFormat, f);
+        // a fixed step run may wait for the writer, a live one drops
+        FrameCapture* capture = new FrameCapture(config.capture, f, 8,
+                                                 config.fixedStep != 0);
+        if (config.fixedStep)
+            capture->SetFrameRate(1000000, config.fixedStep);
+        Traced(renderer->PostProcessEvent(), "post render").Attach(*capture);
+        Traced(config.engine.DeinitializeEvent(), "deinitialize").Attach(*capture);
+    }
+
+    if (config.benchmark) {
+        Benchmark* benchmark = new Benchmark(config.engine, *config.profiler,
+                                             fullscreeneffects,
+                                             fullscreeneffectsNames);
+        benchmark->AddDefaultScript();
+        benchmark->SetGolden(config.golden, config.updateGolden,
+                             config.goldenTolerance, config.goldenP99);
+        if (!config.profile.empty())
+            benchmark->SetReportName(config.profile + "_benchmark");
+        Traced(renderer->PostProcessEvent(), "post render").Attach(*benchmark);
+        config.benchmarkRun = benchmark;
+    }
 
     VolumetricLightScattering* sun = new
         VolumetricLightScattering(viewport,engine);
     TransformationNode* sunTrans = new TransformationNode();
     SunModule* sunModule = new SunModule(sun,
                                          sunTrans, config.camera);
-    config.engine.ProcessEvent().Attach(*sunModule);
+    Traced(config.engine.ProcessEvent(), "process").Attach(*sunModule);
     sun->Enable(true);
     sunModule->SetFollowSun(false);
     //config.scene->AddNode(sunTrans);
@@ -459,50 +1206,140 @@ void SetupScene(Config& config) {
     light1Pos->SetPosition(Vector<3,float>(-100,0,0));
     light1Pos->AddNode(light1);
     config.scene->AddNode(light1Pos);
+    if (config.shadows) config.shadows->SetLight(light1Pos);
 
     //Bind renderstatenode handler: F1...
     RenderStateHandler* rs_h = new RenderStateHandler(*renderStateNode);
     config.keyboard->KeyEvent().Attach(*rs_h);
     
 
-    TransformationNode* left = new TransformationNode();
-    //left->SetPosition(Vector<3,float>(-10,0,0));
-
-    TransformationNode* topCenter = new TransformationNode();
-    //topCenter->SetPosition(Vector<3,float>(0,7,0));
-    topCenter->SetRotation(Quaternion<float>(Math::PI/2,0,Math::PI/2));
-
-    TransformationNode* right = new TransformationNode();
-    //right->SetPosition(Vector<3,float>(10,0,0));
-    right->SetRotation(Quaternion<float>(Math::PI,0,Math::PI));
+    // key poses of the teapot
+    TransformationNode left;
+    //left.SetPosition(Vector<3,float>(-10,0,0));
+
+    TransformationNode topCenter;
+    //topCenter.SetPosition(Vector<3,float>(0,7,0));
+    topCenter.SetRotation(Quaternion<float>(Math::PI/2,0,Math::PI/2));
+
+    TransformationNode right;
+    //right.SetPosition(Vector<3,float>(10,0,0));
+    right.SetRotation(Quaternion<float>(Math::PI,0,Math::PI));
+
+    TransformationNode bottomCenter;
+    //bottomCenter.SetPosition(Vector<3,float>(0,-7,0));
+    bottomCenter.SetRotation(Quaternion<float>(-Math::PI/2,0,-Math::PI/2));
+
+    // all animated nodes share one set of tracks and one listener;
+    // pipelined, the tracks run on the simulation thread and drive a
+    // copy of the node that is handed over once per frame
+    KeyframeTracks* tracks = new KeyframeTracks();
+    TransformationNode* trans = new TransformationNode();
+    TransformationNode* animated = trans;
+    if (config.pipelined) {
+        animated = new TransformationNode();
+        Traced(config.pipelined->SimulationEvent(), "simulation").Attach(*tracks);
+    }
+    else Traced(config.engine.ProcessEvent(), "process").Attach(*tracks);
 
-    TransformationNode* bottomCenter = new TransformationNode();
-    //bottomCenter->SetPosition(Vector<3,float>(0,-7,0));
-    bottomCenter->SetRotation(Quaternion<float>(-Math::PI/2,0,-Math::PI/2));
-
-    TransformationNodeMorpher* tmorpher =
-      new TransformationNodeMorpher();
-    
-    MetaMorpher<TransformationNode>* metamorpher =
-      new MetaMorpher<TransformationNode>
-      (tmorpher,LOOP);
-    config.engine.ProcessEvent().Attach(*metamorpher);
-    metamorpher->Add(left, new Utils::Time(0));
-    metamorpher->Add(topCenter, new Utils::Time(3000000));
-    metamorpher->Add(right, new Utils::Time(6000000));
-    metamorpher->Add(bottomCenter, new Utils::Time(9000000));
-    metamorpher->Add(left, new Utils::Time(12000000));
-    
-    TransformationNode* trans = metamorpher->GetObject();
-    trans->AddNode(new TeaPotNode(1.0));
+    unsigned int track = tracks->AddTrack(animated);
+    tracks->AddKey(track, 0, left);
+    tracks->AddKey(track, 3000000, topCenter);
+    tracks->AddKey(track, 6000000, right);
+    tracks->AddKey(track, 9000000, bottomCenter);
+    tracks->AddKey(track, 12000000, left);
 
+    TeaPotNode* teapot = new TeaPotNode(1.0);
 
     TransformationNode* tnode = new TransformationNode();
     tnode->Rotate(0,0,Math::PI);
     tnode->Rotate(0,Math::PI/2,0);
-    config.scene->AddNode(tnode);
 
-    tnode->AddNode(trans);
+    // tnode and trans are flattened into a draw list with cached world
+    // matrices; the tracks, or the pipelined state, flag trans when
+    // they move it
+    RenderList* list = new RenderList();
+    unsigned int base = list->AddTransformation(tnode);
+    unsigned int spin = list->AddTransformation(trans, base);
+    list->AddItem(teapot, spin, 0);
+    if (config.pipelined)
+        config.pipelined->GetState()
+            .AddTransformation(animated, trans, &list->GetTransforms());
+    else tracks->SetTransformCache(&list->GetTransforms());
+    if (config.shadows)
+        config.shadows->AddCaster(new TransformedCaster(teapot, teapot->GetBounds(),
+                                                        list->GetTransforms(), spin),
+                                  true);
+
+    // the animated teapot only rotates, so its bounds stay put
+    config.culling = new CullNode();
+    config.scene->AddNode(config.culling);
+    TransformationNode* place = new TransformationNode();
+    place->AddNode(list);
+    config.culling->Add(place, *teapot);
+
+    // cull statistics over the frame, F10 toggles them; benchmarks
+    // start without them
+    StatsHUD* hud = new StatsHUD(*config.frame, *config.culling,
+                                 !config.benchmark);
+    Traced(config.renderer->PostProcessEvent(), "post render").Attach(*hud);
+    config.keyboard->KeyEvent().Attach(*hud);
+
+    // stress mode: a block of instanced teapots behind the animated
+    // one, in chunks of 4x4x4 so the hierarchy can cull them
+    if (config.instances > 0) {
+        MeshBuffer* mesh = config.instanceMesh =
+            TeaPotMesh::Acquire(TEAPOT_LOD_GRIDS[1], 1.0);
+        InstanceSpinner* spinner = new InstanceSpinner(8);
+        std::map<unsigned int, InstancedMeshNode*> chunks;
+        unsigned int side = 1;
+        while (side * side * side < config.instances) side++;
+        const float spacing = 5.0f;
+        for (unsigned int i = 0; i < config.instances; i++) {
+            unsigned int x = i % side, y = (i / side) % side, z = i / (side * side);
+            float position[3] = { (x - (side - 1) * 0.5f) * spacing,
+                                  (y - (side - 1) * 0.5f) * spacing,
+                                  -10.0f - z * spacing };
+            float color[4] = { 0.3f + 0.7f * x / side, 0.3f + 0.7f * y / side,
+                               0.3f + 0.7f * z / side, 1.0f };
+            float m[16];
+            InstanceSpinner::Transform(i * 0.1f, position, m);
+            InstancedMeshNode*& chunk = chunks[(x / 4) + side * ((y / 4) + side * (z / 4))];
+            if (chunk == NULL) chunk = new InstancedMeshNode(mesh, TEAPOT_RADIUS);
+            chunk->AddInstance(m, color);
+        }
+        // one chunk in eight spins, the rest is static scenery
+        std::map<unsigned int, InstancedMeshNode*>::iterator it;
+        unsigned int n = 0;
+        for (it = chunks.begin(); it != chunks.end(); ++it, ++n) {
+            TransformationNode* place = new TransformationNode();
+            place->AddNode(it->second);
+            config.culling->Add(place, *it->second);
+            if (n % 8 == 0) spinner->Add(it->second);
+            if (config.shadows)
+                config.shadows->AddCaster(new InstancedCaster(*it->second), false);
+        }
+        Traced(config.engine.ProcessEvent(), "process").Attach(*spinner);
+        logger.info << "Stress mode with " << config.instances
+                    << " instanced teapots in " << chunks.size()
+                    << " chunks" << logger.end;
+    }
+
+    // models load in the background and appear beside the teapot
+    // when they are done
+    if (!config.models.empty()) {
+        ModelLoader* loader = new ModelLoader();
+        Traced(config.engine.DeinitializeEvent(), "deinitialize").Attach(*loader);
+        StreamedTexture* texture = config.streaming != NULL
+            ? config.streaming->Load(config.texture) : NULL;
+        for (unsigned int i = 0; i < config.models.size(); i++) {
+            TransformationNode* place = new TransformationNode();
+            place->SetPosition(Vector<3,float>(6.0f * (i + 1), 0, 0));
+            MeshNode* mesh = new MeshNode(loader->Load(config.models[i]));
+            mesh->SetTexture(texture);
+            place->AddNode(mesh);
+            config.scene->AddNode(place);
+        }
+    }
 }
 
 void SetupDebugging(Config& config) {